@@ -0,0 +1,216 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University
+ * of Wisconsin-Madison.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "btree.h"
+#include "exceptions/end_of_file_exception.h"
+#include "exceptions/file_not_found_exception.h"
+#include "exceptions/insufficient_space_exception.h"
+#include "file_iterator.h"
+#include "filescan.h"
+
+/**
+ * Compares the hit rates of the buffer replacement policies. A relation of
+ * the tuples used by the tests in main.cpp, large enough to be many times the
+ * buffer pool, is indexed on its integer attribute; every policy then runs the
+ * same workloads on a buffer pool of its own:
+ *
+ * - skewed: index lookups, most of them for a small set of hot keys, each
+ *   followed by reading the record found
+ * - skewed+scan: the same lookups, with a full scan of the relation now and
+ *   then, which a good policy keeps from flushing out the hot pages
+ * - loop: pages of the relation read in turn, over and over, a tenth more of
+ *   them than fit in the pool, so that LRU evicts every page just before it
+ *   is needed again
+ *
+ * Usage: badgerdb_bench [frames [records]]
+ */
+
+using namespace badgerdb;
+
+// -----------------------------------------------------------------------------
+// Globals
+// -----------------------------------------------------------------------------
+const std::string relationName = "relBench";
+
+typedef struct tuple {
+  int i;
+  double d;
+  char s[64];
+} RECORD;
+
+// -----------------------------------------------------------------------------
+// Forward declarations
+// -----------------------------------------------------------------------------
+
+void createRelation(int numRecords);
+void lookup(BufMgr* bufMgr, PageFile* file, BTreeIndex* index, int key);
+void scan(BufMgr* bufMgr, int numRecords);
+void runWorkload(const std::string& workload, ReplacementPolicyType policy,
+                 int frames, int numRecords);
+
+int main(int argc, char** argv) {
+  int frames = argc > 1 ? atoi(argv[1]) : 100;
+  int numRecords = argc > 2 ? atoi(argv[2]) : 100000;
+
+  createRelation(numRecords);
+
+  // build the index once, every policy then opens it
+  std::string indexName;
+  {
+    BufMgr bufMgr(frames);
+    BTreeIndex index(relationName, indexName, &bufMgr, offsetof(tuple, i),
+                     INTEGER);
+  }
+
+  std::cout << std::left << std::setw(14) << "workload" << std::setw(12)
+            << "policy" << std::right << std::setw(10) << "accesses"
+            << std::setw(10) << "reads" << std::setw(10) << "hit rate"
+            << std::endl;
+
+  const char* workloads[] = {"skewed", "skewed+scan", "loop"};
+  const ReplacementPolicyType policies[] = {CLOCK_POLICY, LRUK_POLICY,
+                                            TWOQ_POLICY, ARC_POLICY,
+                                            CLOCKPRO_POLICY};
+  for (const char* workload : workloads) {
+    for (ReplacementPolicyType policy : policies) {
+      runWorkload(workload, policy, frames, numRecords);
+    }
+  }
+
+  File::remove(indexName);
+  File::remove(relationName);
+  return 0;
+}
+
+// -----------------------------------------------------------------------------
+// createRelation
+// -----------------------------------------------------------------------------
+
+void createRelation(int numRecords) {
+  try {
+    File::remove(relationName);
+  } catch (const FileNotFoundException& e) {
+  }
+
+  PageFile file = PageFile::create(relationName);
+  RECORD record;
+  memset(record.s, ' ', sizeof(record.s));
+  PageId pageNo;
+  Page page = file.allocatePage(pageNo);
+
+  for (int i = 0; i < numRecords; i++) {
+    sprintf(record.s, "%05d string record", i);
+    record.i = i;
+    record.d = (double)i;
+    std::string data(reinterpret_cast<char*>(&record), sizeof(record));
+
+    while (1) {
+      try {
+        page.insertRecord(data);
+        break;
+      } catch (const InsufficientSpaceException& e) {
+        file.writePage(pageNo, page);
+        page = file.allocatePage(pageNo);
+      }
+    }
+  }
+
+  file.writePage(pageNo, page);
+}
+
+// -----------------------------------------------------------------------------
+// lookup
+// -----------------------------------------------------------------------------
+
+void lookup(BufMgr* bufMgr, PageFile* file, BTreeIndex* index, int key) {
+  std::vector<RecordId> rids;
+  index->lookup(&key, rids);
+  for (const RecordId& rid : rids) {
+    Page* page;
+    bufMgr->readPage(file, rid.page_number, page);
+    bufMgr->unPinPage(file, rid.page_number, false);
+  }
+}
+
+// -----------------------------------------------------------------------------
+// scan
+// -----------------------------------------------------------------------------
+
+void scan(BufMgr* bufMgr, int numRecords) {
+  FileScan fscan(relationName, bufMgr);
+  RecordId rid;
+  try {
+    for (int i = 0; i < numRecords; i++) {
+      fscan.scanNext(rid);
+    }
+  } catch (const EndOfFileException& e) {
+  }
+}
+
+// -----------------------------------------------------------------------------
+// runWorkload
+// -----------------------------------------------------------------------------
+
+void runWorkload(const std::string& workload, ReplacementPolicyType policy,
+                 int frames, int numRecords) {
+  BufMgr bufMgr(frames, policy);
+  PageFile file(relationName, false);
+  std::string indexName;
+  BTreeIndex index(relationName, indexName, &bufMgr, offsetof(tuple, i),
+                   INTEGER);
+
+  // the same keys for every policy: 80% of the lookups for 2% of the keys
+  std::mt19937 rng(1);
+  int hotKeys = std::max(1, numRecords / 50);
+  std::uniform_int_distribution<int> hot(0, hotKeys - 1);
+  std::uniform_int_distribution<int> any(0, numRecords - 1);
+  std::uniform_int_distribution<int> percent(0, 99);
+
+  bufMgr.clearBufStats();
+  if (workload == "loop") {
+    std::vector<PageId> pageNos;
+    for (FileIterator it = file.begin(); it != file.end(); ++it) {
+      if (pageNos.size() == std::size_t(frames + frames / 10)) break;
+      pageNos.push_back(it.page_number());
+    }
+    for (int i = 0; i < 20; i++) {
+      for (PageId pageNo : pageNos) {
+        Page* page;
+        bufMgr.readPage(&file, pageNo, page);
+        bufMgr.unPinPage(&file, pageNo, false);
+      }
+    }
+  } else {
+    for (int i = 0; i < 20000; i++) {
+      int key = percent(rng) < 80 ? numRecords / 2 + hot(rng) : any(rng);
+      lookup(&bufMgr, &file, &index, key);
+      if (workload == "skewed+scan" && i % 5000 == 4999) {
+        scan(&bufMgr, numRecords);
+      }
+    }
+  }
+
+  BufStats& stats = bufMgr.getBufStats();
+  double hitRate =
+      stats.accesses == 0
+          ? 0
+          : 100.0 * (stats.accesses - stats.diskreads) / stats.accesses;
+  std::cout << std::left << std::setw(14) << workload << std::setw(12)
+            << bufMgr.getPolicyName() << std::right << std::setw(10)
+            << stats.accesses << std::setw(10) << stats.diskreads
+            << std::setw(9) << std::fixed << std::setprecision(1) << hitRate
+            << "%" << std::endl;
+}
@@ -8,11 +8,17 @@
 
 #include "btree.h"
 
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <queue>
+
 #include "exceptions/bad_index_info_exception.h"
 #include "exceptions/bad_opcodes_exception.h"
 #include "exceptions/bad_scanrange_exception.h"
 #include "exceptions/end_of_file_exception.h"
 #include "exceptions/file_not_found_exception.h"
+#include "exceptions/index_read_only_exception.h"
 #include "exceptions/index_scan_completed_exception.h"
 #include "exceptions/no_such_key_found_exception.h"
 #include "exceptions/scan_not_initialized_exception.h"
@@ -22,369 +28,2334 @@
 
 namespace badgerdb {
 
+// -----------------------------------------------------------------------------
+// Node operations
+// -----------------------------------------------------------------------------
+
+// The tree algorithms of BTreeIndex and IndexCursor touch nodes only through
+// the functions below. They are overloaded for the fixed-size layouts of
+// LeafNode<T> and NonLeafNode<T> and for the prefix compressed STRING layout,
+// so each key type gets its own specialised code.
+
+namespace {
+
+int commonPrefixLength(const char *a, int aLength, const char *b,
+                       int bLength) {
+  int length = std::min(aLength, bLength);
+  int i = 0;
+  while (i < length && a[i] == b[i]) {
+    i++;
+  }
+  return i;
+}
+
+int commonPrefixLength(const StringKey &a, const StringKey &b) {
+  return commonPrefixLength(a.data, a.length, b.data, b.length);
+}
+
 /**
- * Constructor for BTreeIndex
- * First check if the specified index file exists
- * If not, constructed by concatenating the relational name with the offset of
- * the attribute over which the index is built.
- *
- * @param relationName The name of the relation on which to build the index.
- * @param outIndexName The name of the index file
- * @param bufMgrIn The instance of the global buffer manager.
- * @param attrByteOffset The byte offset of the attribute in the tuple on which
- * to build the index.
- * @param attrType The data type of the attribute we are indexing.
- * @throws  BadIndexInfoException     If the index file already exists for the
- * corresponding attribute, but values in metapage(relationName, attribute
- * byte offset, attribute type etc.) do not match with values received through
- * constructor parameters.
+ * Returns the key to separate a node whose last key is leftLast from its right
+ * sibling whose first key is rightFirst. Every key of the right node is greater
+ * than or equal to the separator.
  */
-BTreeIndex::BTreeIndex(const std::string &relationName,
-                       std::string &outIndexName, BufMgr *bufMgrIn,
-                       const int attrByteOffset, const Datatype attrType) {
-  // construct index name
-  std::ostringstream idxStr;
-  idxStr << relationName << '.' << attrByteOffset;
-  outIndexName = idxStr.str();
+template <class T>
+T separatorKey(const T &leftLast, const T &rightFirst) {
+  return rightFirst;
+}
 
-  bool exist = false;
-  // Check if already exists
-  if (File::exists(outIndexName)) {
-    exist = true;
+/**
+ * STRING separators are suffix truncated: the shortest prefix of rightFirst
+ * that is still greater than leftLast.
+ */
+StringKey separatorKey(const StringKey &leftLast, const StringKey &rightFirst) {
+  StringKey separator = rightFirst;
+  if (leftLast < rightFirst) {
+    separator.length = commonPrefixLength(leftLast, rightFirst) + 1;
   }
-  this->nodeOccupancy = INTARRAYNONLEAFSIZE;
-  this->leafOccupancy = INTARRAYLEAFSIZE;
-  this->bufMgr = bufMgrIn;
-  this->scanExecuting = false;
+  return separator;
+}
 
-  Page *headerPage;
-  if (exist) {  // if exist
+// ---- fixed-size leaf nodes
 
-    // Read the file to construct the Btree
-    this->file = new BlobFile(outIndexName, false);
-    this->headerPageNum = this->file->getFirstPageNo();
-    bufMgr->readPage(this->file, this->headerPageNum, headerPage);
-    IndexMetaInfo *metaInfo = (IndexMetaInfo *)headerPage;
-    this->rootPageNum = metaInfo->rootPageNo;
+// fixed-size leaves never hold included bytes, covering indexes use the STRING
+// layout
+template <class T>
+void initNode(LeafNode<T> *node, int payloadLength) {
+  node->numKeys = 0;
+  node->rightSibPageNo = 0;
+}
 
-    // values in metapage not match
-    if (relationName != metaInfo->relationName ||
-        attrByteOffset != metaInfo->attrByteOffset ||
-        attrType != metaInfo->attrType) {
-      throw BadIndexInfoException(outIndexName);
+template <class T>
+const T &keyAt(const LeafNode<T> *node, int i) {
+  return node->keyArray[i];
+}
+
+template <class T>
+const RecordId &ridAt(const LeafNode<T> *node, int i) {
+  return node->ridArray[i];
+}
+
+template <class T>
+RIDKeyPair<T> entryAt(const LeafNode<T> *node, int i) {
+  RIDKeyPair<T> entry;
+  entry.set(node->ridArray[i], node->keyArray[i]);
+  return entry;
+}
+
+template <class T>
+int compareAt(const LeafNode<T> *node, int i, const T &key) {
+  const T &nodeKey = node->keyArray[i];
+  return nodeKey < key ? -1 : (key < nodeKey ? 1 : 0);
+}
+
+template <class T>
+int lowerBound(const LeafNode<T> *node, const T &key) {
+  return std::lower_bound(node->keyArray, node->keyArray + node->numKeys,
+                          key) -
+         node->keyArray;
+}
+
+template <class T>
+int upperBound(const LeafNode<T> *node, const T &key) {
+  return std::upper_bound(node->keyArray, node->keyArray + node->numKeys,
+                          key) -
+         node->keyArray;
+}
+
+template <class T>
+bool hasRoom(const LeafNode<T> *node, const T &key) {
+  return node->numKeys < NodeSize<T>::LEAF;
+}
+
+template <class T>
+bool isUnderfull(const LeafNode<T> *node) {
+  return node->numKeys < NodeSize<T>::LEAF / 2;
+}
+
+template <class T>
+bool isFilledTo(const LeafNode<T> *node, double fillFactor) {
+  return node->numKeys >= std::max(1, (int)(NodeSize<T>::LEAF * fillFactor));
+}
+
+template <class T>
+void insertAt(LeafNode<T> *node, int i, const RIDKeyPair<T> &entry) {
+  // shift the record id and key arrays right by one
+  int tail = node->numKeys - i;
+  memmove(&node->keyArray[i + 1], &node->keyArray[i], tail * sizeof(T));
+  memmove(&node->ridArray[i + 1], &node->ridArray[i], tail * sizeof(RecordId));
+  node->keyArray[i] = entry.key;
+  node->ridArray[i] = entry.rid;
+  node->numKeys++;
+}
+
+template <class T>
+void removeAt(LeafNode<T> *node, int i) {
+  int tail = node->numKeys - i - 1;
+  memmove(&node->keyArray[i], &node->keyArray[i + 1], tail * sizeof(T));
+  memmove(&node->ridArray[i], &node->ridArray[i + 1], tail * sizeof(RecordId));
+  node->numKeys--;
+}
+
+template <class T>
+void copyRids(const LeafNode<T> *node, int i, int count, RecordId *outRids) {
+  memcpy(outRids, &node->ridArray[i], count * sizeof(RecordId));
+}
+
+template <class T>
+void copyPayloads(const LeafNode<T> *node, int i, int count, char *out) {}
+
+/**
+ * Splits the full oldNode into itself and the empty newNode, inserting the
+ * entry into the part it belongs to.
+ */
+template <class T>
+void splitInsert(LeafNode<T> *oldNode, LeafNode<T> *newNode,
+                 const RIDKeyPair<T> &entry) {
+  // after inserting the record the left part holds half of the entries
+  // rounded up
+  int half = (oldNode->numKeys + 1) / 2;
+  int pos = upperBound(oldNode, entry.key);
+  int mid = pos < half ? half - 1 : half;
+  newNode->numKeys = oldNode->numKeys - mid;
+  memcpy(newNode->keyArray, &oldNode->keyArray[mid],
+         newNode->numKeys * sizeof(T));
+  memcpy(newNode->ridArray, &oldNode->ridArray[mid],
+         newNode->numKeys * sizeof(RecordId));
+  oldNode->numKeys = mid;
+
+  // insert the record to the appropriate part based on its position
+  if (pos < half) {
+    insertAt(oldNode, pos, entry);
+  } else {
+    insertAt(newNode, pos - mid, entry);
+  }
+}
+
+template <class T>
+bool canMerge(const LeafNode<T> *left, const LeafNode<T> *right) {
+  return left->numKeys + right->numKeys <= NodeSize<T>::LEAF;
+}
+
+/**
+ * Moves every entry of right to the end of left.
+ */
+template <class T>
+void mergeNodes(LeafNode<T> *left, LeafNode<T> *right) {
+  memcpy(&left->keyArray[left->numKeys], right->keyArray,
+         right->numKeys * sizeof(T));
+  memcpy(&left->ridArray[left->numKeys], right->ridArray,
+         right->numKeys * sizeof(RecordId));
+  left->numKeys += right->numKeys;
+  right->numKeys = 0;
+}
+
+/**
+ * Evens out two sibling leaves and updates their separator, key leftIndex of
+ * parent. Returns false, leaving everything untouched, if that cannot be
+ * done.
+ */
+template <class T>
+bool rebalance(NonLeafNode<T> *parent, int leftIndex, LeafNode<T> *left,
+               LeafNode<T> *right) {
+  int total = left->numKeys + right->numKeys;
+  int newLeft = total / 2;
+  if (left->numKeys < newLeft) {
+    int moved = newLeft - left->numKeys;
+    memcpy(&left->keyArray[left->numKeys], right->keyArray, moved * sizeof(T));
+    memcpy(&left->ridArray[left->numKeys], right->ridArray,
+           moved * sizeof(RecordId));
+    memmove(right->keyArray, &right->keyArray[moved],
+            (right->numKeys - moved) * sizeof(T));
+    memmove(right->ridArray, &right->ridArray[moved],
+            (right->numKeys - moved) * sizeof(RecordId));
+  } else {
+    int moved = left->numKeys - newLeft;
+    memmove(&right->keyArray[moved], right->keyArray,
+            right->numKeys * sizeof(T));
+    memmove(&right->ridArray[moved], right->ridArray,
+            right->numKeys * sizeof(RecordId));
+    memcpy(right->keyArray, &left->keyArray[newLeft], moved * sizeof(T));
+    memcpy(right->ridArray, &left->ridArray[newLeft],
+           moved * sizeof(RecordId));
+  }
+  left->numKeys = newLeft;
+  right->numKeys = total - newLeft;
+  parent->keyArray[leftIndex] = right->keyArray[0];
+  return true;
+}
+
+// ---- fixed-size non-leaf nodes
+
+template <class T>
+void initNode(NonLeafNode<T> *node, int level, PageId firstPageNo) {
+  node->level = level;
+  node->numKeys = 0;
+  node->pageNoArray[0] = firstPageNo;
+}
+
+template <class T>
+const T &keyAt(const NonLeafNode<T> *node, int i) {
+  return node->keyArray[i];
+}
+
+template <class T>
+PageId childAt(const NonLeafNode<T> *node, int i) {
+  return node->pageNoArray[i];
+}
+
+template <class T>
+int lowerBound(const NonLeafNode<T> *node, const T &key) {
+  return std::lower_bound(node->keyArray, node->keyArray + node->numKeys,
+                          key) -
+         node->keyArray;
+}
+
+template <class T>
+int upperBound(const NonLeafNode<T> *node, const T &key) {
+  return std::upper_bound(node->keyArray, node->keyArray + node->numKeys,
+                          key) -
+         node->keyArray;
+}
+
+template <class T>
+bool hasRoom(const NonLeafNode<T> *node, const T &key) {
+  return node->numKeys < NodeSize<T>::NONLEAF;
+}
+
+/**
+ * Returns true if any key fits in the node, so that no insert below it can
+ * split it.
+ */
+template <class T>
+bool hasRoomForAny(const NonLeafNode<T> *node) {
+  return node->numKeys < NodeSize<T>::NONLEAF;
+}
+
+template <class T>
+bool isUnderfull(const NonLeafNode<T> *node) {
+  return node->numKeys < NodeSize<T>::NONLEAF / 2;
+}
+
+template <class T>
+bool isFilledTo(const NonLeafNode<T> *node, double fillFactor) {
+  return node->numKeys + 1 >=
+         std::max(3, (int)((NodeSize<T>::NONLEAF + 1) * fillFactor));
+}
+
+/**
+ * Inserts key at position i, with pageNo as the child right of it.
+ */
+template <class T>
+void insertAt(NonLeafNode<T> *node, int i, const T &key, PageId pageNo) {
+  int tail = node->numKeys - i;
+  memmove(&node->keyArray[i + 1], &node->keyArray[i], tail * sizeof(T));
+  memmove(&node->pageNoArray[i + 2], &node->pageNoArray[i + 1],
+          tail * sizeof(PageId));
+  node->keyArray[i] = key;
+  node->pageNoArray[i + 1] = pageNo;
+  node->numKeys++;
+}
+
+/**
+ * Removes the key at position i and the child right of it.
+ */
+template <class T>
+void removeAt(NonLeafNode<T> *node, int i) {
+  int tail = node->numKeys - i - 1;
+  memmove(&node->keyArray[i], &node->keyArray[i + 1], tail * sizeof(T));
+  memmove(&node->pageNoArray[i + 1], &node->pageNoArray[i + 2],
+          tail * sizeof(PageId));
+  node->numKeys--;
+}
+
+/**
+ * Splits the full oldNode into itself and newNode, whose level is set already,
+ * inserting the key at position pos with pageNo right of it. The key between
+ * the two parts is returned in pushUpKey.
+ */
+template <class T>
+void splitInsert(NonLeafNode<T> *oldNode, NonLeafNode<T> *newNode, int pos,
+                 const T &key, PageId pageNo, T &pushUpKey) {
+  // lay out the node with the entry inserted, one key more than fits
+  T keys[NodeSize<T>::NONLEAF + 1];
+  PageId pageNos[NodeSize<T>::NONLEAF + 2];
+  int total = oldNode->numKeys + 1;
+  memcpy(keys, oldNode->keyArray, pos * sizeof(T));
+  keys[pos] = key;
+  memcpy(&keys[pos + 1], &oldNode->keyArray[pos],
+         (oldNode->numKeys - pos) * sizeof(T));
+  memcpy(pageNos, oldNode->pageNoArray, (pos + 1) * sizeof(PageId));
+  pageNos[pos + 1] = pageNo;
+  memcpy(&pageNos[pos + 2], &oldNode->pageNoArray[pos + 1],
+         (oldNode->numKeys - pos) * sizeof(PageId));
+
+  // the left part keeps the first half of the keys, the key after them is
+  // pushed up and the rest goes to the new node
+  int mid = total / 2;
+  oldNode->numKeys = mid;
+  memcpy(oldNode->keyArray, keys, mid * sizeof(T));
+  memcpy(oldNode->pageNoArray, pageNos, (mid + 1) * sizeof(PageId));
+  newNode->numKeys = total - mid - 1;
+  memcpy(newNode->keyArray, &keys[mid + 1], newNode->numKeys * sizeof(T));
+  memcpy(newNode->pageNoArray, &pageNos[mid + 1],
+         (newNode->numKeys + 1) * sizeof(PageId));
+  pushUpKey = keys[mid];
+}
+
+template <class T>
+bool canMerge(const NonLeafNode<T> *left, const T &separator,
+              const NonLeafNode<T> *right) {
+  return left->numKeys + 1 + right->numKeys <= NodeSize<T>::NONLEAF;
+}
+
+/**
+ * Moves the separator and every key and child of right to the end of left.
+ */
+template <class T>
+void mergeNodes(NonLeafNode<T> *left, const T &separator,
+                NonLeafNode<T> *right) {
+  left->keyArray[left->numKeys] = separator;
+  memcpy(&left->keyArray[left->numKeys + 1], right->keyArray,
+         right->numKeys * sizeof(T));
+  memcpy(&left->pageNoArray[left->numKeys + 1], right->pageNoArray,
+         (right->numKeys + 1) * sizeof(PageId));
+  left->numKeys += 1 + right->numKeys;
+  right->numKeys = 0;
+}
+
+/**
+ * Evens out two sibling non-leaf nodes, rotating keys through their
+ * separator, key leftIndex of parent. Returns false, leaving everything
+ * untouched, if that cannot be done.
+ */
+template <class T>
+bool rebalance(NonLeafNode<T> *parent, int leftIndex, NonLeafNode<T> *left,
+               NonLeafNode<T> *right) {
+  // lay out both nodes with the separator pulled down between them
+  T keys[2 * NodeSize<T>::NONLEAF + 1];
+  PageId pageNos[2 * NodeSize<T>::NONLEAF + 2];
+  int total = left->numKeys + 1 + right->numKeys;
+  memcpy(keys, left->keyArray, left->numKeys * sizeof(T));
+  keys[left->numKeys] = parent->keyArray[leftIndex];
+  memcpy(&keys[left->numKeys + 1], right->keyArray, right->numKeys * sizeof(T));
+  memcpy(pageNos, left->pageNoArray, (left->numKeys + 1) * sizeof(PageId));
+  memcpy(&pageNos[left->numKeys + 1], right->pageNoArray,
+         (right->numKeys + 1) * sizeof(PageId));
+
+  // split them evenly again, pushing the middle key back up
+  int mid = total / 2;
+  left->numKeys = mid;
+  memcpy(left->keyArray, keys, mid * sizeof(T));
+  memcpy(left->pageNoArray, pageNos, (mid + 1) * sizeof(PageId));
+  right->numKeys = total - mid - 1;
+  memcpy(right->keyArray, &keys[mid + 1], right->numKeys * sizeof(T));
+  memcpy(right->pageNoArray, &pageNos[mid + 1],
+         (right->numKeys + 1) * sizeof(PageId));
+  parent->keyArray[leftIndex] = keys[mid];
+  return true;
+}
+
+// ---- prefix compressed STRING nodes
+
+typedef LeafNode<StringKey> StringLeaf;
+typedef NonLeafNode<StringKey> StringNonLeaf;
+
+/**
+ * Value of an entry of a STRING leaf, its rid and the included bytes of a
+ * covering index.
+ */
+struct LeafValue {
+  RecordId rid;
+  char payload[MAXINCLUDESIZE];
+};
+
+template <class Node>
+typename Node::Slot *slotsOf(Node *node) {
+  return reinterpret_cast<typename Node::Slot *>(node->data);
+}
+
+template <class Node>
+const typename Node::Slot *slotsOf(const Node *node) {
+  return reinterpret_cast<const typename Node::Slot *>(node->data);
+}
+
+/**
+ * Number of bytes stored after each key suffix in the heap of the node.
+ */
+int payloadLengthOf(const StringLeaf *node) { return node->payloadLength; }
+int payloadLengthOf(const StringNonLeaf *node) { return 0; }
+
+/**
+ * Reads and writes the value of entry i, whose slot has been set up.
+ */
+void readValue(const StringLeaf *node, int i, LeafValue &value) {
+  const StringLeafSlot &slot = slotsOf(node)[i];
+  value.rid = slot.rid;
+  memcpy(value.payload, node->data + slot.offset + slot.length,
+         node->payloadLength);
+}
+
+void writeValue(StringLeaf *node, int i, const LeafValue &value) {
+  StringLeafSlot &slot = slotsOf(node)[i];
+  slot.rid = value.rid;
+  memcpy(node->data + slot.offset + slot.length, value.payload,
+         node->payloadLength);
+}
+
+void readValue(const StringNonLeaf *node, int i, PageId &pageNo) {
+  pageNo = slotsOf(node)[i].pageNo;
+}
+
+void writeValue(StringNonLeaf *node, int i, PageId pageNo) {
+  slotsOf(node)[i].pageNo = pageNo;
+}
+
+template <class Node>
+int freeSpace(const Node *node) {
+  return node->heapOffset - node->numKeys * (int)sizeof(typename Node::Slot);
+}
+
+template <class Node>
+int usedSpace(const Node *node) {
+  return Node::DATASIZE - freeSpace(node);
+}
+
+template <class Node>
+StringKey decodeKey(const Node *node, int i) {
+  const typename Node::Slot &slot = slotsOf(node)[i];
+  StringKey key;
+  key.length = node->prefixLength + slot.length;
+  memcpy(key.data, node->prefix, node->prefixLength);
+  memcpy(key.data + node->prefixLength, node->data + slot.offset, slot.length);
+  return key;
+}
+
+/**
+ * Compares key with the prefix every key of the node shares. Returns a
+ * negative (positive) value if every key of the node is smaller (greater)
+ * than key, and zero if key starts with the prefix.
+ */
+template <class Node>
+int comparePrefix(const Node *node, const StringKey &key) {
+  int c = memcmp(node->prefix, key.data,
+                 std::min((int)node->prefixLength, key.length));
+  if (c == 0 && key.length < node->prefixLength) {
+    c = 1;
+  }
+  return c;
+}
+
+/**
+ * Compares the suffix of key i with the suffix of a key that starts with the
+ * prefix of the node.
+ */
+template <class Node>
+int compareSuffix(const Node *node, int i, const char *suffix, int length) {
+  const typename Node::Slot &slot = slotsOf(node)[i];
+  int c = memcmp(node->data + slot.offset, suffix,
+                 std::min((int)slot.length, length));
+  return c != 0 ? c : slot.length - length;
+}
+
+/**
+ * Binary search for the first key greater than (or, if upper is false, not
+ * smaller than) the given key.
+ */
+template <class Node>
+int searchNode(const Node *node, const StringKey &key, bool upper) {
+  if (node->numKeys == 0) {
+    return 0;
+  }
+  int c = comparePrefix(node, key);
+  if (c != 0) {
+    return c > 0 ? 0 : node->numKeys;
+  }
+  const char *suffix = key.data + node->prefixLength;
+  int length = key.length - node->prefixLength;
+  int low = 0;
+  int high = node->numKeys;
+  while (low < high) {
+    int mid = (low + high) / 2;
+    int cmp = compareSuffix(node, mid, suffix, length);
+    if (cmp < 0 || (upper && cmp == 0)) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  return low;
+}
+
+template <class Node>
+int compareEntry(const Node *node, int i, const StringKey &key) {
+  int c = comparePrefix(node, key);
+  if (c != 0) {
+    return c;
+  }
+  return compareSuffix(node, i, key.data + node->prefixLength,
+                       key.length - node->prefixLength);
+}
+
+/**
+ * Number of bytes the entries take up when encoded in one node laid out like
+ * the given one, slots included.
+ */
+template <class Node>
+int encodedSize(const Node *node, const StringKey *keys, int count) {
+  if (count == 0) {
+    return 0;
+  }
+  int prefixLength = commonPrefixLength(keys[0], keys[count - 1]);
+  int size = 0;
+  for (int i = 0; i < count; i++) {
+    size += sizeof(typename Node::Slot) + keys[i].length - prefixLength +
+            payloadLengthOf(node);
+  }
+  return size;
+}
+
+/**
+ * Rewrites the keys and slots of the node from sorted keys and the values of
+ * their slots, taking the longest prefix they share out of them.
+ */
+template <class Node, class Value>
+void encodeNode(Node *node, const StringKey *keys, const Value *values,
+                int count) {
+  typename Node::Slot *slots = slotsOf(node);
+  node->numKeys = count;
+  node->prefixLength =
+      count == 0 ? 0 : commonPrefixLength(keys[0], keys[count - 1]);
+  if (count > 0) {
+    memcpy(node->prefix, keys[0].data, node->prefixLength);
+  }
+  node->heapOffset = Node::DATASIZE;
+  for (int i = 0; i < count; i++) {
+    int length = keys[i].length - node->prefixLength;
+    node->heapOffset -= length + payloadLengthOf(node);
+    memcpy(node->data + node->heapOffset, keys[i].data + node->prefixLength,
+           length);
+    slots[i].offset = node->heapOffset;
+    slots[i].length = length;
+    writeValue(node, i, values[i]);
+  }
+}
+
+/**
+ * Appends the keys of the node and the values of their slots to the vectors.
+ */
+template <class Node, class Value>
+void decodeNode(const Node *node, std::vector<StringKey> &keys,
+                std::vector<Value> &values) {
+  for (int i = 0; i < node->numKeys; i++) {
+    keys.push_back(decodeKey(node, i));
+    values.push_back(Value());
+    readValue(node, i, values.back());
+  }
+}
+
+/**
+ * Finds where to cut the sorted keys in two nodes laid out like the given
+ * one, the left one holding [0, cut) and the right one [cut + gap, count), so
+ * that the fuller of the two is as empty as possible. Each part keeps at least
+ * one key. Returns -1 if no cut makes both parts fit.
+ */
+template <class Node>
+int balancedCut(const Node *node, const std::vector<StringKey> &keys,
+                int gap) {
+  int count = keys.size();
+  std::vector<int> sizes(count + 1, 0);
+  for (int i = 0; i < count; i++) {
+    sizes[i + 1] = sizes[i] + sizeof(typename Node::Slot) + keys[i].length +
+                   payloadLengthOf(node);
+  }
+  int bestCut = -1;
+  int bestSize = Node::DATASIZE + 1;
+  for (int cut = 1; cut + gap < count; cut++) {
+    int leftSize =
+        sizes[cut] - cut * commonPrefixLength(keys[0], keys[cut - 1]);
+    int rightCount = count - cut - gap;
+    int rightSize = sizes[count] - sizes[cut + gap] -
+                    rightCount * commonPrefixLength(keys[cut + gap],
+                                                    keys[count - 1]);
+    int size = std::max(leftSize, rightSize);
+    if (size < bestSize) {
+      bestSize = size;
+      bestCut = cut;
+    }
+  }
+  return bestCut;
+}
+
+/**
+ * Inserts key with the given slot value at position i, re-encoding the node
+ * if the key does not share its prefix. The node must have room for it.
+ */
+template <class Node, class Value>
+void insertSlot(Node *node, int i, const StringKey &key, const Value &value) {
+  if (node->numKeys == 0 || comparePrefix(node, key) != 0) {
+    std::vector<StringKey> keys;
+    std::vector<Value> values;
+    decodeNode(node, keys, values);
+    keys.insert(keys.begin() + i, key);
+    values.insert(values.begin() + i, value);
+    encodeNode(node, keys.data(), values.data(), keys.size());
+    return;
+  }
+  // the suffix goes on top of the heap, the slots right of i move up by one
+  typename Node::Slot *slots = slotsOf(node);
+  int length = key.length - node->prefixLength;
+  node->heapOffset -= length + payloadLengthOf(node);
+  memcpy(node->data + node->heapOffset, key.data + node->prefixLength, length);
+  memmove(&slots[i + 1], &slots[i],
+          (node->numKeys - i) * sizeof(typename Node::Slot));
+  slots[i].offset = node->heapOffset;
+  slots[i].length = length;
+  writeValue(node, i, value);
+  node->numKeys++;
+}
+
+/**
+ * Removes slot i and its suffix, closing the hole left in the heap.
+ */
+template <class Node>
+void removeSlot(Node *node, int i) {
+  typename Node::Slot *slots = slotsOf(node);
+  int offset = slots[i].offset;
+  int length = slots[i].length + payloadLengthOf(node);
+  memmove(node->data + node->heapOffset + length,
+          node->data + node->heapOffset, offset - node->heapOffset);
+  node->heapOffset += length;
+  // empty suffixes may share the offset of the removed one, they move too
+  for (int j = 0; j < node->numKeys; j++) {
+    if (slots[j].offset <= offset) {
+      slots[j].offset += length;
+    }
+  }
+  memmove(&slots[i], &slots[i + 1],
+          (node->numKeys - i - 1) * sizeof(typename Node::Slot));
+  node->numKeys--;
+}
+
+/**
+ * Returns true if the key, with its slot, fits in the node. A key that does
+ * not share the prefix of the node shortens the prefix and so lengthens every
+ * suffix stored.
+ */
+template <class Node>
+bool hasRoomFor(const Node *node, const StringKey &key) {
+  int prefixLength = node->numKeys == 0
+                         ? key.length
+                         : commonPrefixLength(node->prefix, node->prefixLength,
+                                              key.data, key.length);
+  int needed = sizeof(typename Node::Slot) + key.length - prefixLength +
+               payloadLengthOf(node);
+  if (node->numKeys > 0) {
+    needed += node->numKeys * (node->prefixLength - prefixLength);
+  }
+  return needed <= freeSpace(node);
+}
+
+void initNode(StringLeaf *node, int payloadLength) {
+  node->numKeys = 0;
+  node->rightSibPageNo = 0;
+  node->payloadLength = payloadLength;
+  node->prefixLength = 0;
+  node->heapOffset = StringLeaf::DATASIZE;
+}
+
+StringKey keyAt(const StringLeaf *node, int i) { return decodeKey(node, i); }
+
+const RecordId &ridAt(const StringLeaf *node, int i) {
+  return slotsOf(node)[i].rid;
+}
+
+RIDKeyPair<StringKey> entryAt(const StringLeaf *node, int i) {
+  const StringLeafSlot &slot = slotsOf(node)[i];
+  RIDKeyPair<StringKey> entry;
+  entry.set(slot.rid, decodeKey(node, i));
+  memcpy(entry.payload, node->data + slot.offset + slot.length,
+         node->payloadLength);
+  return entry;
+}
+
+int compareAt(const StringLeaf *node, int i, const StringKey &key) {
+  return compareEntry(node, i, key);
+}
+
+int lowerBound(const StringLeaf *node, const StringKey &key) {
+  return searchNode(node, key, false);
+}
+
+int upperBound(const StringLeaf *node, const StringKey &key) {
+  return searchNode(node, key, true);
+}
+
+bool hasRoom(const StringLeaf *node, const StringKey &key) {
+  return hasRoomFor(node, key);
+}
+
+bool isUnderfull(const StringLeaf *node) {
+  return usedSpace(node) < StringLeaf::DATASIZE / 2;
+}
+
+bool isFilledTo(const StringLeaf *node, double fillFactor) {
+  return node->numKeys >= 1 &&
+         usedSpace(node) >= StringLeaf::DATASIZE * fillFactor;
+}
+
+void insertAt(StringLeaf *node, int i, const RIDKeyPair<StringKey> &entry) {
+  LeafValue value;
+  value.rid = entry.rid;
+  memcpy(value.payload, entry.payload, node->payloadLength);
+  insertSlot(node, i, entry.key, value);
+}
+
+void removeAt(StringLeaf *node, int i) { removeSlot(node, i); }
+
+void copyRids(const StringLeaf *node, int i, int count, RecordId *outRids) {
+  const StringLeafSlot *slots = slotsOf(node);
+  for (int j = 0; j < count; j++) {
+    outRids[j] = slots[i + j].rid;
+  }
+}
+
+void copyPayloads(const StringLeaf *node, int i, int count, char *out) {
+  const StringLeafSlot *slots = slotsOf(node);
+  for (int j = 0; j < count; j++) {
+    const StringLeafSlot &slot = slots[i + j];
+    memcpy(out + j * node->payloadLength,
+           node->data + slot.offset + slot.length, node->payloadLength);
+  }
+}
+
+void splitInsert(StringLeaf *oldNode, StringLeaf *newNode,
+                 const RIDKeyPair<StringKey> &entry) {
+  // cut the entries, the new one included, where both halves take up about
+  // the same space
+  std::vector<StringKey> keys;
+  std::vector<LeafValue> values;
+  decodeNode(oldNode, keys, values);
+  int pos = upperBound(oldNode, entry.key);
+  LeafValue value;
+  value.rid = entry.rid;
+  memcpy(value.payload, entry.payload, oldNode->payloadLength);
+  keys.insert(keys.begin() + pos, entry.key);
+  values.insert(values.begin() + pos, value);
+  int cut = balancedCut(oldNode, keys, 0);
+  encodeNode(oldNode, keys.data(), values.data(), cut);
+  encodeNode(newNode, keys.data() + cut, values.data() + cut,
+             keys.size() - cut);
+}
+
+bool canMerge(const StringLeaf *left, const StringLeaf *right) {
+  std::vector<StringKey> keys;
+  std::vector<LeafValue> values;
+  decodeNode(left, keys, values);
+  decodeNode(right, keys, values);
+  return encodedSize(left, keys.data(), keys.size()) <= StringLeaf::DATASIZE;
+}
+
+void mergeNodes(StringLeaf *left, StringLeaf *right) {
+  std::vector<StringKey> keys;
+  std::vector<LeafValue> values;
+  decodeNode(left, keys, values);
+  decodeNode(right, keys, values);
+  encodeNode(left, keys.data(), values.data(), keys.size());
+  right->numKeys = 0;
+}
+
+void setKeyAt(StringNonLeaf *node, int i, const StringKey &key);
+bool canSetKeyAt(const StringNonLeaf *node, int i, const StringKey &key);
+
+bool rebalance(StringNonLeaf *parent, int leftIndex, StringLeaf *left,
+               StringLeaf *right) {
+  std::vector<StringKey> keys;
+  std::vector<LeafValue> values;
+  decodeNode(left, keys, values);
+  decodeNode(right, keys, values);
+  int cut = balancedCut(left, keys, 0);
+  if (cut < 0) {
+    return false;
+  }
+  // the new separator may be longer than the old one
+  StringKey separator = separatorKey(keys[cut - 1], keys[cut]);
+  if (!canSetKeyAt(parent, leftIndex, separator)) {
+    return false;
+  }
+  encodeNode(left, keys.data(), values.data(), cut);
+  encodeNode(right, keys.data() + cut, values.data() + cut, keys.size() - cut);
+  setKeyAt(parent, leftIndex, separator);
+  return true;
+}
+
+void initNode(StringNonLeaf *node, int level, PageId firstPageNo) {
+  node->level = level;
+  node->numKeys = 0;
+  node->firstPageNo = firstPageNo;
+  node->prefixLength = 0;
+  node->heapOffset = StringNonLeaf::DATASIZE;
+}
+
+StringKey keyAt(const StringNonLeaf *node, int i) {
+  return decodeKey(node, i);
+}
+
+PageId childAt(const StringNonLeaf *node, int i) {
+  return i == 0 ? node->firstPageNo : slotsOf(node)[i - 1].pageNo;
+}
+
+int lowerBound(const StringNonLeaf *node, const StringKey &key) {
+  return searchNode(node, key, false);
+}
+
+int upperBound(const StringNonLeaf *node, const StringKey &key) {
+  return searchNode(node, key, true);
+}
+
+bool hasRoom(const StringNonLeaf *node, const StringKey &key) {
+  return hasRoomFor(node, key);
+}
+
+bool hasRoomForAny(const StringNonLeaf *node) {
+  // the longest key, sharing none of the prefix of the node
+  int needed = sizeof(StringNonLeaf::Slot) + STRINGSIZE +
+               node->numKeys * node->prefixLength;
+  return needed <= freeSpace(node);
+}
+
+bool isUnderfull(const StringNonLeaf *node) {
+  return usedSpace(node) < StringNonLeaf::DATASIZE / 2;
+}
+
+bool isFilledTo(const StringNonLeaf *node, double fillFactor) {
+  return node->numKeys >= 2 &&
+         usedSpace(node) >= StringNonLeaf::DATASIZE * fillFactor;
+}
+
+void insertAt(StringNonLeaf *node, int i, const StringKey &key,
+              PageId pageNo) {
+  insertSlot(node, i, key, pageNo);
+}
+
+void removeAt(StringNonLeaf *node, int i) { removeSlot(node, i); }
+
+/**
+ * Lays out the keys and children of a non-leaf node in two vectors, children
+ * holding one page number more than keys.
+ */
+void decodeNonLeaf(const StringNonLeaf *node, std::vector<StringKey> &keys,
+                   std::vector<PageId> &pageNos) {
+  pageNos.push_back(node->firstPageNo);
+  decodeNode(node, keys, pageNos);
+}
+
+/**
+ * Rewrites a non-leaf node from keys [begin, end) and the children around
+ * them.
+ */
+void encodeNonLeaf(StringNonLeaf *node, const std::vector<StringKey> &keys,
+                   const std::vector<PageId> &pageNos, int begin, int end) {
+  node->firstPageNo = pageNos[begin];
+  encodeNode(node, keys.data() + begin, pageNos.data() + begin + 1,
+             end - begin);
+}
+
+bool canSetKeyAt(const StringNonLeaf *node, int i, const StringKey &key) {
+  std::vector<StringKey> keys;
+  std::vector<PageId> pageNos;
+  decodeNonLeaf(node, keys, pageNos);
+  keys[i] = key;
+  return encodedSize(node, keys.data(), keys.size()) <=
+         StringNonLeaf::DATASIZE;
+}
+
+void setKeyAt(StringNonLeaf *node, int i, const StringKey &key) {
+  std::vector<StringKey> keys;
+  std::vector<PageId> pageNos;
+  decodeNonLeaf(node, keys, pageNos);
+  keys[i] = key;
+  encodeNonLeaf(node, keys, pageNos, 0, keys.size());
+}
+
+void splitInsert(StringNonLeaf *oldNode, StringNonLeaf *newNode, int pos,
+                 const StringKey &key, PageId pageNo, StringKey &pushUpKey) {
+  std::vector<StringKey> keys;
+  std::vector<PageId> pageNos;
+  decodeNonLeaf(oldNode, keys, pageNos);
+  keys.insert(keys.begin() + pos, key);
+  pageNos.insert(pageNos.begin() + pos + 1, pageNo);
+
+  // the key at the cut is pushed up, the parts around it take up about the
+  // same space
+  int cut = balancedCut(oldNode, keys, 1);
+  pushUpKey = keys[cut];
+  encodeNonLeaf(oldNode, keys, pageNos, 0, cut);
+  encodeNonLeaf(newNode, keys, pageNos, cut + 1, keys.size());
+}
+
+bool canMerge(const StringNonLeaf *left, const StringKey &separator,
+              const StringNonLeaf *right) {
+  std::vector<StringKey> keys;
+  std::vector<PageId> pageNos;
+  decodeNonLeaf(left, keys, pageNos);
+  keys.push_back(separator);
+  decodeNonLeaf(right, keys, pageNos);
+  return encodedSize(left, keys.data(), keys.size()) <=
+         StringNonLeaf::DATASIZE;
+}
+
+void mergeNodes(StringNonLeaf *left, const StringKey &separator,
+                StringNonLeaf *right) {
+  std::vector<StringKey> keys;
+  std::vector<PageId> pageNos;
+  decodeNonLeaf(left, keys, pageNos);
+  keys.push_back(separator);
+  decodeNonLeaf(right, keys, pageNos);
+  encodeNonLeaf(left, keys, pageNos, 0, keys.size());
+  right->numKeys = 0;
+}
+
+bool rebalance(StringNonLeaf *parent, int leftIndex, StringNonLeaf *left,
+               StringNonLeaf *right) {
+  std::vector<StringKey> keys;
+  std::vector<PageId> pageNos;
+  decodeNonLeaf(left, keys, pageNos);
+  keys.push_back(keyAt(parent, leftIndex));
+  decodeNonLeaf(right, keys, pageNos);
+  int cut = balancedCut(left, keys, 1);
+  if (cut < 0 || !canSetKeyAt(parent, leftIndex, keys[cut])) {
+    return false;
+  }
+  encodeNonLeaf(left, keys, pageNos, 0, cut);
+  encodeNonLeaf(right, keys, pageNos, cut + 1, keys.size());
+  setKeyAt(parent, leftIndex, keys[cut]);
+  return true;
+}
+
+}  // namespace
+
+/**
+ * Constructor for BTreeIndex
+ * First check if the specified index file exists
+ * If not, constructed by concatenating the relational name with the offset of
+ * the attribute over which the index is built.
+ *
+ * @param relationName The name of the relation on which to build the index.
+ * @param outIndexName The name of the index file
+ * @param bufMgrIn The instance of the global buffer manager.
+ * @param attrByteOffset The byte offset of the attribute in the tuple on which
+ * to build the index.
+ * @param attrType The data type of the attribute we are indexing.
+ * @param fillFactor The fraction of each node filled by the bulk loader.
+ * @throws  BadIndexInfoException     If the index file already exists for the
+ * corresponding attribute, but values in metapage(relationName, attribute
+ * byte offset, attribute type etc.) do not match with values received through
+ * constructor parameters.
+ */
+BTreeIndex::BTreeIndex(const std::string &relationName,
+                       std::string &outIndexName, BufMgr *bufMgrIn,
+                       const int attrByteOffset, const Datatype attrType,
+                       const double fillFactor)
+    : BTreeIndex(relationName, outIndexName, bufMgrIn,
+                 std::vector<KeyAttribute>(
+                     1, KeyAttribute{attrByteOffset, attrType}),
+                 fillFactor) {}
+
+/**
+ * Constructor for BTreeIndex over the given key attributes. A single
+ * attribute gives the same index as the constructor above, several give a
+ * COMPOSITE index whose file name lists the offset of each of them.
+ */
+BTreeIndex::BTreeIndex(const std::string &relationName,
+                       std::string &outIndexName, BufMgr *bufMgrIn,
+                       const std::vector<KeyAttribute> &keyAttrs,
+                       const double fillFactor)
+    : BTreeIndex(relationName, outIndexName, bufMgrIn, keyAttrs,
+                 IncludedColumns{0, 0}, fillFactor) {}
+
+/**
+ * Constructor for BTreeIndex over the given key attributes, storing the
+ * included bytes of each record in the leaves. An index that includes any
+ * bytes is COMPOSITE and its file name ends with the included range.
+ */
+BTreeIndex::BTreeIndex(const std::string &relationName,
+                       std::string &outIndexName, BufMgr *bufMgrIn,
+                       const std::vector<KeyAttribute> &keyAttrs,
+                       const IncludedColumns &included,
+                       const double fillFactor)
+    : mapped(false), nodeLatches(NODE_LATCH_STRIPES), scanCursor(this) {
+  // construct index name
+  std::ostringstream idxStr;
+  idxStr << relationName;
+  for (size_t i = 0; i < keyAttrs.size(); i++) {
+    idxStr << '.' << keyAttrs[i].byteOffset;
+  }
+  if (included.length > 0) {
+    idxStr << '+' << included.byteOffset << '.' << included.length;
+  }
+  outIndexName = idxStr.str();
+  if (keyAttrs.empty() || keyAttrs.size() > (size_t)MAXKEYATTRS ||
+      included.byteOffset < 0 || included.length < 0 ||
+      included.length > MAXINCLUDESIZE) {
+    throw BadIndexInfoException(outIndexName);
+  }
+  for (size_t i = 0; i < keyAttrs.size(); i++) {
+    if (keyAttrs[i].type == COMPOSITE) {
+      throw BadIndexInfoException(outIndexName);
+    }
+  }
+  Datatype attrType = keyAttrs.size() == 1 && included.length == 0
+                          ? keyAttrs[0].type
+                          : COMPOSITE;
+  int attrByteOffset = keyAttrs[0].byteOffset;
+  if (attrType == COMPOSITE) {
+    this->keyAttrs = keyAttrs;
+  }
+  this->included = included;
+
+  bool exist = false;
+  // Check if already exists
+  if (File::exists(outIndexName)) {
+    exist = true;
+  }
+  switch (attrType) {
+    case INTEGER:
+      this->nodeOccupancy = INTARRAYNONLEAFSIZE;
+      this->leafOccupancy = INTARRAYLEAFSIZE;
+      break;
+    case DOUBLE:
+      this->nodeOccupancy = DOUBLEARRAYNONLEAFSIZE;
+      this->leafOccupancy = DOUBLEARRAYLEAFSIZE;
+      break;
+    case STRING:
+    case COMPOSITE:
+      // as many keys as fit if every one of them is a prefix of the others
+      this->nodeOccupancy = STRINGNONLEAFDATASIZE / sizeof(StringNonLeafSlot);
+      this->leafOccupancy = STRINGLEAFDATASIZE / sizeof(StringLeafSlot);
+      break;
+  }
+  this->bufMgr = bufMgrIn;
+  this->attrByteOffset = attrByteOffset;
+  this->attributeType = attrType;
+
+  Page *headerPage;
+  if (exist) {  // if exist
+
+    // Read the file to construct the Btree
+    this->file = new BlobFile(outIndexName, false);
+    this->headerPageNum = this->file->getFirstPageNo();
+    bufMgr->readPage(this->file, this->headerPageNum, headerPage);
+    IndexMetaInfo *metaInfo = (IndexMetaInfo *)headerPage;
+    this->rootPageNum = metaInfo->rootPageNo;
+    // the first root, a leaf, is always allocated right after the meta page
+    // and stays the leftmost leaf
+    this->initial = this->headerPageNum + 1;
+
+    // values in metapage not match
+    bool match = relationName == metaInfo->relationName &&
+                 attrByteOffset == metaInfo->attrByteOffset &&
+                 attrType == metaInfo->attrType;
+    if (match && attrType == COMPOSITE) {
+      match = metaInfo->numKeyAttrs == (int)keyAttrs.size();
+      for (size_t i = 0; match && i < keyAttrs.size(); i++) {
+        match = keyAttrs[i].byteOffset == metaInfo->keyAttrs[i].byteOffset &&
+                keyAttrs[i].type == metaInfo->keyAttrs[i].type;
+      }
+      match = match &&
+              included.byteOffset == metaInfo->included.byteOffset &&
+              included.length == metaInfo->included.length;
+    }
+    if (!match) {
+      throw BadIndexInfoException(outIndexName);
+    }
+    // Unpin page as soon as possible
+    bufMgr->unPinPage(this->file, this->headerPageNum, false);
+
+  } else {  // not exist
+
+    // Create new file
+    this->file = new BlobFile(outIndexName, true);
+    bufMgr->allocPage(this->file, this->headerPageNum, headerPage);
+    Page *rootPage;
+    PageId rootPageNo;
+    bufMgr->allocPage(this->file, rootPageNo, rootPage);
+    this->rootPageNum = rootPageNo;
+    IndexMetaInfo *metaInfo = (IndexMetaInfo *)headerPage;
+
+    // Read in metaInfo for this file
+    strncpy(metaInfo->relationName, relationName.c_str(), 20);
+    metaInfo->attrType = attrType;
+    metaInfo->attrByteOffset = attrByteOffset;
+    metaInfo->freePageNo = 0;
+    metaInfo->numKeyAttrs = this->keyAttrs.size();
+    std::copy(this->keyAttrs.begin(), this->keyAttrs.end(),
+              metaInfo->keyAttrs);
+    metaInfo->included = included;
+    this->initial = rootPageNum;
+    // the root leaf is initialized by the bulk loader
+    metaInfo->rootPageNo = this->rootPageNum;
+
+    // Unpin as soon as possible
+    bufMgr->unPinPage(this->file, this->headerPageNum, true);
+    bufMgr->unPinPage(this->file, this->rootPageNum, true);
+
+    // Scan in and fill new file
+    switch (attributeType) {
+      case INTEGER:
+        bulkLoad<int>(relationName, outIndexName, fillFactor);
+        break;
+      case DOUBLE:
+        bulkLoad<double>(relationName, outIndexName, fillFactor);
+        break;
+      case STRING:
+      case COMPOSITE:
+        bulkLoad<StringKey>(relationName, outIndexName, fillFactor);
+        break;
+    }
+    // Save to disk
+    bufMgr->flushFile(file);
+  }
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::~BTreeIndex -- destructor
+// -----------------------------------------------------------------------------
+
+/**
+ * The destructor
+ * End the built-in scan, flush and delete the index file
+ */
+BTreeIndex::~BTreeIndex() {
+  // the built-in scan must let go of its leaf before the file is flushed
+  if (scanCursor.isScanExecuting()) {
+    scanCursor.endScan();
+  }
+  this->bufMgr->flushFile(BTreeIndex::file);
+  delete file;
+  this->file = nullptr;
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::compositeKey
+// -----------------------------------------------------------------------------
+
+namespace {
+
+/**
+ * Appends the lowest bytes of value to the key, most significant first, as
+ * far as the key has room for them.
+ */
+void appendBigEndian(StringKey &key, std::uint64_t value, int numBytes) {
+  for (int i = numBytes - 1; i >= 0 && key.length < STRINGSIZE; i--) {
+    key.data[key.length++] = (char)(value >> (8 * i));
+  }
+}
+
+/**
+ * Pads a COMPOSITE key with the greatest byte up to STRINGSIZE bytes, which
+ * makes it greater than every key starting with it.
+ */
+void padCompositeKey(StringKey &key) {
+  memset(key.data + key.length, 0xff, STRINGSIZE - key.length);
+  key.length = STRINGSIZE;
+}
+
+/**
+ * Appends the attribute value at src, of the given type, to a COMPOSITE key.
+ */
+void appendAttribute(StringKey &key, const char *src, Datatype type) {
+  switch (type) {
+    case INTEGER: {
+      // flipping the sign bit orders negative values first
+      std::uint32_t bits = readKey<int>(src);
+      appendBigEndian(key, bits ^ 0x80000000u, sizeof(bits));
+      break;
+    }
+    case DOUBLE: {
+      // flip the sign bit of positive values and every bit of negative
+      // ones, so that larger magnitudes of negative values come first
+      double value = readKey<double>(src);
+      if (value == 0) {
+        value = 0;  // -0.0 equals 0.0
+      }
+      std::uint64_t bits;
+      memcpy(&bits, &value, sizeof(bits));
+      bits = (bits >> 63) ? ~bits : bits ^ (1ull << 63);
+      appendBigEndian(key, bits, sizeof(bits));
+      break;
+    }
+    case STRING: {
+      // the null character ends a string before any longer one
+      StringKey value = readKey<StringKey>(src);
+      int length = std::min(value.length, STRINGSIZE - key.length);
+      memcpy(key.data + key.length, value.data, length);
+      key.length += length;
+      appendBigEndian(key, 0, 1);
+      break;
+    }
+    case COMPOSITE:  // rejected by the constructor
+      break;
+  }
+}
+
+/**
+ * Copies the included bytes of an entry into its pair, or zeros if payload
+ * is null. Only STRING pairs have room for them, covering indexes being
+ * COMPOSITE.
+ */
+template <class T>
+void setPayload(RIDKeyPair<T> &pair, const char *payload, int length) {}
+
+void setPayload(RIDKeyPair<StringKey> &pair, const char *payload,
+                int length) {
+  if (payload != nullptr) {
+    memcpy(pair.payload, payload, length);
+  } else {
+    memset(pair.payload, 0, length);
+  }
+}
+
+}  // namespace
+
+StringKey BTreeIndex::compositeKey(const void *record, int numAttrs) const {
+  StringKey key;
+  key.length = 0;
+  for (int i = 0; i < numAttrs; i++) {
+    appendAttribute(key, (const char *)record + keyAttrs[i].byteOffset,
+                    keyAttrs[i].type);
+  }
+  return key;
+}
+
+StringKey BTreeIndex::encodeKey(const void *key, int numAttrs) const {
+  if (keyAttrs.size() == 1) {
+    StringKey encoded;
+    encoded.length = 0;
+    appendAttribute(encoded, (const char *)key, keyAttrs[0].type);
+    return encoded;
+  }
+  return compositeKey(key, numAttrs);
+}
+
+template <class T>
+T BTreeIndex::recordKey(const char *record) const {
+  return readKey<T>(record + attrByteOffset);
+}
+
+template <>
+StringKey BTreeIndex::recordKey<StringKey>(const char *record) const {
+  if (attributeType == COMPOSITE) {
+    return compositeKey(record, keyAttrs.size());
+  }
+  return readKey<StringKey>(record + attrByteOffset);
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::insertNodeLeaf
+// -----------------------------------------------------------------------------
+
+template <class T>
+void BTreeIndex::insertNodeLeaf(LeafNode<T> *node,
+                                const RIDKeyPair<T> &entryInsertPair) {
+  // binary search for the slot after every key not greater than the new one
+  int i = upperBound(node, entryInsertPair.key);
+  insertAt(node, i, entryInsertPair);
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::insertNodeNonLeaf
+// -----------------------------------------------------------------------------
+
+template <class T>
+void BTreeIndex::insertNodeNonLeaf(NonLeafNode<T> *node, int childIndex,
+                                   const PageKeyPair<T> &entryInsertPair) {
+  // the new page goes right of the child it was split from, which a search
+  // for its key would miss among equal keys
+  insertAt(node, childIndex, entryInsertPair.key, entryInsertPair.pageNo);
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::insertEntryHelper
+// -----------------------------------------------------------------------------
+
+template <class T>
+bool BTreeIndex::insertEntryHelper(const RIDKeyPair<T> &entryInsertPair,
+                                   PageKeyPair<T> &entryPropPair,
+                                   Page *currPage, PageId currPageNum,
+                                   bool isLeafNode,
+                                   std::vector<PageId> &latched) {
+  // the latch of the current node is let go of on the way back up, unless
+  // it went already along with those above it
+  size_t depth = latched.size();
+  bool split;
+
+  // when the current code is a non-leaf node
+  if (!isLeafNode) {
+    NonLeafNode<T> *node = (NonLeafNode<T> *)(currPage);
+    // find the index of the next child to insert, keys equal to a separator
+    // live right of it
+    int i = upperBound(node, entryInsertPair.key);
+
+    // latch the child, and let go of every latch above it if it cannot split
+    PageId childPageNo = childAt(node, i);
+    nodeLatches.lock(childPageNo);
+    Page *childPage = nullptr;
+    bufMgr->readPage(file, childPageNo, childPage);
+    bool isChildLeafNode = node->level != 0;
+    if (isChildLeafNode
+            ? hasRoom((LeafNode<T> *)childPage, entryInsertPair.key)
+            : hasRoomForAny((NonLeafNode<T> *)childPage)) {
+      releaseLatches(latched);
+    }
+    latched.push_back(childPageNo);
+
+    // recusively call the helper function on the child node
+    bool childSplit =
+        insertEntryHelper(entryInsertPair, entryPropPair, childPage,
+                          childPageNo, isChildLeafNode, latched);
+
+    // when the child was splitted and the entry should be pushed up
+    if (!childSplit) {
+      bufMgr->unPinPage(file, currPageNum, false);
+      split = false;
+    } else if (hasRoom(node, entryPropPair.key)) {
+      // when the current node is not full
+      insertNodeNonLeaf(node, i, entryPropPair);
+      bufMgr->unPinPage(file, currPageNum, true);
+      split = false;
+    } else {
+      // simple case: if full, directly split the node
+      splitNonLeafNode(node, currPageNum, i, entryPropPair);
+      split = true;
+    }
+  } else {
+    // when the current code is a leaf node
+    LeafNode<T> *node = (LeafNode<T> *)(currPage);
+    // insert the node directly when the page is not full
+    if (hasRoom(node, entryInsertPair.key)) {
+      insertNodeLeaf(node, entryInsertPair);
+      bufMgr->unPinPage(file, currPageNum, true);
+      split = false;
+    } else {
+      // simple case: if full, directly split the node
+      splitLeafNode(node, currPageNum, entryPropPair, entryInsertPair);
+      split = true;
+    }
+  }
+
+  if (latched.size() == depth) {
+    releaseLatch(latched.back());
+    latched.pop_back();
+  }
+  return split;
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::insertEntry
+// -----------------------------------------------------------------------------
+
+void BTreeIndex::insertEntry(const void *key, const RecordId rid,
+                             const void *payload) {
+  switch (attributeType) {
+    case INTEGER:
+      insertKey(readKey<int>(key), rid, nullptr);
+      break;
+    case DOUBLE:
+      insertKey(readKey<double>(key), rid, nullptr);
+      break;
+    case STRING:
+      insertKey(readKey<StringKey>(key), rid, nullptr);
+      break;
+    case COMPOSITE:
+      insertKey(encodeKey(key, keyAttrs.size()), rid,
+                (const char *)payload);
+      break;
+  }
+}
+
+template <class T>
+void BTreeIndex::insertKey(const T &key, const RecordId &rid,
+                           const char *payload) {
+  // for making changes to leaf node pages
+  RIDKeyPair<T> entryInsertPair;
+  entryInsertPair.set(rid, key);
+  setPayload(entryInsertPair, payload, included.length);
+  SharedLatchGuard treeGuard(treeLatch);
+  checkWritable();
+
+  // most inserts fit in their leaf, which is all they need to latch
+  // exclusively
+  PageId leafPageNum;
+  Page *leafPage;
+  findLeaf(key, leafPageNum, leafPage, true, true);
+  LeafNode<T> *leaf = (LeafNode<T> *)leafPage;
+  bool fits = hasRoom(leaf, key);
+  if (fits) {
+    insertNodeLeaf(leaf, entryInsertPair);
+  }
+  nodeLatches.unlock(leafPageNum);
+  bufMgr->unPinPage(file, leafPageNum, fits);
+  if (fits) {
+    return;
+  }
+
+  // the leaf has to split, descend again latching exclusively every node the
+  // split may reach, from the root page number down
+  std::vector<PageId> latched;
+  rootLatch.lock();
+  latched.push_back(PageId(Page::INVALID_NUMBER));
+  PageId rootNum = rootPageNum;
+  bool isLeafNode = rootNum == initial;
+  nodeLatches.lock(rootNum);
+  // read the root page node
+  Page *root = nullptr;
+  bufMgr->readPage(file, rootNum, root);
+  if (isLeafNode ? hasRoom((LeafNode<T> *)root, key)
+                 : hasRoomForAny((NonLeafNode<T> *)root)) {
+    releaseLatches(latched);
+  }
+  latched.push_back(rootNum);
+
+  // for making changes to non-leaf node pages
+  PageKeyPair<T> entryPropPair;
+  insertEntryHelper(entryInsertPair, entryPropPair, root, rootNum, isLeafNode,
+                    latched);
+  releaseLatches(latched);
+}
+
+template <class T>
+void BTreeIndex::splitLeafNode(LeafNode<T> *oldNode, PageId oldPageID,
+                               PageKeyPair<T> &pushUpPage,
+                               const RIDKeyPair<T> &insertRecord) {
+  // allocate space for a new leaf node
+  Page *newPage;
+  PageId newPageID;
+  allocNodePage(newPageID, newPage);
+  LeafNode<T> *newNode = (LeafNode<T> *)newPage;
+  initNode(newNode, included.length);
+  splitInsert(oldNode, newNode, insertRecord);
+
+  // update sibling relation after inserting
+  newNode->rightSibPageNo = oldNode->rightSibPageNo;
+  oldNode->rightSibPageNo = newPageID;
+
+  // push up the key separating the two leaves
+  pushUpPage.set(newPageID, separatorKey(keyAt(oldNode, oldNode->numKeys - 1),
+                                         keyAt(newNode, 0)));
+
+  // update root if the old node is root itself
+  if (oldPageID == rootPageNum) {
+    updateRoot(rootPageNum, pushUpPage);
+  }
+
+  // unpin
+  bufMgr->unPinPage(file, oldPageID, true);
+  bufMgr->unPinPage(file, newPageID, true);
+}
+
+template <class T>
+void BTreeIndex::splitNonLeafNode(NonLeafNode<T> *oldNode, PageId oldPageID,
+                                  int childIndex,
+                                  PageKeyPair<T> &pushUpPage) {
+  // allocate space for a new leaf node
+  Page *newPage;
+  PageId newPageID;
+  allocNodePage(newPageID, newPage);
+  NonLeafNode<T> *newNode = (NonLeafNode<T> *)newPage;
+  initNode(newNode, oldNode->level, 0);
+
+  // the middle key moves up to the pushUpPage
+  T pushUpKey;
+  splitInsert(oldNode, newNode, childIndex, pushUpPage.key, pushUpPage.pageNo,
+              pushUpKey);
+  pushUpPage.set(newPageID, pushUpKey);
+
+  // update root if the old node is root itself
+  if (oldPageID == rootPageNum) {
+    updateRoot(rootPageNum, pushUpPage);
+  }
+
+  // unpin
+  bufMgr->unPinPage(file, oldPageID, true);
+  bufMgr->unPinPage(file, newPageID, true);
+}
+
+template <class T>
+void BTreeIndex::updateRoot(PageId oldRootID,
+                            const PageKeyPair<T> &pushUpPage) {
+  // allocate space for the new root page
+  Page *newRoot;
+  PageId newRootID;
+  allocNodePage(newRootID, newRoot);
+
+  // retrive and update the old meta page
+  std::lock_guard<std::mutex> metaGuard(metaLatch);
+  Page *metaPage;
+  bufMgr->readPage(file, headerPageNum, metaPage);
+  IndexMetaInfo *metaInfoPage = (IndexMetaInfo *)metaPage;
+  metaInfoPage->rootPageNo = newRootID;
+
+  // define the new root node
+  NonLeafNode<T> *newRootNode = (NonLeafNode<T> *)newRoot;
+  initNode(newRootNode, initial == rootPageNum ? 1 : 0, oldRootID);
+  insertAt(newRootNode, 0, pushUpPage.key, pushUpPage.pageNo);
+  rootPageNum = newRootID;
+
+  // unpin
+  bufMgr->unPinPage(file, newRootID, true);
+  bufMgr->unPinPage(file, headerPageNum, true);
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::allocNodePage
+// -----------------------------------------------------------------------------
+
+void BTreeIndex::allocNodePage(PageId &pageNo, Page *&page) {
+  std::lock_guard<std::mutex> metaGuard(metaLatch);
+  Page *metaPage;
+  bufMgr->readPage(file, headerPageNum, metaPage);
+  IndexMetaInfo *metaInfo = (IndexMetaInfo *)metaPage;
+  if (metaInfo->freePageNo == 0) {
+    bufMgr->unPinPage(file, headerPageNum, false);
+    bufMgr->allocPage(file, pageNo, page);
+    return;
+  }
+
+  // reuse the page at the head of the free list
+  pageNo = metaInfo->freePageNo;
+  bufMgr->readPage(file, pageNo, page);
+  metaInfo->freePageNo = ((FreeNode *)page)->nextFreePageNo;
+  bufMgr->unPinPage(file, headerPageNum, true);
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::freeNodePage
+// -----------------------------------------------------------------------------
+
+void BTreeIndex::freeNodePage(PageId pageNo, Page *page) {
+  std::lock_guard<std::mutex> metaGuard(metaLatch);
+  Page *metaPage;
+  bufMgr->readPage(file, headerPageNum, metaPage);
+  IndexMetaInfo *metaInfo = (IndexMetaInfo *)metaPage;
+  ((FreeNode *)page)->nextFreePageNo = metaInfo->freePageNo;
+  metaInfo->freePageNo = pageNo;
+  bufMgr->unPinPage(file, pageNo, true);
+  bufMgr->unPinPage(file, headerPageNum, true);
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::deleteEntry
+// -----------------------------------------------------------------------------
+
+bool BTreeIndex::deleteEntry(const void *key, const RecordId rid,
+                             const DeletePolicy policy) {
+  switch (attributeType) {
+    case INTEGER:
+      return deleteKey(readKey<int>(key), rid, policy);
+    case DOUBLE:
+      return deleteKey(readKey<double>(key), rid, policy);
+    case STRING:
+      return deleteKey(readKey<StringKey>(key), rid, policy);
+    case COMPOSITE:
+      return deleteKey(encodeKey(key, keyAttrs.size()), rid, policy);
+  }
+  return false;
+}
+
+template <class T>
+bool BTreeIndex::deleteKey(const T &key, const RecordId &rid,
+                           DeletePolicy policy) {
+  bool found = false;
+
+  if (policy == LAZY_DELETE) {
+    // remove the entry from its leaf and leave the tree shape alone, which
+    // only takes latching the leaves exclusively
+    SharedLatchGuard treeGuard(treeLatch);
+    checkWritable();
+    PageId pageNum;
+    Page *page;
+    findLeaf(key, pageNum, page, true);
+    while (true) {
+      LeafNode<T> *leaf = (LeafNode<T> *)page;
+      found = removeFromLeaf(leaf, key, rid);
+      PageId nextPageNum = leaf->rightSibPageNo;
+      bool keyMayContinue =
+          leaf->numKeys == 0 || compareAt(leaf, leaf->numKeys - 1, key) <= 0;
+      if (found || !keyMayContinue || nextPageNum == 0) {
+        nodeLatches.unlock(pageNum);
+        bufMgr->unPinPage(file, pageNum, found);
+        return found;
+      }
+      nodeLatches.lock(nextPageNum);
+      nodeLatches.unlock(pageNum);
+      bufMgr->unPinPage(file, pageNum, false);
+      pageNum = nextPageNum;
+      bufMgr->readPage(file, pageNum, page);
+    }
+  }
+
+  // merges reach across siblings and up to the root, so they wait for every
+  // other operation rather than latching node by node
+  std::lock_guard<RWLatch> treeGuard(treeLatch);
+  checkWritable();
+  Page *root;
+  bufMgr->readPage(file, rootPageNum, root);
+  deleteEntryHelper(key, rid, root, rootPageNum, rootPageNum == initial,
+                    found);
+
+  // a non-leaf root left with a single child hands the root over to it
+  while (rootPageNum != initial) {
+    bufMgr->readPage(file, rootPageNum, root);
+    NonLeafNode<T> *rootNode = (NonLeafNode<T> *)root;
+    if (rootNode->numKeys > 0) {
+      bufMgr->unPinPage(file, rootPageNum, false);
+      break;
+    }
+    PageId oldRootNum = rootPageNum;
+    rootPageNum = childAt(rootNode, 0);
+    freeNodePage(oldRootNum, root);
+
+    Page *metaPage;
+    bufMgr->readPage(file, headerPageNum, metaPage);
+    ((IndexMetaInfo *)metaPage)->rootPageNo = rootPageNum;
+    bufMgr->unPinPage(file, headerPageNum, true);
+  }
+  return found;
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::removeFromLeaf
+// -----------------------------------------------------------------------------
+
+template <class T>
+bool BTreeIndex::removeFromLeaf(LeafNode<T> *node, const T &key,
+                                const RecordId &rid) {
+  int i = lowerBound(node, key);
+  for (; i < node->numKeys && compareAt(node, i, key) == 0; i++) {
+    if (ridAt(node, i) == rid) {
+      removeAt(node, i);
+      return true;
+    }
+  }
+  return false;
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::deleteEntryHelper
+// -----------------------------------------------------------------------------
+
+template <class T>
+bool BTreeIndex::deleteEntryHelper(const T &key, const RecordId &rid,
+                                   Page *currPage, PageId currPageNum,
+                                   bool isLeafNode, bool &found) {
+  if (isLeafNode) {
+    LeafNode<T> *node = (LeafNode<T> *)currPage;
+    found = removeFromLeaf(node, key, rid);
+    bool underfull = found && isUnderfull(node);
+    bufMgr->unPinPage(file, currPageNum, found);
+    return underfull;
+  }
+
+  // equal keys may sit in any child between the separators bounding the key
+  NonLeafNode<T> *node = (NonLeafNode<T> *)currPage;
+  int first = lowerBound(node, key);
+  int last = upperBound(node, key);
+  bool isDirty = false;
+  for (int i = first; i <= last && !found; i++) {
+    PageId childPageNo = childAt(node, i);
+    Page *childPage;
+    bufMgr->readPage(file, childPageNo, childPage);
+    bool isChildLeafNode = node->level != 0;
+    if (deleteEntryHelper(key, rid, childPage, childPageNo, isChildLeafNode,
+                          found)) {
+      rebalanceChild(node, i, isChildLeafNode);
+      isDirty = true;
+    }
+  }
+  // only a node something was deleted below asks its parent to rebalance it,
+  // which also ends the walk of the parent before its children move
+  bool underfull = found && isUnderfull(node);
+  bufMgr->unPinPage(file, currPageNum, isDirty);
+  return underfull;
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::rebalanceChild
+// -----------------------------------------------------------------------------
+
+template <class T>
+void BTreeIndex::rebalanceChild(NonLeafNode<T> *parent, int childIndex,
+                                bool isLeafChild) {
+  // pair the child with its left sibling, or its right one if it has none
+  int leftIndex = childIndex > 0 ? childIndex - 1 : 0;
+  PageId leftPageNo = childAt(parent, leftIndex);
+  PageId rightPageNo = childAt(parent, leftIndex + 1);
+  Page *leftPage, *rightPage;
+  bufMgr->readPage(file, leftPageNo, leftPage);
+  bufMgr->readPage(file, rightPageNo, rightPage);
+
+  // merge the two nodes if they fit in one, else even them out; a STRING
+  // parent may have no room for the longer separator that takes, then the
+  // child is left as it is
+  bool merge;
+  bool changed = true;
+  if (isLeafChild) {
+    LeafNode<T> *left = (LeafNode<T> *)leftPage;
+    LeafNode<T> *right = (LeafNode<T> *)rightPage;
+    merge = canMerge(left, right);
+    if (merge) {
+      // move everything into the left leaf and unlink the right one
+      mergeNodes(left, right);
+      left->rightSibPageNo = right->rightSibPageNo;
+    } else {
+      changed = rebalance(parent, leftIndex, left, right);
+    }
+  } else {
+    NonLeafNode<T> *left = (NonLeafNode<T> *)leftPage;
+    NonLeafNode<T> *right = (NonLeafNode<T> *)rightPage;
+    // the separator is pulled down between the two nodes
+    T separator = keyAt(parent, leftIndex);
+    merge = canMerge(left, separator, right);
+    if (merge) {
+      mergeNodes(left, separator, right);
+    } else {
+      changed = rebalance(parent, leftIndex, left, right);
+    }
+  }
+
+  bufMgr->unPinPage(file, leftPageNo, changed);
+  if (!merge) {
+    bufMgr->unPinPage(file, rightPageNo, changed);
+    return;
+  }
+
+  // drop the separator and the right node from the parent
+  removeAt(parent, leftIndex);
+  freeNodePage(rightPageNo, rightPage);
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::compact
+// -----------------------------------------------------------------------------
+
+void BTreeIndex::compact(const double fillFactor) {
+  std::lock_guard<RWLatch> treeGuard(treeLatch);
+  checkWritable();
+  switch (attributeType) {
+    case INTEGER:
+      compactTree<int>(fillFactor);
+      break;
+    case DOUBLE:
+      compactTree<double>(fillFactor);
+      break;
+    case STRING:
+    case COMPOSITE:
+      compactTree<StringKey>(fillFactor);
+      break;
+  }
+}
+
+template <class T>
+void BTreeIndex::compactTree(double fillFactor) {
+  // gather the live entries along the leaf chain
+  std::vector<RIDKeyPair<T>> entries;
+  std::vector<PageId> pageNos;
+  PageId pageNum = initial;
+  while (pageNum != 0) {
+    Page *page;
+    bufMgr->readPage(file, pageNum, page);
+    LeafNode<T> *leaf = (LeafNode<T> *)page;
+    for (int i = 0; i < leaf->numKeys; i++) {
+      entries.push_back(entryAt(leaf, i));
+    }
+    if (pageNum != initial) {
+      pageNos.push_back(pageNum);
+    }
+    PageId nextPageNum = leaf->rightSibPageNo;
+    bufMgr->unPinPage(file, pageNum, false);
+    pageNum = nextPageNum;
+  }
+
+  // gather the non-leaf pages level by level
+  std::vector<PageId> levelPageNos;
+  if (rootPageNum != initial) {
+    levelPageNos.push_back(rootPageNum);
+  }
+  while (!levelPageNos.empty()) {
+    std::vector<PageId> childPageNos;
+    for (size_t i = 0; i < levelPageNos.size(); i++) {
+      Page *page;
+      bufMgr->readPage(file, levelPageNos[i], page);
+      NonLeafNode<T> *node = (NonLeafNode<T> *)page;
+      if (node->level == 0) {
+        for (int j = 0; j <= node->numKeys; j++) {
+          childPageNos.push_back(childAt(node, j));
+        }
+      }
+      bufMgr->unPinPage(file, levelPageNos[i], false);
     }
-    // Unpin page as soon as possible
-    bufMgr->unPinPage(this->file, this->headerPageNum, false);
+    pageNos.insert(pageNos.end(), levelPageNos.begin(), levelPageNos.end());
+    levelPageNos.swap(childPageNos);
+  }
 
-  } else {  // not exist
+  // take the free list apart as well
+  {
+    std::lock_guard<std::mutex> metaGuard(metaLatch);
+    Page *metaPage;
+    bufMgr->readPage(file, headerPageNum, metaPage);
+    IndexMetaInfo *metaInfo = (IndexMetaInfo *)metaPage;
+    PageId freeNum = metaInfo->freePageNo;
+    metaInfo->freePageNo = 0;
+    bufMgr->unPinPage(file, headerPageNum, true);
+    while (freeNum != 0) {
+      Page *page;
+      bufMgr->readPage(file, freeNum, page);
+      pageNos.push_back(freeNum);
+      PageId nextFreeNum = ((FreeNode *)page)->nextFreePageNo;
+      bufMgr->unPinPage(file, freeNum, false);
+      freeNum = nextFreeNum;
+    }
+  }
 
-    // Create new file
-    this->file = new BlobFile(outIndexName, true);
-    bufMgr->allocPage(this->file, this->headerPageNum, headerPage);
-    Page *rootPage;
-    bufMgr->allocPage(this->file, this->rootPageNum, rootPage);
-    IndexMetaInfo *metaInfo = (IndexMetaInfo *)headerPage;
+  // free every page but the initial leaf, highest first so the free list
+  // hands them back in ascending order, and rebuild from there: the leaves
+  // are allocated first, so the chain runs in page order
+  std::sort(pageNos.begin(), pageNos.end());
+  for (size_t i = pageNos.size(); i > 0; i--) {
+    Page *page;
+    bufMgr->readPage(file, pageNos[i - 1], page);
+    freeNodePage(pageNos[i - 1], page);
+  }
 
-    // Read in metaInfo for this file
-    strncpy(metaInfo->relationName, relationName.c_str(), 20);
-    metaInfo->attrType = attrType;
-    metaInfo->attrByteOffset = attrByteOffset;
-    this->initial = rootPageNum;
+  size_t next = 0;
+  auto nextPair = [&](RIDKeyPair<T> &out) {
+    if (next == entries.size()) {
+      return false;
+    }
+    out = entries[next++];
+    return true;
+  };
+  bulkLoadTree<T>(nextPair, std::min(1.0, std::max(fillFactor, 0.0)));
+}
 
-    // Initialize root
-    LeafNodeInt *root = (LeafNodeInt *)rootPage;
-    root->rightSibPageNo = 0;
-    metaInfo->rootPageNo = this->rootPageNum;
+// -----------------------------------------------------------------------------
+// BTreeIndex::bulkLoad
+// -----------------------------------------------------------------------------
 
-    // Unpin as soon as possible
-    bufMgr->unPinPage(this->file, this->headerPageNum, true);
-    bufMgr->unPinPage(this->file, this->rootPageNum, true);
+template <class T>
+void BTreeIndex::bulkLoad(const std::string &relationName,
+                          const std::string &indexName, double fillFactor) {
+  fillFactor = std::min(1.0, std::max(fillFactor, 0.0));
 
-    // Scan in and fill new file
+  // extract the pairs, spilling a sorted run whenever memory is full
+  std::vector<RIDKeyPair<T>> run;
+  std::vector<std::string> runNames;
+  {
     FileScan fileScan(relationName, bufMgr);
     RecordId rid;
     try {
       while (true) {
         fileScan.scanNext(rid);
         std::string record = fileScan.getRecord();
-        insertEntry(record.c_str() + attrByteOffset, rid);
+        RIDKeyPair<T> pair;
+        pair.set(rid, recordKey<T>(record.c_str()));
+        setPayload(pair, record.c_str() + included.byteOffset,
+                   included.length);
+        run.push_back(pair);
+        if (run.size() == (size_t)BULKLOAD_RUN_SIZE) {
+          std::sort(run.begin(), run.end());
+          std::ostringstream runName;
+          runName << indexName << ".run" << runNames.size();
+          std::ofstream out(runName.str(), std::ios::binary);
+          out.write((const char *)run.data(),
+                    run.size() * sizeof(RIDKeyPair<T>));
+          runNames.push_back(runName.str());
+          run.clear();
+        }
       }
-    } catch (EndOfFileException e) {
-      // Save to disk
-      bufMgr->flushFile(file);
+    } catch (const EndOfFileException &e) {
+    }
+  }
+  std::sort(run.begin(), run.end());
+
+  // merge the spilled runs with whatever is still in memory
+  typedef std::pair<RIDKeyPair<T>, size_t> RunHead;
+  struct RunHeadGreater {
+    bool operator()(const RunHead &a, const RunHead &b) const {
+      return b.first < a.first;
+    }
+  };
+  std::vector<std::ifstream *> runs;
+  std::priority_queue<RunHead, std::vector<RunHead>, RunHeadGreater> heads;
+  for (size_t r = 0; r < runNames.size(); r++) {
+    runs.push_back(new std::ifstream(runNames[r], std::ios::binary));
+    RIDKeyPair<T> pair;
+    if (runs[r]->read((char *)&pair, sizeof(pair))) {
+      heads.push(RunHead(pair, r));
     }
   }
+  size_t nextInRun = 0;
+  auto nextPair = [&](RIDKeyPair<T> &out) {
+    bool fromMemory =
+        nextInRun < run.size() && (heads.empty() || !(heads.top().first <
+                                                       run[nextInRun]));
+    if (fromMemory) {
+      out = run[nextInRun++];
+      return true;
+    }
+    if (heads.empty()) {
+      return false;
+    }
+    RunHead head = heads.top();
+    heads.pop();
+    out = head.first;
+    if (runs[head.second]->read((char *)&head.first, sizeof(head.first))) {
+      heads.push(head);
+    }
+    return true;
+  };
+
+  bulkLoadTree<T>(nextPair, fillFactor);
+
+  for (size_t r = 0; r < runs.size(); r++) {
+    delete runs[r];
+    std::remove(runNames[r].c_str());
+  }
 }
 
-// -----------------------------------------------------------------------------
-// BTreeIndex::~BTreeIndex -- destructor
-// -----------------------------------------------------------------------------
+template <class T, class NextPair>
+void BTreeIndex::bulkLoadTree(NextPair nextPair, double fillFactor) {
+  // pack the leaves, then build each non-leaf level over the one below
+  std::vector<PageKeyPair<T>> level;
+  bulkLoadLeaves<T>(nextPair, fillFactor, level);
+  int nodeLevel = 1;
+  while (level.size() > 1) {
+    std::vector<PageKeyPair<T>> parents;
+    bulkLoadNonLeafLevel(level, nodeLevel, fillFactor, parents);
+    level.swap(parents);
+    nodeLevel = 0;
+  }
 
-/**
- * The destructor
- * Flush and delete the index file
- */
-BTreeIndex::~BTreeIndex() {
-  this->bufMgr->flushFile(BTreeIndex::file);
-  this->scanExecuting = false;
-  delete file;
-  this->file = nullptr;
+  // the top of the last level built is the new root
+  rootPageNum = level[0].pageNo;
+  Page *metaPage;
+  bufMgr->readPage(file, headerPageNum, metaPage);
+  ((IndexMetaInfo *)metaPage)->rootPageNo = rootPageNum;
+  bufMgr->unPinPage(file, headerPageNum, true);
 }
 
-// -----------------------------------------------------------------------------
-// BTreeIndex::insertNodeLeaf
-// -----------------------------------------------------------------------------
+template <class T, class NextPair>
+void BTreeIndex::bulkLoadLeaves(NextPair nextPair, double fillFactor,
+                                std::vector<PageKeyPair<T>> &leaves) {
+  // the initial leaf becomes the first leaf
+  PageId pageNo = initial;
+  Page *page;
+  bufMgr->readPage(file, pageNo, page);
+  LeafNode<T> *node = (LeafNode<T> *)page;
+  initNode(node, included.length);
+  PageKeyPair<T> entry;
+  entry.set(pageNo, T());
 
-void BTreeIndex::insertNodeLeaf(LeafNodeInt *node,
-                                RIDKeyPair<int> entryInsertPair) {
-  // for leaf node pages that are not empty
-  if (node->ridArray[0].page_number != 0) {
-    int i = leafOccupancy - 1;
-    for (; i >= 0 && node->ridArray[i].page_number == 0; --i) {}
-    // copy and move the record id and key arrays
-    for (; i >= 0 && node->keyArray[i] > entryInsertPair.key; --i) {
-      node->ridArray[i + 1] = node->ridArray[i];
-      node->keyArray[i + 1] = node->keyArray[i];
-    }
-    // finally add the entry pair to be inserted
-    node->ridArray[i + 1] = entryInsertPair.rid;
-    node->keyArray[i + 1] = entryInsertPair.key;
-  } else {
-    // simple case: for leaf node pages that are empty
-    node->ridArray[0] = entryInsertPair.rid;
-    node->keyArray[0] = entryInsertPair.key;
+  // fill each leaf up to the fill factor before moving on to the next one
+  RIDKeyPair<T> pair;
+  while (nextPair(pair)) {
+    if (node->numKeys > 0 &&
+        (isFilledTo(node, fillFactor) || !hasRoom(node, pair.key))) {
+      leaves.push_back(entry);
+      PageId nextPageNo;
+      Page *nextPage;
+      allocNodePage(nextPageNo, nextPage);
+      entry.set(nextPageNo,
+                separatorKey(keyAt(node, node->numKeys - 1), pair.key));
+      node->rightSibPageNo = nextPageNo;
+      bufMgr->unPinPage(file, pageNo, true);
+      pageNo = nextPageNo;
+      node = (LeafNode<T> *)nextPage;
+      initNode(node, included.length);
+    }
+    insertAt(node, node->numKeys, pair);
+  }
+  leaves.push_back(entry);
+
+  // even the last leaf out with the one before so it is not left nearly empty
+  if (leaves.size() > 1 && isUnderfull(node)) {
+    PageId prevPageNo = leaves[leaves.size() - 2].pageNo;
+    Page *prevPage;
+    bufMgr->readPage(file, prevPageNo, prevPage);
+    NonLeafNode<T> parent;
+    initNode(&parent, 1, prevPageNo);
+    insertAt(&parent, 0, entry.key, pageNo);
+    if (rebalance(&parent, 0, (LeafNode<T> *)prevPage, node)) {
+      leaves.back().key = keyAt(&parent, 0);
+    }
+    bufMgr->unPinPage(file, prevPageNo, true);
   }
+  bufMgr->unPinPage(file, pageNo, true);
 }
 
-// -----------------------------------------------------------------------------
-// BTreeIndex::insertNodeNonLeaf
-// -----------------------------------------------------------------------------
+template <class T>
+void BTreeIndex::bulkLoadNonLeafLevel(
+    const std::vector<PageKeyPair<T>> &children, int level,
+    double fillFactor, std::vector<PageKeyPair<T>> &parents) {
+  size_t next = 0;
+  PageId pageNo = 0;
+  NonLeafNode<T> *node = nullptr;
+  while (next < children.size()) {
+    if (node != nullptr) {
+      bufMgr->unPinPage(file, pageNo, true);
+    }
+    Page *page;
+    allocNodePage(pageNo, page);
+    node = (NonLeafNode<T> *)page;
+    initNode(node, level, children[next].pageNo);
+    // the first key of each child but the leftmost separates it from the
+    // child before it, the key of the leftmost one moves up a level
+    PageKeyPair<T> entry;
+    entry.set(pageNo, children[next].key);
+    parents.push_back(entry);
+    next++;
+    while (next < children.size() && !isFilledTo(node, fillFactor) &&
+           hasRoom(node, children[next].key)) {
+      insertAt(node, node->numKeys, children[next].key, children[next].pageNo);
+      next++;
+    }
+  }
 
-void BTreeIndex::insertNodeNonLeaf(NonLeafNodeInt *node,
-                                   PageKeyPair<int> *entryInsertPair) {
-  // similar approach to inserting a leaf node
-  int i = nodeOccupancy;
-  for (; i >= 0 && node->pageNoArray[i] == 0; --i) {}
-  for (; i > 0 && node->keyArray[i - 1] > entryInsertPair->key; --i) {
-    node->keyArray[i] = node->keyArray[i - 1];
-    node->pageNoArray[i + 1] = node->pageNoArray[i];
+  // even the last node out with the one before, rotating their keys through
+  // the separator between them
+  if (parents.size() > 1 && isUnderfull(node)) {
+    PageId prevPageNo = parents[parents.size() - 2].pageNo;
+    Page *prevPage;
+    bufMgr->readPage(file, prevPageNo, prevPage);
+    NonLeafNode<T> parent;
+    initNode(&parent, 0, prevPageNo);
+    insertAt(&parent, 0, parents.back().key, pageNo);
+    if (rebalance(&parent, 0, (NonLeafNode<T> *)prevPage, node)) {
+      parents.back().key = keyAt(&parent, 0);
+    }
+    bufMgr->unPinPage(file, prevPageNo, true);
   }
-  // finally add the entry pair to be inserted
-  node->keyArray[i] = entryInsertPair->key;
-  node->pageNoArray[i + 1] = entryInsertPair->pageNo;
+  bufMgr->unPinPage(file, pageNo, true);
 }
 
 // -----------------------------------------------------------------------------
-// BTreeIndex::insertEntryHelper
+// BTreeIndex::findLeaf
 // -----------------------------------------------------------------------------
 
-void BTreeIndex::insertEntryHelper(RIDKeyPair<int> entryInsertPair,
-                                   PageKeyPair<int> *&entryPropPair,
-                                   Page *currPage, PageId currPageNum,
-                                   bool isLeafNode) {
-  // when the current code is a non-leaf node
-  if (!isLeafNode) {
-    NonLeafNodeInt *node = (NonLeafNodeInt *)(currPage);
-    // find the index of the next child to insert
-    int i = nodeOccupancy;
-    for (; i >= 0 && node->pageNoArray[i] == 0; --i) {}
-    for (; i > 0 && node->keyArray[i - 1] >= entryInsertPair.key; --i) {}
-
-    // recusively call the helper function on the child node
-    PageId childPageNo = node->pageNoArray[i];
-    Page *childPage = nullptr;
-    bufMgr->readPage(file, childPageNo, childPage);
-    bool isChildLeafNode = node->level != 0;
-    insertEntryHelper(entryInsertPair, entryPropPair, childPage, childPageNo,
-                      isChildLeafNode);
+template <class T>
+void BTreeIndex::findLeaf(const T &key, PageId &leafPageNum, Page *&leafPage,
+                          bool exclusive, bool upper) {
+  // the root cannot move while its page number is read and the page latched
+  rootLatch.lockShared();
+  leafPageNum = rootPageNum;
+  bool foundLeaf = initial == leafPageNum;  // root is leaf
+  if (foundLeaf && exclusive) {
+    nodeLatches.lock(leafPageNum);
+  } else {
+    nodeLatches.lockShared(leafPageNum);
+  }
+  rootLatch.unlockShared();
+  readNode(leafPageNum, leafPage);
 
-    // when the node should be splitted and the entry should be pushed up
-    bool isDirty = false;
-    if (entryPropPair) {
-      // when the current node is not full
-      if (node->pageNoArray[nodeOccupancy] == 0) {
-        insertNodeNonLeaf(node, entryPropPair);
-        isDirty = true;
-        entryPropPair = nullptr;
-        bufMgr->unPinPage(file, currPageNum, isDirty);
-      } else {
-        // simple case: if full, directly split the node
-        splitNonLeafNode(node, currPageNum, entryPropPair);
-      }
-    } else {
-      bufMgr->unPinPage(file, currPageNum, isDirty);
+  while (!foundLeaf) {
+    NonLeafNode<T> *current = reinterpret_cast<NonLeafNode<T> *>(leafPage);
+    if (current->level == 1) {  // Leaf in next level
+      foundLeaf = true;
     }
-  } else {
-    // when the current code is a leaf node
-    LeafNodeInt *node = (LeafNodeInt *)(currPage);
-    // insert the node directly when the page is not full
-    if (node->ridArray[leafOccupancy - 1].page_number == 0) {
-      insertNodeLeaf(node, entryInsertPair);
-      entryPropPair = nullptr;
-      bufMgr->unPinPage(file, currPageNum, true);
+
+    // binary search for the leftmost child that may hold the key, keys equal
+    // to a separator may sit on either side of it
+    int index = upper ? upperBound(current, key) : lowerBound(current, key);
+
+    // Latch the child before letting go of the parent
+    PageId childPageNum = childAt(current, index);
+    if (foundLeaf && exclusive) {
+      nodeLatches.lock(childPageNum);
     } else {
-      // simple case: if full, directly split the node
-      splitLeafNode(node, currPageNum, entryPropPair, entryInsertPair);
+      nodeLatches.lockShared(childPageNum);
     }
+    nodeLatches.unlockShared(leafPageNum);
+    releaseNode(leafPageNum);
+    leafPageNum = childPageNum;
+    readNode(leafPageNum, leafPage);
   }
 }
 
 // -----------------------------------------------------------------------------
-// BTreeIndex::insertEntry
+// BTreeIndex::releaseLatches
 // -----------------------------------------------------------------------------
 
-void BTreeIndex::insertEntry(const void *key, const RecordId rid) {
-  // for making changes to leaf node pages
-  RIDKeyPair<int> entryInsertPair;
-  int keyInt = *(int *)key;
-  entryInsertPair.set(rid, keyInt);
-  // for making changes to non-leaf node pages
-  PageKeyPair<int> *entryPropPair = nullptr;
-  bool isLeafNode = false;
-  // read the root page node
-  Page *root = nullptr;
-  bufMgr->readPage(file, rootPageNum, root);
-
-  if (rootPageNum != initial) {
-    // for the non leaf nodes
-    insertEntryHelper(entryInsertPair, entryPropPair, root, rootPageNum,
-                      isLeafNode);
+void BTreeIndex::releaseLatch(PageId pageNo) {
+  if (pageNo == Page::INVALID_NUMBER) {
+    rootLatch.unlock();
   } else {
-    // for the leaf nodes
-    insertEntryHelper(entryInsertPair, entryPropPair, root, rootPageNum,
-                      !isLeafNode);
+    nodeLatches.unlock(pageNo);
   }
 }
 
-void BTreeIndex::splitLeafNode(LeafNodeInt *oldNode, PageId oldPageID,
-                               PageKeyPair<int> *&pushUpPage,
-                               RIDKeyPair<int> insertRecord) {
-  // allocate space for a new leaf node
-  Page *newPage;
-  PageId newPageID;
-  bufMgr->allocPage(file, newPageID, newPage);
-  LeafNodeInt *newNode = (LeafNodeInt *)newPage;
-
-  // split the old node into 2 parts from index [0, mid] and [mid + 1,
-  // leafOccupancy - 1]
-  int mid = leafOccupancy / 2 - 1;
-  if (leafOccupancy % 2 == 0 && insertRecord.key >= oldNode->keyArray[mid])
-    mid++;  // e.g: keyArray={3, 6, 8}, initially mid = 0 which points to 3.
-            // insert 9 mid should be 1 to balance
-  int index = 0;
-  for (int i = mid + 1; i < leafOccupancy; i++) {
-    newNode->keyArray[index] = oldNode->keyArray[i];
-    oldNode->keyArray[i] = 0;
-    newNode->ridArray[index] = oldNode->ridArray[i];
-    oldNode->ridArray[i].page_number = 0;
-    index++;
-  }
-
-  // insert the record to the appropriate part based on the key value
-  if (insertRecord.key < oldNode->keyArray[mid]) {
-    insertNodeLeaf(oldNode, insertRecord);
+void BTreeIndex::releaseLatches(std::vector<PageId> &latched) {
+  for (PageId pageNo : latched) {
+    releaseLatch(pageNo);
+  }
+  latched.clear();
+}
+
+void BTreeIndex::readNode(PageId pageNo, Page *&page) {
+  if (mapped) {
+    // readers never change the nodes they read, and nothing else may
+    page = const_cast<Page *>(file->mappedPage(pageNo));
   } else {
-    insertNodeLeaf(newNode, insertRecord);
+    bufMgr->readPage(file, pageNo, page);
   }
+}
 
-  // update sibling relation after inserting
-  newNode->rightSibPageNo = oldNode->rightSibPageNo;
-  oldNode->rightSibPageNo = newPageID;
+void BTreeIndex::releaseNode(PageId pageNo) {
+  if (!mapped) {
+    bufMgr->unPinPage(file, pageNo, false);
+  }
+}
 
-  // copy the middle key value to the pushUpPage
-  PageKeyPair<int> middleRecord;
-  middleRecord.set(newPageID, newNode->keyArray[0]);
-  pushUpPage = &middleRecord;
+void BTreeIndex::checkWritable() const {
+  if (mapped) {
+    throw IndexReadOnlyException(file->filename());
+  }
+}
 
-  // update root if the old node is root itself
-  if (oldPageID == rootPageNum) {
-    updateRoot(rootPageNum, pushUpPage);
+PageId BTreeIndex::rightSibling(PageId pageNo, const Page &page) {
+  if (!treeLatch.tryLockShared()) {
+    return Page::INVALID_NUMBER;
   }
+  if (!nodeLatches.tryLockShared(pageNo)) {
+    treeLatch.unlockShared();
+    return Page::INVALID_NUMBER;
+  }
+  PageId nextPageNo;
+  switch (attributeType) {
+    case INTEGER:
+      nextPageNo =
+          reinterpret_cast<const LeafNode<int> *>(&page)->rightSibPageNo;
+      break;
+    case DOUBLE:
+      nextPageNo =
+          reinterpret_cast<const LeafNode<double> *>(&page)->rightSibPageNo;
+      break;
+    default:
+      nextPageNo =
+          reinterpret_cast<const LeafNode<StringKey> *>(&page)->rightSibPageNo;
+      break;
+  }
+  nodeLatches.unlockShared(pageNo);
+  treeLatch.unlockShared();
+  return nextPageNo;
+}
 
-  // unpin
-  bufMgr->unPinPage(file, oldPageID, true);
-  bufMgr->unPinPage(file, newPageID, true);
+// -----------------------------------------------------------------------------
+// BTreeIndex::lookup
+// -----------------------------------------------------------------------------
+
+bool BTreeIndex::lookup(const void *key, std::vector<RecordId> &outRids) {
+  switch (attributeType) {
+    case INTEGER:
+      return lookupKey(readKey<int>(key), outRids);
+    case DOUBLE:
+      return lookupKey(readKey<double>(key), outRids);
+    case STRING:
+      return lookupKey(readKey<StringKey>(key), outRids);
+    case COMPOSITE:
+      return lookupKey(encodeKey(key, keyAttrs.size()), outRids);
+  }
+  return false;
 }
 
-void BTreeIndex::splitNonLeafNode(NonLeafNodeInt *oldNode, PageId oldPageID,
-                                  PageKeyPair<int> *&pushUpPage) {
-  // allocate space for a new leaf node
-  Page *newPage;
-  PageId newPageID;
-  bufMgr->allocPage(file, newPageID, newPage);
-  NonLeafNodeInt *newNode = (NonLeafNodeInt *)newPage;
-
-  int mid = nodeOccupancy / 2 - 1;
-  if (nodeOccupancy % 2 == 0 && pushUpPage->key >= oldNode->keyArray[mid])
-    mid++;
-  mid++;  // for the non-leaf node, we make the left part larger by 1 because
-          // it's easier to delete key from the end of the left part and
-          // maintain structure
-  int index = 0;
-  for (int i = mid + 1; i < nodeOccupancy; i++) {
-    newNode->keyArray[index] = oldNode->keyArray[i];
-    oldNode->keyArray[i] = 0;
-    newNode->pageNoArray[index] = oldNode->pageNoArray[i];
-    oldNode->pageNoArray[i] = 0;
-    index++;
-  }
-
-  // insert the record to the appropriate part based on the key value
-  if (pushUpPage->key < newNode->keyArray[0]) {
-    insertNodeNonLeaf(oldNode, pushUpPage);
-  } else {
-    insertNodeNonLeaf(newNode, pushUpPage);
+template <class T>
+bool BTreeIndex::lookupKey(const T &key, std::vector<RecordId> &outRids) {
+  SharedLatchGuard treeGuard(treeLatch);
+  size_t found = outRids.size();
+  PageId pageNum;
+  Page *page;
+  findLeaf(key, pageNum, page);
+  while (true) {
+    LeafNode<T> *leaf = reinterpret_cast<LeafNode<T> *>(page);
+    int first = lowerBound(leaf, key);
+    int last = upperBound(leaf, key);
+    if (last > first) {
+      size_t size = outRids.size();
+      outRids.resize(size + last - first);
+      copyRids(leaf, first, last - first, &outRids[size]);
+    }
+    // equal keys may continue in the right sibling only if they reach the
+    // end of this leaf
+    PageId nextPageNum = leaf->rightSibPageNo;
+    bool done = last != leaf->numKeys || nextPageNum == 0;
+    if (!done) {
+      nodeLatches.lockShared(nextPageNum);
+    }
+    nodeLatches.unlockShared(pageNum);
+    releaseNode(pageNum);
+    if (done) {
+      break;
+    }
+    pageNum = nextPageNum;
+    readNode(pageNum, page);
   }
+  return outRids.size() > found;
+}
 
-  // update sibling relation after inserting
-  newNode->level = oldNode->level;
+bool BTreeIndex::contains(const void *key) {
+  switch (attributeType) {
+    case INTEGER:
+      return containsKey(readKey<int>(key));
+    case DOUBLE:
+      return containsKey(readKey<double>(key));
+    case STRING:
+      return containsKey(readKey<StringKey>(key));
+    case COMPOSITE:
+      return containsKey(encodeKey(key, keyAttrs.size()));
+  }
+  return false;
+}
 
-  // copy the middle key value to the pushUpPage
-  PageKeyPair<int> middleRecord;
-  middleRecord.set(newPageID, oldNode->keyArray[mid]);
-  pushUpPage = &middleRecord;
+template <class T>
+bool BTreeIndex::containsKey(const T &key) {
+  SharedLatchGuard treeGuard(treeLatch);
+  PageId pageNum;
+  Page *page;
+  findLeaf(key, pageNum, page);
+  while (true) {
+    LeafNode<T> *leaf = reinterpret_cast<LeafNode<T> *>(page);
+    int first = lowerBound(leaf, key);
+    bool found = first != leaf->numKeys && compareAt(leaf, first, key) == 0;
+    bool atEnd = first == leaf->numKeys;
+    PageId nextPageNum = leaf->rightSibPageNo;
+    bool done = !atEnd || nextPageNum == 0;
+    if (!done) {
+      nodeLatches.lockShared(nextPageNum);
+    }
+    nodeLatches.unlockShared(pageNum);
+    releaseNode(pageNum);
+    if (done) {
+      return found;
+    }
+    pageNum = nextPageNum;
+    readNode(pageNum, page);
+  }
+}
 
-  // delete the middle key from the end of the old node
-  oldNode->keyArray[mid] = 0;
-  oldNode->pageNoArray[mid] = 0;
+// -----------------------------------------------------------------------------
+// BTreeIndex::mapReadOnly
+// -----------------------------------------------------------------------------
 
-  // update root if the old node is root itself
-  if (oldPageID == rootPageNum) {
-    updateRoot(rootPageNum, pushUpPage);
+void BTreeIndex::mapReadOnly() {
+  if (mapped) {
+    return;
   }
+  // the built-in scan must let go of its leaf before the file is flushed
+  if (scanCursor.isScanExecuting()) {
+    scanCursor.endScan();
+  }
+  // flushing waits for the read-ahead of earlier scans to finish, so it is
+  // done before the tree is latched
+  bufMgr->flushFile(file);
 
-  // unpin
-  bufMgr->unPinPage(file, oldPageID, true);
-  bufMgr->unPinPage(file, newPageID, true);
+  std::lock_guard<RWLatch> treeGuard(treeLatch);
+  if (mapped) {
+    return;
+  }
+  // the mapping sees what is on disk, and no frame is left to go stale, even
+  // of pages changed before the latch was taken
+  bufMgr->flushFile(file);
+  file->map();
+  mapped = true;
 }
 
-void BTreeIndex::updateRoot(PageId oldRootID, PageKeyPair<int> *pushUpPage) {
-  // allocate space for the new root page
-  Page *newRoot;
-  PageId newRootID;
-  bufMgr->allocPage(file, newRootID, newRoot);
+// -----------------------------------------------------------------------------
+// IndexCursor::IndexCursor -- constructor
+// -----------------------------------------------------------------------------
 
-  // retrive and update the old meta page
-  Page *metaPage;
-  bufMgr->readPage(file, headerPageNum, metaPage);
-  IndexMetaInfo *metaInfoPage = (IndexMetaInfo *)metaPage;
-  metaInfoPage->rootPageNo = newRootID;
+IndexCursor::IndexCursor(BTreeIndex *indexIn)
+    : index(indexIn),
+      scanExecuting(false),
+      nextEntry(-1),
+      currentPageNum(0),
+      currentPageData(nullptr),
+      hasLast(false),
+      leavesRead(0) {}
 
-  // define the new root node
-  NonLeafNodeInt *newRootNode = (NonLeafNodeInt *)newRoot;
-  newRootNode->level = initial == rootPageNum ? 1 : 0;
-  rootPageNum = newRootID;
-  newRootNode->keyArray[0] = pushUpPage->key;
-  newRootNode->pageNoArray[0] = oldRootID;
-  newRootNode->pageNoArray[1] = pushUpPage->pageNo;
+// -----------------------------------------------------------------------------
+// IndexCursor::~IndexCursor -- destructor
+// -----------------------------------------------------------------------------
 
-  // unpin
-  bufMgr->unPinPage(file, newRootID, true);
-  bufMgr->unPinPage(file, headerPageNum, true);
+IndexCursor::~IndexCursor() {
+  if (scanExecuting) {
+    try {
+      endScan();
+    } catch (const BadgerDbException &e) {
+    }
+  }
 }
 
 // -----------------------------------------------------------------------------
-// BTreeIndex::startScan
+// IndexCursor::startScan
 // -----------------------------------------------------------------------------
 
 /**
@@ -401,20 +2372,21 @@ void BTreeIndex::updateRoot(PageId oldRootID, PageKeyPair<int> *pushUpPage) {
  * @param highVal	High value of range, pointer to integer / double / char
  * string
  * @param highOp	High operator (LT/LTE)
+ * @param numKeyAttrs	Number of leading key attributes of a COMPOSITE index
+ * the bounds compare on, 0 for all of them
  * @throws  BadOpcodesException If lowOp and highOp do not contain one of
  * their their expected values
  * @throws  BadScanrangeException If lowVal > highval
  * @throws  NoSuchKeyFoundException If there is no key in the B+ tree that
  * satisfies the scan criteria.
  **/
-void BTreeIndex::startScan(const void *lowValParm, const Operator lowOpParm,
-                           const void *highValParm, const Operator highOpParm) {
+void IndexCursor::startScan(const void *lowValParm, const Operator lowOpParm,
+                            const void *highValParm, const Operator highOpParm,
+                            const int numKeyAttrs) {
   if (this->scanExecuting) {  // if scan in process
     // end here
     endScan();
   }
-  this->lowValInt = *((int *)lowValParm);
-  this->highValInt = *((int *)highValParm);
   this->lowOp = lowOpParm;
   this->highOp = highOpParm;
 
@@ -422,85 +2394,193 @@ void BTreeIndex::startScan(const void *lowValParm, const Operator lowOpParm,
   if (!((lowOp == GT || lowOp == GTE) && (highOp == LT || highOp == LTE))) {
     throw BadOpcodesException();
   }
+  SharedLatchGuard treeGuard(index->treeLatch);
+
+  switch (index->attributeType) {
+    case INTEGER:
+      lowValInt = readKey<int>(lowValParm);
+      highValInt = readKey<int>(highValParm);
+      startScanKey(lowValInt, highValInt);
+      break;
+    case DOUBLE:
+      lowValDouble = readKey<double>(lowValParm);
+      highValDouble = readKey<double>(highValParm);
+      startScanKey(lowValDouble, highValDouble);
+      break;
+    case STRING:
+      lowValString = readKey<StringKey>(lowValParm);
+      highValString = readKey<StringKey>(highValParm);
+      startScanKey(lowValString, highValString);
+      break;
+    case COMPOSITE: {
+      int numAttrs = numKeyAttrs > 0 && numKeyAttrs < (int)index->keyAttrs.size()
+                         ? numKeyAttrs
+                         : index->keyAttrs.size();
+      lowValString = index->encodeKey(lowValParm, numAttrs);
+      highValString = index->encodeKey(highValParm, numAttrs);
+      if (lowValString > highValString) {
+        throw BadScanrangeException();
+      }
+      // every key starting with a bound sorts after it but before the bound
+      // padded with the greatest byte, so the bounds compare on the leading
+      // attributes only
+      if (lowOp == GT) {
+        padCompositeKey(lowValString);
+      }
+      if (highOp == LTE) {
+        padCompositeKey(highValString);
+      }
+      if (lowValString > highValString) {  // (x, x) on the leading attributes
+        throw NoSuchKeyFoundException();
+      }
+      startScanKey(lowValString, highValString);
+      break;
+    }
+  }
+}
+
+template <>
+const int &IndexCursor::highVal<int>() const {
+  return highValInt;
+}
+
+template <>
+const double &IndexCursor::highVal<double>() const {
+  return highValDouble;
+}
+
+template <>
+const StringKey &IndexCursor::highVal<StringKey>() const {
+  return highValString;
+}
+
+template <>
+int &IndexCursor::lowVal<int>() {
+  return lowValInt;
+}
+
+template <>
+double &IndexCursor::lowVal<double>() {
+  return lowValDouble;
+}
+
+template <>
+StringKey &IndexCursor::lowVal<StringKey>() {
+  return lowValString;
+}
 
+template <class T>
+void IndexCursor::startScanKey(const T &lowVal, const T &highVal) {
   // check for lowVal>highVal
-  if (lowValInt > highValInt) {
+  if (lowVal > highVal) {
     throw BadScanrangeException();
   }
 
-  this->currentPageNum = this->rootPageNum;
-  bufMgr->readPage(this->file, this->currentPageNum, this->currentPageData);
-  if (this->initial != currentPageNum) {  // root not leaf
-    bool foundLeaf = false;
-    while (!foundLeaf) {
-      NonLeafNodeInt *current =
-          reinterpret_cast<NonLeafNodeInt *>(this->currentPageData);
-      if (current->level == 1) {  // Leaf in next level
-        foundLeaf = true;
-      }
+  hasLast = false;
+  leavesRead = 0;
+  index->findLeaf(lowVal, this->currentPageNum, this->currentPageData);
 
-      int index = 0;
+  // binary search for the first key satisfying the low bound, moving right
+  // while the leaf has none
+  LeafNode<T> *current =
+      seek(reinterpret_cast<LeafNode<T> *>(this->currentPageData));
+  bool found = nextEntry != current->numKeys;
+  if (found) {
+    int c = compareAt(current, nextEntry, highVal);
+    found = (highOp == LT && c < 0) || (highOp == LTE && c <= 0);
+  }
+  index->nodeLatches.unlockShared(currentPageNum);
+  if (!found) {
+    // fail to find the key, unpin the page and throw the exception
+    index->releaseNode(currentPageNum);
+    throw NoSuchKeyFoundException();
+  }
+  scanExecuting = true;
+}
 
-      // traverse this level of node to find the first satisfactory index
-      while (index < nodeOccupancy && current->keyArray[index] <= lowValInt &&
-             current->pageNoArray[index + 1] != 0) {
-        index++;
-      }
+template <class T>
+LeafNode<T> *IndexCursor::reposition() {
+  LeafNode<T> *current = reinterpret_cast<LeafNode<T> *>(this->currentPageData);
+  index->nodeLatches.lockShared(currentPageNum);
 
-      this->bufMgr->unPinPage(this->file, currentPageNum, false);
+  // nothing moved since the last call as long as the last entry returned is
+  // still right before nextEntry
+  if (hasLast && nextEntry > 0 && nextEntry <= current->numKeys &&
+      compareAt(current, nextEntry - 1, lowVal<T>()) == 0 &&
+      ridAt(current, nextEntry - 1) == lastRid) {
+    return current;
+  }
+  return seek(current);
+}
 
-      // Read current page in and assign to target for future node traversal
-      this->currentPageNum = current->pageNoArray[index];
-      this->bufMgr->readPage(this->file, this->currentPageNum,
-                             this->currentPageData);
-    }
-  }  // root is leaf
-  bool found = false;
-  while (!found) {
-    LeafNodeInt *current =
-        reinterpret_cast<LeafNodeInt *>(this->currentPageData);
-    if (current->ridArray[0].page_number == 0) {  // check if entire page null
-      bufMgr->unPinPage(file, currentPageNum, false);
-      throw NoSuchKeyFoundException();
-    }
-    bool nextNull = false;
-    for (int i = 0; i < leafOccupancy; i++) {
-      if (nextNull) {
-        break;
-      }
-      int key = current->keyArray[i];
-      // if next entry is null
-      if (i < leafOccupancy - 1 and current->ridArray[i + 1].page_number == 0) {
-        nextNull = true;
+template <class T>
+LeafNode<T> *IndexCursor::seek(LeafNode<T> *current) {
+  const T &low = lowVal<T>();
+  while (true) {
+    int i = hasLast || lowOp == GTE ? lowerBound(current, low)
+                                    : upperBound(current, low);
+    if (hasLast) {
+      // entries with the key of the last one were returned up to it, later
+      // inserts of the same key went after it
+      while (i < current->numKeys && compareAt(current, i, low) == 0 &&
+             !(ridAt(current, i) == lastRid)) {
+        i++;
       }
-      if ((lowOp == GT && highOp == LTE && key <= highValInt &&
-           key > lowValInt) ||
-          (lowOp == GTE && highOp == LTE && key <= highValInt &&
-           key >= lowValInt) ||
-          (lowOp == GTE && highOp == LT && key < highValInt &&
-           key >= lowValInt) ||
-          (lowOp == GT && highOp == LT && key < highValInt &&
-           key > lowValInt)) {
-        found = true;
-        scanExecuting = true;
-        nextEntry = i;
-        break;
-      } else if ((highOp == LT && key >= highValInt) ||
-                 (highOp == LTE && key > highValInt)) {
-        // fail to find the key, unpin the page and throw the exception
-        bufMgr->unPinPage(file, currentPageNum, false);
-        throw NoSuchKeyFoundException();
+      if (i < current->numKeys && compareAt(current, i, low) == 0) {
+        i++;
       }
-      if (i == leafOccupancy - 1 || nextNull) {  // no match, go to next leaf
-        bufMgr->unPinPage(file, currentPageNum, false);
-        if (current->rightSibPageNo == 0) {  // no more leaf
-          throw NoSuchKeyFoundException();
-        }
-        this->currentPageNum = current->rightSibPageNo;
-        bufMgr->readPage(file, currentPageNum, currentPageData);
+    }
+    if (i != current->numKeys || current->rightSibPageNo == 0) {
+      nextEntry = i;
+      return current;
+    }
+    current = moveRight(current);
+  }
+}
+
+template <class T>
+LeafNode<T> *IndexCursor::moveRight(LeafNode<T> *current) {
+  BufMgr *bufMgr = index->bufMgr;
+  BlobFile *file = index->file;
+  PageId nextPageNum = current->rightSibPageNo;
+  index->nodeLatches.lockShared(nextPageNum);
+  index->nodeLatches.unlockShared(currentPageNum);
+  index->releaseNode(currentPageNum);
+  this->currentPageNum = nextPageNum;
+  index->readNode(this->currentPageNum, this->currentPageData);
+
+  // a scan past its first leaf has the next leaves read while it is on this
+  // one, asking again once half of them are used
+  if (leavesRead++ % (READAHEAD_PAGES / 2) == 0) {
+    if (index->mapped) {
+      // the bulk loader and compaction lay leaves out in ascending page
+      // order, so while the chain goes on to the page right after this one
+      // the kernel is told about the pages following it; leaves split out of
+      // order only get the next one advised
+      PageId nextPageNum =
+          reinterpret_cast<LeafNode<T> *>(this->currentPageData)
+              ->rightSibPageNo;
+      if (nextPageNum == currentPageNum + 1) {
+        file->adviseSequential(nextPageNum, READAHEAD_PAGES);
+      } else if (nextPageNum != 0) {
+        file->adviseSequential(nextPageNum, 1);
       }
+    } else {
+      BTreeIndex *tree = index;
+      bufMgr->prefetch(file, currentPageNum, READAHEAD_PAGES, NORMAL_ACCESS,
+                       [tree](PageId pageNo, const Page &page) {
+                         return tree->rightSibling(pageNo, page);
+                       });
     }
   }
+  return reinterpret_cast<LeafNode<T> *>(this->currentPageData);
+}
+
+template <class T>
+void IndexCursor::rememberLast(const LeafNode<T> *current) {
+  lowVal<T>() = keyAt(current, nextEntry - 1);
+  lastRid = ridAt(current, nextEntry - 1);
+  hasLast = true;
 }
 
 /**
@@ -515,62 +2595,162 @@ void BTreeIndex::startScan(const void *lowValParm, const Operator lowOpParm,
  * @throws IndexScanCompletedException If no more records, satisfying the scan
  *criteria, are left to be scanned.
  **/
-void BTreeIndex::scanNext(RecordId &outRid) {
+void IndexCursor::scanNext(RecordId &outRid, void *outPayload) {
   if (!scanExecuting) {  // not started
     throw ScanNotInitializedException();
   }
-  LeafNodeInt *current = reinterpret_cast<LeafNodeInt *>(this->currentPageData);
-  if (current->ridArray[nextEntry].page_number == 0 ||
-      nextEntry == this->leafOccupancy - 1) {
-    // Unpin page and read papge
-    bufMgr->unPinPage(file, currentPageNum, false);
-    // No more next leaf
+  SharedLatchGuard treeGuard(index->treeLatch);
+  switch (index->attributeType) {
+    case INTEGER:
+      scanNextKey<int>(outRid, outPayload);
+      break;
+    case DOUBLE:
+      scanNextKey<double>(outRid, outPayload);
+      break;
+    case STRING:
+    case COMPOSITE:
+      scanNextKey<StringKey>(outRid, outPayload);
+      break;
+  }
+}
+
+template <class T>
+void IndexCursor::scanNextKey(RecordId &outRid, void *outPayload) {
+  LeafNode<T> *current = reposition<T>();
+  while (nextEntry == current->numKeys) {
+    // No more next leaf, endScan() unpins the last one
     if (current->rightSibPageNo == 0) {
+      index->nodeLatches.unlockShared(currentPageNum);
       throw IndexScanCompletedException();
     }
-
     // go to next leaf
-    this->currentPageNum = current->rightSibPageNo;
-    bufMgr->readPage(this->file, this->currentPageNum, this->currentPageData);
-
-    // get current page
-    current = reinterpret_cast<LeafNodeInt *>(this->currentPageData);
+    current = moveRight(current);
     nextEntry = 0;
   }
 
-  if ((lowOp == GT && highOp == LT &&
-       current->keyArray[nextEntry] > lowValInt &&
-       current->keyArray[nextEntry] < highValInt) ||
-      (lowOp == GTE && highOp == LT &&
-       current->keyArray[nextEntry] >= lowValInt &&
-       current->keyArray[nextEntry] < highValInt) ||
-      (lowOp == GT && highOp == LTE &&
-       current->keyArray[nextEntry] > lowValInt &&
-       current->keyArray[nextEntry] <= highValInt) ||
-      (lowOp == GTE && highOp == LTE &&
-       current->keyArray[nextEntry] >= lowValInt &&
-       current->keyArray[nextEntry] <= highValInt)) {
-    outRid = current->ridArray[nextEntry];
+  // entries are sorted and the scan started at the low bound, so only the
+  // high bound is left to check
+  int c = compareAt(current, nextEntry, highVal<T>());
+  bool inRange = (highOp == LT && c < 0) || (highOp == LTE && c <= 0);
+  if (inRange) {
+    outRid = ridAt(current, nextEntry);
+    if (outPayload != nullptr) {
+      copyPayloads(current, nextEntry, 1, (char *)outPayload);
+    }
     nextEntry++;
-  } else {
+    rememberLast(current);
+  }
+  index->nodeLatches.unlockShared(currentPageNum);
+  if (!inRange) {
     throw IndexScanCompletedException();
   }
 }
+/**
+ * Fetch the record ids of the next index entries that match the scan.
+ * Copies every remaining qualifying record id of the current leaf, up to
+ *maxRids, in one go, moving on to the right sibling first if the current leaf
+ *has been scanned to its entirety.
+ * @param outRids	Array receiving up to maxRids record ids
+ * @param maxRids	Capacity of outRids, must be greater than zero
+ * @param outPayloads	If not null, receives the included bytes of each entry
+ * @return  Number of record ids copied, zero once the scan is completed.
+ * @throws ScanNotInitializedException If no scan has been initialized.
+ **/
+size_t IndexCursor::scanNextBatch(RecordId *outRids, size_t maxRids,
+                                  void *outPayloads) {
+  if (!scanExecuting) {  // not started
+    throw ScanNotInitializedException();
+  }
+  SharedLatchGuard treeGuard(index->treeLatch);
+  switch (index->attributeType) {
+    case INTEGER:
+      return scanNextBatchKey<int>(outRids, maxRids, outPayloads);
+    case DOUBLE:
+      return scanNextBatchKey<double>(outRids, maxRids, outPayloads);
+    case STRING:
+    case COMPOSITE:
+      return scanNextBatchKey<StringKey>(outRids, maxRids, outPayloads);
+  }
+  return 0;
+}
+
+template <class T>
+size_t IndexCursor::scanNextBatchKey(RecordId *outRids, size_t maxRids,
+                                     void *outPayloads) {
+  LeafNode<T> *current = reposition<T>();
+  while (nextEntry == current->numKeys) {
+    // No more next leaf, endScan() unpins the last one
+    if (current->rightSibPageNo == 0) {
+      index->nodeLatches.unlockShared(currentPageNum);
+      return 0;
+    }
+    current = moveRight(current);
+    nextEntry = 0;
+  }
+
+  // find where the high bound cuts this leaf, usually the whole remaining
+  // leaf qualifies and the last key alone tells
+  int end = current->numKeys;
+  const T &high = highVal<T>();
+  int c = compareAt(current, end - 1, high);
+  if (highOp == LT && c >= 0) {
+    end = std::max(lowerBound(current, high), nextEntry);
+  } else if (highOp == LTE && c > 0) {
+    end = std::max(upperBound(current, high), nextEntry);
+  }
+
+  // once the high bound has been reached this copies nothing, ending the scan
+  size_t count = std::min((size_t)(end - nextEntry), maxRids);
+  copyRids(current, nextEntry, count, outRids);
+  if (outPayloads != nullptr) {
+    copyPayloads(current, nextEntry, count, (char *)outPayloads);
+  }
+  nextEntry += count;
+  if (count > 0) {
+    rememberLast(current);
+  }
+  index->nodeLatches.unlockShared(currentPageNum);
+  return count;
+}
+
 /**
  * Terminate the current scan. Unpin any pinned pages. Reset scan specific
  *variables.
  * @throws ScanNotInitializedException If no scan has been initialized.
  **/
-void BTreeIndex::endScan() {
+void IndexCursor::endScan() {
   if (!scanExecuting) {
     throw ScanNotInitializedException();
   }
 
   currentPageData = nullptr;
-  bufMgr->unPinPage(this->file, this->currentPageNum, false);
+  index->releaseNode(this->currentPageNum);
   this->scanExecuting = false;
 
   this->currentPageNum = -1;
   nextEntry = -1;
 }
+
+// -----------------------------------------------------------------------------
+// BTreeIndex scan, driven by the built-in cursor
+// -----------------------------------------------------------------------------
+
+void BTreeIndex::startScan(const void *lowValParm, const Operator lowOpParm,
+                           const void *highValParm, const Operator highOpParm,
+                           const int numKeyAttrs) {
+  scanCursor.startScan(lowValParm, lowOpParm, highValParm, highOpParm,
+                       numKeyAttrs);
+}
+
+void BTreeIndex::scanNext(RecordId &outRid, void *outPayload) {
+  scanCursor.scanNext(outRid, outPayload);
+}
+
+size_t BTreeIndex::scanNextBatch(RecordId *outRids, size_t maxRids,
+                                 void *outPayloads) {
+  return scanCursor.scanNextBatch(outRids, maxRids, outPayloads);
+}
+
+void BTreeIndex::endScan() { scanCursor.endScan(); }
+
 }  // namespace badgerdb
\ No newline at end of file
@@ -8,12 +8,19 @@
 
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
 #include <iostream>
+#include <memory>
+#include <mutex>
 #include <sstream>
 #include <string>
+#include <vector>
 
 #include "buffer.h"
 #include "file.h"
+#include "latch.h"
 #include "page.h"
 #include "string.h"
 #include "types.h"
@@ -21,9 +28,52 @@
 namespace badgerdb {
 
 /**
- * @brief Datatype enumeration type.
+ * @brief Datatype enumeration type. COMPOSITE is the type of an index over
+ * several attributes and is not a valid type for one attribute.
  */
-enum Datatype { INTEGER = 0, DOUBLE = 1, STRING = 2 };
+enum Datatype { INTEGER = 0, DOUBLE = 1, STRING = 2, COMPOSITE = 3 };
+
+/**
+ * @brief One attribute of the key of an index, in the records of its relation.
+ */
+struct KeyAttribute {
+  /**
+   * Offset of the attribute inside the record.
+   */
+  int byteOffset;
+
+  /**
+   * Type of the attribute, INTEGER, DOUBLE or STRING.
+   */
+  Datatype type;
+};
+
+/**
+ * @brief Maximum number of attributes in the key of a COMPOSITE index.
+ */
+const int MAXKEYATTRS = 8;
+
+/**
+ * @brief Byte range of the records of a relation that a covering index copies
+ * next to each rid in its leaves, so that scans can return it without
+ * fetching the record.
+ */
+struct IncludedColumns {
+  /**
+   * Offset of the first included byte inside the record.
+   */
+  int byteOffset;
+
+  /**
+   * Number of included bytes, 0 for an index that covers no columns.
+   */
+  int length;
+};
+
+/**
+ * @brief Maximum number of included bytes of a covering index.
+ */
+const int MAXINCLUDESIZE = 64;
 
 /**
  * @brief Scan operations enumeration. Passed to BTreeIndex::startScan() method.
@@ -35,21 +85,153 @@ enum Operator {
   GT   /* Greater Than */
 };
 
+/**
+ * @brief Delete policies. Passed to BTreeIndex::deleteEntry() method.
+ */
+enum DeletePolicy {
+  LAZY_DELETE = 0, /* Remove the entry only, leaving nodes underfull */
+  MERGE_DELETE = 1 /* Redistribute or merge underfull nodes with a sibling */
+};
+
 /**
  * @brief Number of key slots in B+Tree leaf for INTEGER key.
  */
-//                                                  sibling ptr             key
-//                                                  rid
-const int INTARRAYLEAFSIZE =
-    (Page::SIZE - sizeof(PageId)) / (sizeof(int) + sizeof(RecordId));
+//                                    numKeys       sibling ptr
+//                                    key           rid
+const int INTARRAYLEAFSIZE = (Page::SIZE - sizeof(int) - sizeof(PageId)) /
+                             (sizeof(int) + sizeof(RecordId));
 
 /**
  * @brief Number of key slots in B+Tree non-leaf for INTEGER key.
  */
-//                                                     level     extra pageNo
-//                                                     key       pageNo
-const int INTARRAYNONLEAFSIZE = (Page::SIZE - sizeof(int) - sizeof(PageId)) /
-                                (sizeof(int) + sizeof(PageId));
+//                                    level, numKeys    extra pageNo
+//                                    key               pageNo
+const int INTARRAYNONLEAFSIZE =
+    (Page::SIZE - 2 * sizeof(int) - sizeof(PageId)) /
+    (sizeof(int) + sizeof(PageId));
+
+/**
+ * @brief Maximum number of bytes of a STRING key. A STRING attribute is indexed
+ * up to its terminating null character or its first STRINGSIZE bytes,
+ * whichever comes first.
+ */
+const int STRINGSIZE = 64;
+
+/**
+ * @brief Number of key slots in B+Tree leaf for DOUBLE key.
+ */
+//                                    numKeys       sibling ptr
+//                                    key           rid
+const int DOUBLEARRAYLEAFSIZE = (Page::SIZE - sizeof(int) - sizeof(PageId)) /
+                                (sizeof(double) + sizeof(RecordId));
+
+/**
+ * @brief Number of key slots in B+Tree non-leaf for DOUBLE key.
+ */
+//                                    level, numKeys    extra pageNo
+//                                    key               pageNo
+const int DOUBLEARRAYNONLEAFSIZE =
+    (Page::SIZE - 2 * sizeof(int) - sizeof(PageId)) /
+    (sizeof(double) + sizeof(PageId));
+
+/**
+ * @brief Number of bytes in a STRING leaf for key suffixes and their slots.
+ */
+//                                    numKeys       sibling ptr
+//                                    payloadLength
+//                                    prefixLength  heapOffset      prefix
+const int STRINGLEAFDATASIZE = Page::SIZE - 2 * sizeof(int) - sizeof(PageId) -
+                               2 * sizeof(std::uint16_t) - STRINGSIZE;
+
+/**
+ * @brief Number of bytes in a STRING non-leaf for key suffixes and their slots.
+ */
+//                                    level, numKeys    first pageNo
+//                                    prefixLength  heapOffset      prefix
+const int STRINGNONLEAFDATASIZE = Page::SIZE - 2 * sizeof(int) -
+                                  sizeof(PageId) - 2 * sizeof(std::uint16_t) -
+                                  STRINGSIZE;
+
+/**
+ * @brief A STRING key: up to STRINGSIZE bytes, ordered like strcmp(). Keys
+ * are kept in this form in memory only, nodes store them prefix compressed.
+ */
+struct StringKey {
+  /**
+   * Number of bytes of the key in use.
+   */
+  int length;
+
+  /**
+   * Bytes of the key, without a terminating null character.
+   */
+  char data[STRINGSIZE];
+
+  int compare(const StringKey& rhs) const {
+    int c = memcmp(data, rhs.data, std::min(length, rhs.length));
+    return c != 0 ? c : length - rhs.length;
+  }
+  bool operator<(const StringKey& rhs) const { return compare(rhs) < 0; }
+  bool operator>(const StringKey& rhs) const { return compare(rhs) > 0; }
+  bool operator<=(const StringKey& rhs) const { return compare(rhs) <= 0; }
+  bool operator>=(const StringKey& rhs) const { return compare(rhs) >= 0; }
+  bool operator==(const StringKey& rhs) const { return compare(rhs) == 0; }
+  bool operator!=(const StringKey& rhs) const { return compare(rhs) != 0; }
+};
+
+/**
+ * @brief Node capacities for a fixed-size key type, so that code templated on
+ * the key type picks the matching ...ARRAYLEAFSIZE and ...ARRAYNONLEAFSIZE.
+ */
+template <class T>
+struct NodeSize;
+
+template <>
+struct NodeSize<int> {
+  static const int LEAF = INTARRAYLEAFSIZE;
+  static const int NONLEAF = INTARRAYNONLEAFSIZE;
+};
+
+template <>
+struct NodeSize<double> {
+  static const int LEAF = DOUBLEARRAYLEAFSIZE;
+  static const int NONLEAF = DOUBLEARRAYNONLEAFSIZE;
+};
+
+/**
+ * @brief Reads a key of type T from memory that need not be aligned, such as
+ * a field of a record or a key passed in by the caller.
+ *
+ * @param src	Pointer to an integer / double / char string
+ * @return  The key.
+ */
+template <class T>
+inline T readKey(const void* src) {
+  T key;
+  memcpy(&key, src, sizeof(T));
+  return key;
+}
+
+template <>
+inline StringKey readKey<StringKey>(const void* src) {
+  StringKey key;
+  key.length = strnlen((const char*)src, STRINGSIZE);
+  memcpy(key.data, src, key.length);
+  return key;
+}
+
+/**
+ * @brief Default fraction of each node filled by the bulk loader. Leaving some
+ * room lets later insertEntry() calls land without splitting right away.
+ */
+const double BULKLOAD_FILL_FACTOR = 0.9;
+
+/**
+ * @brief Maximum number of key-rid pairs the bulk loader sorts in memory. Larger
+ * relations are sorted in runs of this size which are spilled to disk and
+ * merged.
+ */
+const int BULKLOAD_RUN_SIZE = 1 << 20;
 
 /**
  * @brief Structure to store a key-rid pair. It is used to pass the pair to
@@ -67,6 +249,22 @@ class RIDKeyPair {
   }
 };
 
+/**
+ * @brief Key-rid pair of a STRING or COMPOSITE index, which also carries the
+ * included bytes of the record when the index is covering.
+ */
+template <>
+class RIDKeyPair<StringKey> {
+ public:
+  RecordId rid;
+  StringKey key;
+  char payload[MAXINCLUDESIZE];
+  void set(RecordId r, StringKey k) {
+    rid = r;
+    key = k;
+  }
+};
+
 /**
  * @brief Structure to store a key page pair which is used to pass the key and
  * page to functions that make any modifications to the non leaf pages of the
@@ -126,6 +324,27 @@ struct IndexMetaInfo {
    * Page number of root page of the B+ Tree inside the file index file.
    */
   PageId rootPageNo;
+
+  /**
+   * Page number of the first page on the list of freed node pages, 0 if none.
+   */
+  PageId freePageNo;
+
+  /**
+   * Number of attributes in the key when attrType is COMPOSITE.
+   */
+  int numKeyAttrs;
+
+  /**
+   * Attributes of the key, in order of significance, when attrType is
+   * COMPOSITE.
+   */
+  KeyAttribute keyAttrs[MAXKEYATTRS];
+
+  /**
+   * Bytes of the records stored next to each rid in the leaves.
+   */
+  IncludedColumns included;
 };
 
 /*
@@ -134,43 +353,56 @@ page to this struct and use it to access the parts These structures basically
 are the format in which the information is stored in the pages for the index
 file depending on what kind of node they are. The level memeber of each non leaf
 structure seen below is set to 1 if the nodes at this level are just above the
-leaf nodes. Otherwise set to 0.
+leaf nodes. Otherwise set to 0. Keys of a node are kept sorted in the first
+numKeys slots, so positions inside a node are found by binary search.
 */
 
 /**
- * @brief Structure for all non-leaf nodes when the key is of INTEGER type.
+ * @brief Structure for all non-leaf nodes, templated on the type of the key.
  */
-struct NonLeafNodeInt {
+template <class T>
+struct NonLeafNode {
   /**
    * Level of the node in the tree.
    */
   int level;
 
+  /**
+   * Number of keys in use. The node has numKeys + 1 children.
+   */
+  int numKeys;
+
   /**
    * Stores keys.
    */
-  int keyArray[INTARRAYNONLEAFSIZE];
+  T keyArray[NodeSize<T>::NONLEAF];
 
   /**
    * Stores page numbers of child pages which themselves are other non-leaf/leaf
    * nodes in the tree.
    */
-  PageId pageNoArray[INTARRAYNONLEAFSIZE + 1];
+  PageId pageNoArray[NodeSize<T>::NONLEAF + 1];
 };
 
 /**
- * @brief Structure for all leaf nodes when the key is of INTEGER type.
+ * @brief Structure for all leaf nodes, templated on the type of the key.
  */
-struct LeafNodeInt {
+template <class T>
+struct LeafNode {
+  /**
+   * Number of keys (and RecordIds) in use.
+   */
+  int numKeys;
+
   /**
    * Stores keys.
    */
-  int keyArray[INTARRAYLEAFSIZE];
+  T keyArray[NodeSize<T>::LEAF];
 
   /**
    * Stores RecordIds.
    */
-  RecordId ridArray[INTARRAYLEAFSIZE];
+  RecordId ridArray[NodeSize<T>::LEAF];
 
   /**
    * Page number of the leaf on the right side.
@@ -180,58 +412,217 @@ struct LeafNodeInt {
   PageId rightSibPageNo;
 };
 
+/*
+STRING keys are variable length, so STRING nodes are laid out like slotted
+pages instead. All keys of a node share the first prefixLength bytes, which
+are stored once in prefix. Each key keeps only the rest, its suffix, in a heap
+growing down from the end of data, while fixed-size slots pointing at the
+suffixes grow up from its start, sorted by key. The heap is kept free of holes,
+so the free space of a node is the gap between the last slot and heapOffset.
+Separators in non-leaf nodes are cut to the shortest prefix that still
+separates the two children. COMPOSITE indexes use the same nodes, their keys
+being encoded into byte strings that sort like the attribute values. Covering
+indexes are COMPOSITE too: each suffix in the heap of a leaf is followed by
+payloadLength included bytes of the record.
+*/
+
 /**
- * @brief BTreeIndex class. It implements a B+ Tree index on a single attribute
- * of a relation. This index supports only one scan at a time.
+ * @brief Slot of a STRING leaf node.
  */
-class BTreeIndex {
- private:
+struct StringLeafSlot {
   /**
-   * File object for the index file.
+   * Offset of the key suffix in the data of the node.
    */
-  File* file;
+  std::uint16_t offset;
 
   /**
-   * Keep track of initial page before split
+   * Number of bytes of the key suffix.
    */
-  PageId initial;
+  std::uint16_t length;
 
   /**
-   * Buffer Manager Instance.
+   * RecordId of the entry.
    */
-  BufMgr* bufMgr;
+  RecordId rid;
+};
 
+/**
+ * @brief Slot of a STRING non-leaf node.
+ */
+struct StringNonLeafSlot {
   /**
-   * Page number of meta page.
+   * Offset of the key suffix in the data of the node.
    */
-  PageId headerPageNum;
+  std::uint16_t offset;
 
   /**
-   * page number of root page of B+ tree inside index file.
+   * Number of bytes of the key suffix.
    */
-  PageId rootPageNum;
+  std::uint16_t length;
 
   /**
-   * Datatype of attribute over which index is built.
+   * Page number of the child right of the key.
    */
-  Datatype attributeType;
+  PageId pageNo;
+};
+
+/**
+ * @brief Structure for all non-leaf nodes when the key is of STRING type.
+ */
+template <>
+struct NonLeafNode<StringKey> {
+  typedef StringNonLeafSlot Slot;
+
+  static const int DATASIZE = STRINGNONLEAFDATASIZE;
 
   /**
-   * Offset of attribute, over which index is built, inside records.
+   * Level of the node in the tree.
    */
-  int attrByteOffset;
+  int level;
 
   /**
-   * Number of keys in leaf node, depending upon the type of key.
+   * Number of keys in use. The node has numKeys + 1 children.
    */
-  int leafOccupancy;
+  int numKeys;
 
   /**
-   * Number of keys in non-leaf node, depending upon the type of key.
+   * Page number of the leftmost child, the others are kept in the slots.
    */
-  int nodeOccupancy;
+  PageId firstPageNo;
 
-  // MEMBERS SPECIFIC TO SCANNING
+  /**
+   * Number of leading bytes shared by every key of the node.
+   */
+  std::uint16_t prefixLength;
+
+  /**
+   * Offset of the first byte of the suffix heap in data.
+   */
+  std::uint16_t heapOffset;
+
+  /**
+   * Leading bytes shared by every key of the node.
+   */
+  char prefix[STRINGSIZE];
+
+  /**
+   * Slots, followed by free space and the suffix heap.
+   */
+  char data[STRINGNONLEAFDATASIZE];
+};
+
+/**
+ * @brief Structure for all leaf nodes when the key is of STRING type.
+ */
+template <>
+struct LeafNode<StringKey> {
+  typedef StringLeafSlot Slot;
+
+  static const int DATASIZE = STRINGLEAFDATASIZE;
+
+  /**
+   * Number of keys (and RecordIds) in use.
+   */
+  int numKeys;
+
+  /**
+   * Page number of the leaf on the right side.
+   */
+  PageId rightSibPageNo;
+
+  /**
+   * Number of included bytes stored after each key suffix.
+   */
+  int payloadLength;
+
+  /**
+   * Number of leading bytes shared by every key of the node.
+   */
+  std::uint16_t prefixLength;
+
+  /**
+   * Offset of the first byte of the suffix heap in data.
+   */
+  std::uint16_t heapOffset;
+
+  /**
+   * Leading bytes shared by every key of the node.
+   */
+  char prefix[STRINGSIZE];
+
+  /**
+   * Slots, followed by free space and the suffix heap.
+   */
+  char data[STRINGLEAFDATASIZE];
+};
+
+/**
+ * @brief Structure for all non-leaf nodes when the key is of INTEGER type.
+ */
+typedef NonLeafNode<int> NonLeafNodeInt;
+
+/**
+ * @brief Structure for all leaf nodes when the key is of INTEGER type.
+ */
+typedef LeafNode<int> LeafNodeInt;
+
+/**
+ * @brief Structure for all non-leaf nodes when the key is of DOUBLE type.
+ */
+typedef NonLeafNode<double> NonLeafNodeDouble;
+
+/**
+ * @brief Structure for all leaf nodes when the key is of DOUBLE type.
+ */
+typedef LeafNode<double> LeafNodeDouble;
+
+/**
+ * @brief Structure for all non-leaf nodes when the key is of STRING type.
+ */
+typedef NonLeafNode<StringKey> NonLeafNodeString;
+
+/**
+ * @brief Structure for all leaf nodes when the key is of STRING type.
+ */
+typedef LeafNode<StringKey> LeafNodeString;
+
+static_assert(sizeof(LeafNodeInt) <= Page::SIZE &&
+                  sizeof(NonLeafNodeInt) <= Page::SIZE &&
+                  sizeof(LeafNodeDouble) <= Page::SIZE &&
+                  sizeof(NonLeafNodeDouble) <= Page::SIZE &&
+                  sizeof(LeafNodeString) <= Page::SIZE &&
+                  sizeof(NonLeafNodeString) <= Page::SIZE,
+              "B+ tree nodes must fit in a page");
+
+/**
+ * @brief Structure of a node page that has been freed. Freed pages are chained
+ * from IndexMetaInfo::freePageNo and reused before the file is grown.
+ */
+struct FreeNode {
+  /**
+   * Page number of the next free page, 0 at the end of the list.
+   */
+  PageId nextFreePageNo;
+};
+
+class BTreeIndex;
+
+/**
+ * @brief A range scan over a BTreeIndex. Each cursor owns its bounds and the
+ * leaf page it keeps pinned, so any number of cursors can scan one index at the
+ * same time. Cursors must be ended (or destroyed) before their index is.
+ *
+ * A cursor latches its leaf only within each call, so inserts into the leaf
+ * can go ahead between calls. The cursor remembers the last entry it returned
+ * and finds its place again after it, moving right if a split took the entry
+ * to a new sibling.
+ */
+class IndexCursor {
+ private:
+  /**
+   * Index being scanned.
+   */
+  BTreeIndex* index;
 
   /**
    * True if an index scan has been started.
@@ -266,7 +657,7 @@ class BTreeIndex {
   /**
    * Low STRING value for scan.
    */
-  std::string lowValString;
+  StringKey lowValString;
 
   /**
    * High INTEGER value for scan.
@@ -281,7 +672,7 @@ class BTreeIndex {
   /**
    * High STRING value for scan.
    */
-  std::string highValString;
+  StringKey highValString;
 
   /**
    * Low Operator. Can only be GT(>) or GTE(>=).
@@ -294,77 +685,629 @@ class BTreeIndex {
   Operator highOp;
 
   /**
-   * Inserts the pair into a given node that is a leaf node
-   * 
-   * @param node is a given leaf node
-   * @param entryInsertPair is the entry pair to be inserted
+   * True once the scan has returned an entry. The low value then holds the
+   * key of the last entry returned.
    */
-  void insertNodeLeaf(LeafNodeInt* node, RIDKeyPair<int> entryInsertPair);
+  bool hasLast;
 
   /**
-   * Inserts the pair into a given node that is a non leaf node
-   * 
-   * @param node is a given non leaf node
-   * @param entryInsertPair is the entry pair to be inserted
+   * Record id of the last entry returned.
    */
-  void insertNodeNonLeaf(NonLeafNodeInt* node,
-                         PageKeyPair<int>* entryInsertPair);
+  RecordId lastRid;
 
   /**
-   * Recursive helper function to insert an entry into the B+ tree
-   * 
-   * @param entryInsertPair is the entry pair to be inserted for leaf nodes
-   * @param entryPropPair is the entry pair to be inserted for non leaf nodes
-   * @param currPage the current page during the recusive calls
-   * @param currPageNum the current page number during the recusive calls
-   * @param isLeafNode whether inserting for leaf nodes or non leaf nodes
+   * Number of leaves moved to since the scan started, for reading ahead.
    */
-  void insertEntryHelper(RIDKeyPair<int> entryInsertPair,
-                         PageKeyPair<int>*& entryPropPair, Page* currPage,
-                         PageId currPageNum, bool isLeafNode);
+  int leavesRead;
+
+  IndexCursor(const IndexCursor&) = delete;
+  IndexCursor& operator=(const IndexCursor&) = delete;
 
   /**
-   * Splits a leaf node, given that the node is already full.
-   * Inserts the record properly and propagate changes in siblings.
-   * Copy the middle key value to the pushed up page
-   * 
-   * @param oldNode is leaf node to be splitted
-   * @param oldPageID is page id for the old leaf node
-   * @param pushUpPage the page storing the middle record to be pushed up
-   * @param insertRecord is the entry pair to be inserted
+   * Returns the high value of the scan for the given key type.
    */
-  void splitLeafNode(LeafNodeInt* oldNode, PageId oldPageID,
-                     PageKeyPair<int>*& pushUpPage,
-                     RIDKeyPair<int> insertRecord);
+  template <class T>
+  const T& highVal() const;
 
   /**
-   * Splits a non leaf node, given that the node is already full.
-   * Inserts the record properly and propagate changes in siblings.
-   * Copy the middle key value to the pushed up page
-   * 
-   * @param oldNode is non leaf node to be splitted
-   * @param oldPageID is page id for the old non leaf node
-   * @param pushUpPage the page storing the middle record to be pushed up
-   * @param insertRecord is the entry pair to be inserted
+   * Returns the low value of the scan for the given key type.
    */
-  void splitNonLeafNode(NonLeafNodeInt* oldNode, PageId oldPageID,
-                        PageKeyPair<int>*& pushUpPage);
+  template <class T>
+  T& lowVal();
 
   /**
-   * Retrieves the old root node. 
-   * Updates it with the new root node of the B+ tree
-   * 
-   * @param oldRootID is page id for the old root node
-   * @param pushUpPage the page storing the middle record to be pushed up
+   * Latches the current leaf shared and makes sure nextEntry still points
+   * right after the last entry returned, seeking it again if not.
+   *
+   * @return  The current leaf, left latched for the caller.
    */
-  void updateRoot(PageId oldRootID, PageKeyPair<int>* pushUpPage);
+  template <class T>
+  LeafNode<T>* reposition();
 
- public:
+  /**
+   * Points nextEntry right after the last entry returned, or at the first
+   * entry above the low bound if there is none, moving right along the leaves
+   * as needed. The given current leaf is latched shared.
+   *
+   * @return  The current leaf, left latched for the caller.
+   */
+  template <class T>
+  LeafNode<T>* seek(LeafNode<T>* current);
+
+  /**
+   * Moves on to the right sibling of the current leaf, latching it before
+   * letting go of the current one.
+   *
+   * @return  The new current leaf.
+   */
+  template <class T>
+  LeafNode<T>* moveRight(LeafNode<T>* current);
+
+  /**
+   * Records the entry just before nextEntry as the last one returned.
+   */
+  template <class T>
+  void rememberLast(const LeafNode<T>* current);
+
+  /**
+   * Positions the cursor on the first entry not below the low bound, see
+   * startScan(). The bounds have been set already.
+   *
+   * @param lowVal	Low value of range
+   * @param highVal	High value of range
+   */
+  template <class T>
+  void startScanKey(const T& lowVal, const T& highVal);
+
+  /**
+   * scanNext() for the given key type.
+   */
+  template <class T>
+  void scanNextKey(RecordId& outRid, void* outPayload);
+
+  /**
+   * scanNextBatch() for the given key type.
+   */
+  template <class T>
+  size_t scanNextBatchKey(RecordId* outRids, size_t maxRids,
+                          void* outPayloads);
+
+ public:
+  /**
+   * IndexCursor Constructor. The cursor starts out with no scan executing.
+   *
+   * @param indexIn       Index to be scanned.
+   */
+  explicit IndexCursor(BTreeIndex* indexIn);
+
+  /**
+   * IndexCursor Destructor. Ends the scan, if one is executing, unpinning its
+   * leaf. Does not throw.
+   */
+  ~IndexCursor();
+
+  /**
+   * Begin a filtered scan of the index, see BTreeIndex::startScan(). A scan
+   * already executing on this cursor is ended first; other cursors are not
+   * affected.
+   *
+   * @param lowVal	Low value of range, pointer to integer / double / char
+   *string
+   * @param lowOp		Low operator (GT/GTE)
+   * @param highVal	High value of range, pointer to integer / double / char
+   *string
+   * @param highOp	High operator (LT/LTE)
+   * @param numKeyAttrs	For a COMPOSITE index, the number of leading key
+   *attributes the bounds compare on, 0 for all of them. The scan seeks straight
+   *to the first entry of the range.
+   * @throws  BadOpcodesException If lowOp and highOp do not contain one of
+   *their their expected values
+   * @throws  BadScanrangeException If lowVal > highval
+   * @throws  NoSuchKeyFoundException If there is no key in the B+ tree that
+   *satisfies the scan criteria.
+   **/
+  void startScan(const void* lowVal, const Operator lowOp, const void* highVal,
+                 const Operator highOp, const int numKeyAttrs = 0);
+
+  /**
+   * Fetch the record id of the next index entry that matches the scan, see
+   * BTreeIndex::scanNext().
+   *
+   * @param outRid	RecordId of next record found that satisfies the scan
+   *criteria returned in this
+   * @param outPayload	If not null, receives the included bytes of the entry
+   * @throws ScanNotInitializedException If no scan has been initialized.
+   * @throws IndexScanCompletedException If no more records, satisfying the scan
+   *criteria, are left to be scanned.
+   **/
+  void scanNext(RecordId& outRid, void* outPayload = nullptr);
+
+  /**
+   * Fetch the record ids of the next index entries that match the scan, see
+   * BTreeIndex::scanNextBatch().
+   *
+   * @param outRids	Array receiving up to maxRids record ids
+   * @param maxRids	Capacity of outRids, must be greater than zero
+   * @param outPayloads	If not null, receives the included bytes of each entry
+   *one after the other
+   * @return  Number of record ids copied, zero once the scan is completed.
+   * @throws ScanNotInitializedException If no scan has been initialized.
+   **/
+  size_t scanNextBatch(RecordId* outRids, size_t maxRids,
+                       void* outPayloads = nullptr);
+
+  /**
+   * Terminate the scan. Unpin any pinned pages. Reset scan specific variables.
+   * @throws ScanNotInitializedException If no scan has been initialized.
+   **/
+  void endScan();
+
+  /**
+   * Returns true if a scan has been started and not ended yet.
+   */
+  bool isScanExecuting() const { return scanExecuting; }
+};
+
+/**
+ * @brief BTreeIndex class. It implements a B+ Tree index on a single attribute
+ * of a relation. Any number of scans can run at once through IndexCursor
+ * objects; startScan(), scanNext() and endScan() drive one built-in cursor.
+ * The public methods take keys as untyped pointers and dispatch on the
+ * attribute type to the helpers templated on the key type (int, double or
+ * StringKey), which work on the matching LeafNode and NonLeafNode layout.
+ *
+ * Lookups, scans, inserts and lazy deletes may run in any number of threads at
+ * once. They descend by latch crabbing: each node is latched before the latch
+ * on its parent is let go of. Readers latch shared all the way down; an insert
+ * first does the same but latches the leaf exclusively, and only if the leaf
+ * has to split descends again with exclusive latches, letting go of all those
+ * above each node that cannot split. Merging deletes and compaction hold the
+ * whole tree exclusively.
+ */
+class BTreeIndex {
+  friend class IndexCursor;
+
+ private:
+  /**
+   * File object for the index file.
+   */
+  BlobFile* file;
+
+  /**
+   * True once the index file has been mapped read only by mapReadOnly().
+   * Nodes are then used where they lie in the mapping, not in the buffer pool.
+   */
+  std::atomic<bool> mapped;
+
+  /**
+   * Keep track of initial page before split
+   */
+  PageId initial;
+
+  /**
+   * Buffer Manager Instance.
+   */
+  BufMgr* bufMgr;
+
+  /**
+   * Page number of meta page.
+   */
+  PageId headerPageNum;
+
+  /**
+   * page number of root page of B+ tree inside index file.
+   */
+  std::atomic<PageId> rootPageNum;
+
+  /**
+   * Held shared by every operation, and exclusively by those that restructure
+   * the tree without latching its nodes: merging deletes and compaction.
+   */
+  RWLatch treeLatch;
+
+  /**
+   * Protects rootPageNum while a descent gets hold of the root. Held
+   * exclusively by an insert that may split the root.
+   */
+  RWLatch rootLatch;
+
+  /**
+   * Protects the meta page, whose free list splits in different subtrees
+   * use at the same time.
+   */
+  std::mutex metaLatch;
+
+  /**
+   * Number of stripes the node latches are spread over
+   */
+  static const std::size_t NODE_LATCH_STRIPES = 1024;
+
+  /**
+   * Latches of the node pages, by page number.
+   */
+  LatchTable nodeLatches;
+
+  /**
+   * Datatype of attribute over which index is built.
+   */
+  Datatype attributeType;
+
+  /**
+   * Offset of attribute, over which index is built, inside records.
+   */
+  int attrByteOffset;
+
+  /**
+   * Attributes of the key, in order of significance, if attributeType is
+   * COMPOSITE.
+   */
+  std::vector<KeyAttribute> keyAttrs;
+
+  /**
+   * Bytes of the records stored next to each rid in the leaves.
+   */
+  IncludedColumns included;
+
+  /**
+   * Number of keys in leaf node, depending upon the type of key.
+   */
+  int leafOccupancy;
+
+  /**
+   * Number of keys in non-leaf node, depending upon the type of key.
+   */
+  int nodeOccupancy;
+
+  // MEMBERS SPECIFIC TO SCANNING
+
+  /**
+   * Cursor driven by startScan(), scanNext() and endScan().
+   */
+  IndexCursor scanCursor;
+
+  /**
+   * Encodes the first numAttrs key attributes of a record into a key of a
+   * COMPOSITE index. The bytes of the key compare like the attribute values,
+   * attribute by attribute: integers and doubles are stored big-endian with
+   * their sign flipped, strings up to their terminating null character and
+   * followed by one. Keys longer than STRINGSIZE bytes are cut short.
+   *
+   * @param record is the record, or a buffer laid out like one
+   * @param numAttrs is the number of leading key attributes to encode
+   * @return  The key.
+   */
+  StringKey compositeKey(const void* record, int numAttrs) const;
+
+  /**
+   * Encodes a key passed in by the caller into a key of a COMPOSITE index.
+   * The key of an index with a single key attribute, which is COMPOSITE when
+   * it covers columns, is a pointer to the attribute value; other keys are
+   * laid out like records, see compositeKey().
+   *
+   * @param key is the key passed in by the caller
+   * @param numAttrs is the number of leading key attributes to encode
+   * @return  The key.
+   */
+  StringKey encodeKey(const void* key, int numAttrs) const;
+
+  /**
+   * Returns the key of the index in a record of the base relation.
+   *
+   * @param record is the record
+   */
+  template <class T>
+  T recordKey(const char* record) const;
+
+  /**
+   * Inserts the pair into a given node that is a leaf node
+   * 
+   * @param node is a given leaf node
+   * @param entryInsertPair is the entry pair to be inserted
+   */
+  template <class T>
+  void insertNodeLeaf(LeafNode<T>* node, const RIDKeyPair<T>& entryInsertPair);
+
+  /**
+   * Inserts the pair into a given node that is a non leaf node
+   * 
+   * @param node is a given non leaf node
+   * @param childIndex is the position of the child the page was split from
+   * @param entryInsertPair is the entry pair to be inserted
+   */
+  template <class T>
+  void insertNodeNonLeaf(NonLeafNode<T>* node, int childIndex,
+                         const PageKeyPair<T>& entryInsertPair);
+
+  /**
+   * Gets hold of a node for reading, from the mapping if the index is mapped
+   * and pinned in the buffer pool otherwise.
+   *
+   * @param pageNo is the page number of the node
+   * @param page is set to the node
+   */
+  void readNode(PageId pageNo, Page*& page);
+
+  /**
+   * Lets go of a node got hold of by readNode() and left unchanged.
+   *
+   * @param pageNo is the page number of the node
+   */
+  void releaseNode(PageId pageNo);
+
+  /**
+   * Throws IndexReadOnlyException if the index is mapped read only.
+   */
+  void checkWritable() const;
+
+  /**
+   * Lets go of an exclusive latch an insert holds.
+   *
+   * @param pageNo is the page number of the node, or Page::INVALID_NUMBER for
+   * rootLatch
+   */
+  void releaseLatch(PageId pageNo);
+
+  /**
+   * Lets go of the exclusive latches an insert holds.
+   *
+   * @param latched the page numbers of the nodes latched, as for
+   * releaseLatch(), emptied
+   */
+  void releaseLatches(std::vector<PageId>& latched);
+
+  /**
+   * Returns the right sibling of a leaf, for the prefetcher of the buffer
+   * manager to follow the leaves ahead of a scan. Latches the tree and the
+   * leaf shared meanwhile, but never waits for them: a scan holding them may
+   * be waiting for a page the prefetcher is reading, so the chain ends
+   * instead.
+   *
+   * @param pageNo is the page number of the leaf
+   * @param page is the leaf, pinned in the buffer pool
+   * @return the page number of the right sibling, 0 for the last leaf or if
+   * a latch is not free
+   */
+  PageId rightSibling(PageId pageNo, const Page& page);
+
+  /**
+   * Recursive helper function to insert an entry into the B+ tree
+   * 
+   * @param entryInsertPair is the entry pair to be inserted for leaf nodes
+   * @param entryPropPair receives the entry pair to be inserted in the parent
+   * when the current node is split
+   * @param currPage the current page during the recusive calls
+   * @param currPageNum the current page number during the recusive calls
+   * @param isLeafNode whether inserting for leaf nodes or non leaf nodes
+   * @param latched the exclusive latches held, as for releaseLatches(),
+   * ending with the one of the current node unless it has been let go of
+   * already. The latch of each child
+   * is added on the way down, after letting go of all the others if the child
+   * cannot split.
+   * @return true if the current node was split and entryPropPair is set
+   */
+  template <class T>
+  bool insertEntryHelper(const RIDKeyPair<T>& entryInsertPair,
+                         PageKeyPair<T>& entryPropPair, Page* currPage,
+                         PageId currPageNum, bool isLeafNode,
+                         std::vector<PageId>& latched);
+
+  /**
+   * insertEntry() for the given key type.
+   *
+   * @param key is the key to insert
+   * @param rid is the record id of the entry
+   * @param payload is the included bytes of the entry, or null
+   */
+  template <class T>
+  void insertKey(const T& key, const RecordId& rid, const char* payload);
+
+  /**
+   * Splits a leaf node, given that the node is already full.
+   * Inserts the record properly and propagate changes in siblings.
+   * Copy the middle key value to the pushed up page
+   * 
+   * @param oldNode is leaf node to be splitted
+   * @param oldPageID is page id for the old leaf node
+   * @param pushUpPage receives the middle record to be pushed up
+   * @param insertRecord is the entry pair to be inserted
+   */
+  template <class T>
+  void splitLeafNode(LeafNode<T>* oldNode, PageId oldPageID,
+                     PageKeyPair<T>& pushUpPage,
+                     const RIDKeyPair<T>& insertRecord);
+
+  /**
+   * Splits a non leaf node, given that the node is already full.
+   * Inserts the record properly and propagate changes in siblings.
+   * Move the middle key value to the pushed up page
+   * 
+   * @param oldNode is non leaf node to be splitted
+   * @param oldPageID is page id for the old non leaf node
+   * @param childIndex is the position of the child the page was split from
+   * @param pushUpPage holds the entry pair to be inserted, and receives the
+   * middle record to be pushed up
+   */
+  template <class T>
+  void splitNonLeafNode(NonLeafNode<T>* oldNode, PageId oldPageID,
+                        int childIndex, PageKeyPair<T>& pushUpPage);
+
+  /**
+   * Retrieves the old root node. 
+   * Updates it with the new root node of the B+ tree
+   * 
+   * @param oldRootID is page id for the old root node
+   * @param pushUpPage the page storing the middle record to be pushed up
+   */
+  template <class T>
+  void updateRoot(PageId oldRootID, const PageKeyPair<T>& pushUpPage);
+
+  /**
+   * Descends from the root to the leftmost leaf that may hold the given key by
+   * latch crabbing.
+   *
+   * @param key is the key to search for
+   * @param leafPageNum receives the page number of the leaf
+   * @param leafPage receives the leaf page, left pinned and latched for the
+   * caller
+   * @param exclusive whether to latch the leaf exclusively rather than shared
+   * @param upper whether to descend to the rightmost leaf that may hold the
+   * key instead, where an insert puts it
+   */
+  template <class T>
+  void findLeaf(const T& key, PageId& leafPageNum, Page*& leafPage,
+                bool exclusive = false, bool upper = false);
+
+  /**
+   * lookup() for the given key type.
+   *
+   * @param key is the key to look up
+   * @param outRids receives the record ids of the matching entries
+   * @return true if at least one entry matched
+   */
+  template <class T>
+  bool lookupKey(const T& key, std::vector<RecordId>& outRids);
+
+  /**
+   * contains() for the given key type.
+   *
+   * @param key is the key to look up
+   * @return true if the key is present
+   */
+  template <class T>
+  bool containsKey(const T& key);
+
+  /**
+   * Allocates a page for a new node, reusing the head of the free list if
+   * there is one.
+   *
+   * @param pageNo receives the page number of the node
+   * @param page receives the page, left pinned for the caller
+   */
+  void allocNodePage(PageId& pageNo, Page*& page);
+
+  /**
+   * Pushes a node page onto the free list and unpins it.
+   *
+   * @param pageNo is the page number of the node
+   * @param page is the pinned page of the node
+   */
+  void freeNodePage(PageId pageNo, Page* page);
+
+  /**
+   * deleteEntry() for the given key type.
+   *
+   * @param key is the key of the entry
+   * @param rid is the record id of the entry
+   * @param policy is how to treat nodes left underfull
+   * @return true if the entry was found and deleted
+   */
+  template <class T>
+  bool deleteKey(const T& key, const RecordId& rid, DeletePolicy policy);
+
+  /**
+   * Removes the pair <key,rid> from a leaf node if it is there.
+   *
+   * @param node is a given leaf node
+   * @param key is the key of the entry
+   * @param rid is the record id of the entry
+   * @return true if the entry was found and removed
+   */
+  template <class T>
+  bool removeFromLeaf(LeafNode<T>* node, const T& key, const RecordId& rid);
+
+  /**
+   * Recursive function to delete the pair <key,rid> below the given node,
+   * rebalancing the children left underfull on the way back up. Unpins the
+   * given page before returning.
+   *
+   * @param key is the key of the entry
+   * @param rid is the record id of the entry
+   * @param currPage is the current page, pinned
+   * @param currPageNum is the page number of the current page
+   * @param isLeafNode true if the current page is a leaf node
+   * @param found is set to true once the entry has been removed
+   * @return true if the current node is left underfull
+   */
+  template <class T>
+  bool deleteEntryHelper(const T& key, const RecordId& rid, Page* currPage,
+                         PageId currPageNum, bool isLeafNode, bool& found);
+
+  /**
+   * Refills an underfull child from its left sibling (or its right one for the
+   * first child), merging the two nodes if they fit in one.
+   *
+   * @param parent is the parent node, pinned by the caller
+   * @param childIndex is the position of the underfull child in the parent
+   * @param isLeafChild true if the children of the parent are leaf nodes
+   */
+  template <class T>
+  void rebalanceChild(NonLeafNode<T>* parent, int childIndex,
+                      bool isLeafChild);
+
+  /**
+   * compact() for the given key type.
+   *
+   * @param fillFactor is the fraction of each node to fill
+   */
+  template <class T>
+  void compactTree(double fillFactor);
+
+  /**
+   * Builds the tree bottom-up from every tuple of the base relation.
+   * Key-rid pairs are extracted with FileScan and sorted (in runs spilled to
+   * disk if there are more than BULKLOAD_RUN_SIZE of them), then packed into
+   * leaves left to right and finally the non-leaf levels are built on top.
+   *
+   * @param relationName is the name of the base relation
+   * @param indexName is the name of the index file, used to name sort runs
+   * @param fillFactor is the fraction of each node to fill
+   */
+  template <class T>
+  void bulkLoad(const std::string& relationName, const std::string& indexName,
+                double fillFactor);
+
+  /**
+   * Builds the leaves and the non-leaf levels on top of them from a sorted
+   * stream of pairs, and records the new root in the meta page.
+   *
+   * @param nextPair returns the next pair of the sorted stream, false at end
+   * @param fillFactor is the fraction of each node to fill
+   */
+  template <class T, class NextPair>
+  void bulkLoadTree(NextPair nextPair, double fillFactor);
+
+  /**
+   * Packs a sorted stream of pairs into leaves, starting at the root leaf,
+   * and returns the separator before and page number of every leaf built.
+   * The last leaf is evened out with the one before it.
+   *
+   * @param nextPair returns the next pair of the sorted stream, false at end
+   * @param fillFactor is the fraction of each leaf to fill
+   * @param leaves receives one entry per leaf, in key order
+   */
+  template <class T, class NextPair>
+  void bulkLoadLeaves(NextPair nextPair, double fillFactor,
+                      std::vector<PageKeyPair<T>>& leaves);
+
+  /**
+   * Builds one non-leaf level over the given children.
+   *
+   * @param children is the separator before and page number of every child
+   * @param level is the level to store in the new nodes
+   * @param fillFactor is the fraction of each node to fill
+   * @param parents receives one entry per node built, in key order
+   */
+  template <class T>
+  void bulkLoadNonLeafLevel(const std::vector<PageKeyPair<T>>& children,
+                            int level, double fillFactor,
+                            std::vector<PageKeyPair<T>>& parents);
+
+ public:
   /**
    * BTreeIndex Constructor.
    * Check to see if the corresponding index file exists. If so, open the file.
-   * If not, create it and insert entries for every tuple in the base relation
-   * using FileScan class.
+   * If not, create it and bulk load entries for every tuple in the base
+   * relation using FileScan class.
    *
    * @param relationName        Name of file.
    * @param outIndexName        Return the name of index file.
@@ -374,6 +1317,8 @@ class BTreeIndex {
    * index is to be built, in the record
    * @param attrType						Datatype of attribute over
    * which index is built
+   * @param fillFactor        Fraction of each node filled when the index is
+   * built, clamped to (0, 1]
    * @throws  BadIndexInfoException     If the index file already exists for the
    * corresponding attribute, but values in metapage(relationName, attribute
    * byte offset, attribute type etc.) do not match with values received through
@@ -381,7 +1326,53 @@ class BTreeIndex {
    */
   BTreeIndex(const std::string& relationName, std::string& outIndexName,
              BufMgr* bufMgrIn, const int attrByteOffset,
-             const Datatype attrType);
+             const Datatype attrType,
+             const double fillFactor = BULKLOAD_FILL_FACTOR);
+
+  /**
+   * BTreeIndex Constructor for a key over several attributes, compared in
+   * the order given. With more than one attribute the index is COMPOSITE,
+   * and its keys are passed to the other methods as pointers to a buffer laid
+   * out like a record, holding the key attributes at their byte offsets. The
+   * index file is named after the relation and every attribute offset.
+   *
+   * @param relationName        Name of file.
+   * @param outIndexName        Return the name of index file.
+   * @param bufMgrIn            Buffer Manager Instance
+   * @param keyAttrs            Offset and type of each attribute of the key,
+   * at most MAXKEYATTRS of them
+   * @param fillFactor        Fraction of each node filled when the index is
+   * built, clamped to (0, 1]
+   * @throws  BadIndexInfoException     If the index file already exists but
+   * the values in its metapage do not match the parameters.
+   */
+  BTreeIndex(const std::string& relationName, std::string& outIndexName,
+             BufMgr* bufMgrIn, const std::vector<KeyAttribute>& keyAttrs,
+             const double fillFactor = BULKLOAD_FILL_FACTOR);
+
+  /**
+   * BTreeIndex Constructor for a covering index, which stores the given byte
+   * range of each record next to its rid so that scans can return it without
+   * fetching the record. A covering index is COMPOSITE even over a single
+   * key attribute, whose keys are then passed like for the attribute type.
+   * The index file name lists the included range after the key offsets.
+   *
+   * @param relationName        Name of file.
+   * @param outIndexName        Return the name of index file.
+   * @param bufMgrIn            Buffer Manager Instance
+   * @param keyAttrs            Offset and type of each attribute of the key,
+   * at most MAXKEYATTRS of them
+   * @param included            Bytes of the records to store in the leaves, at
+   * most MAXINCLUDESIZE of them
+   * @param fillFactor        Fraction of each node filled when the index is
+   * built, clamped to (0, 1]
+   * @throws  BadIndexInfoException     If the index file already exists but
+   * the values in its metapage do not match the parameters.
+   */
+  BTreeIndex(const std::string& relationName, std::string& outIndexName,
+             BufMgr* bufMgrIn, const std::vector<KeyAttribute>& keyAttrs,
+             const IncludedColumns& included,
+             const double fillFactor = BULKLOAD_FILL_FACTOR);
 
   /**
    * BTreeIndex Destructor.
@@ -399,19 +1390,97 @@ class BTreeIndex {
    *addition of new leaf page number entry into the parent non-leaf, which may
    *in-turn get split. This may continue all the way upto the root causing the
    *root to get split. If root gets split, metapage needs to be changed
-   *accordingly. Make sure to unpin pages as soon as you can.
+   *accordingly. Make sure to unpin pages as soon as you can. Inserts may run
+   *alongside each other, lookups and scans; see the class comment.
    * @param key			Key to insert, pointer to integer/double/char
    *string
    * @param rid			Record ID of a record whose entry is getting
    *inserted into the index.
+   * @param payload	Included bytes of the record for a covering index, zeros
+   *are stored if null
+   * @throws  IndexReadOnlyException If the index is mapped read only
+   **/
+  void insertEntry(const void* key, const RecordId rid,
+                   const void* payload = nullptr);
+
+  /**
+   * Delete the entry with the pair <value,rid>.
+   * With LAZY_DELETE the entry is just removed from its leaf. With
+   *MERGE_DELETE a node left less than half full borrows entries from a sibling
+   *or is merged into it; merges may propagate up to the root, which collapses
+   *onto its only child. Pages released by merges are kept on a free list in the
+   *index file and reused by later splits. Lazy deletes may run alongside other
+   *operations like inserts do. A merging delete waits for every other operation
+   *on the index to finish, and no scan may be executing on the index meanwhile.
+   * @param key			Key to delete, pointer to integer/double/char
+   *string
+   * @param rid			Record ID of the entry to delete
+   * @param policy	How to treat nodes left underfull
+   * @return  True if the entry was found and deleted.
+   * @throws  IndexReadOnlyException If the index is mapped read only
+   **/
+  bool deleteEntry(const void* key, const RecordId rid,
+                   const DeletePolicy policy = MERGE_DELETE);
+
+  /**
+   * Rebuild the tree bottom-up from its live entries, packing every node to
+   *the given fill factor. Useful after many lazy deletes. All pages of the old
+   *tree go to the free list and the new tree is built from it. Waits for every
+   *other operation on the index to finish, and no scan may be executing on the
+   *index while it is compacted.
+   * @param fillFactor	Fraction of each node to fill, clamped to (0, 1]
+   * @throws  IndexReadOnlyException If the index is mapped read only
    **/
-  void insertEntry(const void* key, const RecordId rid);
+  void compact(const double fillFactor = BULKLOAD_FILL_FACTOR);
+
+  /**
+   * Find every entry whose key equals the given key with a single descent
+   * from the root. Does not touch the state of the current scan, leaves no
+   * page pinned and reports a missing key through the return value rather
+   * than an exception.
+   *
+   * @param key			Key to look up, pointer to integer/double/char
+   *string
+   * @param outRids	RecordIds of the matching entries are appended to this
+   * @return  True if at least one entry matched.
+   **/
+  bool lookup(const void* key, std::vector<RecordId>& outRids);
+
+  /**
+   * Check whether any entry has the given key. Like lookup(), this neither
+   * throws on a miss nor touches the state of the current scan.
+   *
+   * @param key			Key to look up, pointer to integer/double/char
+   *string
+   * @return  True if the key is present in the index.
+   **/
+  bool contains(const void* key);
+
+  /**
+   * Switch the index to read only, mapping its file into memory. Lookups and
+   *scans then use the nodes where they lie in the mapping, with no buffer pool
+   *frame to pin, and scans advise the kernel to read the leaves ahead of them.
+   *Meant for indexes that are read much and fit in memory. The pages of the
+   *index are written out and dropped from the buffer pool first. Inserts,
+   *deletes and compaction throw from then on. Waits for every other operation
+   *on the index to finish, and no scan may be executing on the index
+   *meanwhile. Does nothing if the index is read only already.
+   * @throws  PagePinnedException If a page of the index is still pinned
+   * @throws  FileIOException If the file cannot be mapped
+   **/
+  void mapReadOnly();
+
+  /**
+   * Returns true if mapReadOnly() has been called.
+   **/
+  bool isReadOnly() const { return mapped; }
 
   /**
    * Begin a filtered scan of the index.  For instance, if the method is called
    * using ("a",GT,"d",LTE) then we should seek all entries with a value
    * greater than "a" and less than or equal to "d".
-   * If another scan is already executing, that needs to be ended here.
+   * If another scan is already executing, that needs to be ended here. Scans
+   * running on other IndexCursor objects are not affected.
    * Set up all the variables for scan. Start from root to find out the leaf
    *page that contains the first RecordID that satisfies the scan parameters.
    *Keep that page pinned in the buffer pool.
@@ -421,6 +1490,9 @@ class BTreeIndex {
    * @param highVal	High value of range, pointer to integer / double / char
    *string
    * @param highOp	High operator (LT/LTE)
+   * @param numKeyAttrs	For a COMPOSITE index, the number of leading key
+   *attributes the bounds compare on, 0 for all of them. The scan seeks straight
+   *to the first entry of the range.
    * @throws  BadOpcodesException If lowOp and highOp do not contain one of
    *their their expected values
    * @throws  BadScanrangeException If lowVal > highval
@@ -428,7 +1500,7 @@ class BTreeIndex {
    *satisfies the scan criteria.
    **/
   void startScan(const void* lowVal, const Operator lowOp, const void* highVal,
-                 const Operator highOp);
+                 const Operator highOp, const int numKeyAttrs = 0);
 
   /**
    * Fetch the record id of the next index entry that matches the scan.
@@ -438,11 +1510,31 @@ class BTreeIndex {
    *that are no longer required.
    * @param outRid	RecordId of next record found that satisfies the scan
    *criteria returned in this
+   * @param outPayload	If not null, receives the included bytes of the entry,
+   *which saves fetching the record for a covered query
    * @throws ScanNotInitializedException If no scan has been initialized.
    * @throws IndexScanCompletedException If no more records, satisfying the scan
    *criteria, are left to be scanned.
    **/
-  void scanNext(RecordId& outRid);  // returned record id
+  void scanNext(RecordId& outRid,
+                void* outPayload = nullptr);  // returned record id
+
+  /**
+   * Fetch the record ids of the next index entries that match the scan.
+   * Copies every remaining qualifying record id of the current leaf, up to
+   *maxRids, in one go; the high bound is checked once per call rather than
+   *once per entry. Moves on to the right sibling when the current leaf has
+   *been scanned to its entirety. The end of the scan is reported by returning
+   *zero instead of throwing, and the scan must still be ended with endScan().
+   * @param outRids	Array receiving up to maxRids record ids
+   * @param maxRids	Capacity of outRids, must be greater than zero
+   * @param outPayloads	If not null, receives the included bytes of each entry
+   *one after the other, room for maxRids of them
+   * @return  Number of record ids copied, zero once the scan is completed.
+   * @throws ScanNotInitializedException If no scan has been initialized.
+   **/
+  size_t scanNextBatch(RecordId* outRids, size_t maxRids,
+                       void* outPayloads = nullptr);
 
   /**
    * Terminate the current scan. Unpin any pinned pages. Reset scan specific
@@ -14,93 +14,137 @@
 #include "buffer.h"
 #include "exceptions/hash_already_present_exception.h"
 #include "exceptions/hash_not_found_exception.h"
-#include "exceptions/hash_table_exception.h"
 
 namespace badgerdb {
 
-int BufHashTbl::hash(const File* file, const PageId pageNo) {
-  int tmp, value;
-  tmp = (long)file;  // cast of pointer to the file object to an integer
-  value = (tmp + pageNo) % HTSIZE;
+std::uint64_t BufHashTbl::hash(const File* file, const PageId pageNo) {
+  // finalizer of MurmurHash3 over the file address and page number, pages of
+  // different files spread out like pages of one file
+  std::uint64_t value = reinterpret_cast<std::uintptr_t>(file) ^
+                        (std::uint64_t(pageNo) * 0x9e3779b97f4a7c15ULL);
+  value ^= value >> 33;
+  value *= 0xff51afd7ed558ccdULL;
+  value ^= value >> 33;
+  value *= 0xc4ceb9fe1a85ec53ULL;
+  value ^= value >> 33;
   return value;
 }
 
-BufHashTbl::BufHashTbl(int htSize) : HTSIZE(htSize) {
-  // allocate an array of pointers to hashBuckets
-  ht = new hashBucket*[htSize];
-  for (int i = 0; i < HTSIZE; i++) ht[i] = NULL;
+BufHashTbl::Partition& BufHashTbl::partitionOf(const File* file,
+                                               const PageId pageNo,
+                                               int& bucket) {
+  std::uint64_t value = hash(file, pageNo);
+  Partition& part = partitions[value % NUMPARTITIONS];
+  bucket = (value / NUMPARTITIONS) & (part.size - 1);
+  return part;
+}
+
+BufHashTbl::BufHashTbl(const int numEntries) {
+  // room for twice the share of each partition keeps it at most half full
+  int size = 8;
+  while (size < 2 * numEntries / NUMPARTITIONS) size *= 2;
+  for (int i = 0; i < NUMPARTITIONS; i++) {
+    partitions[i].buckets = new hashBucket[size]();
+    partitions[i].size = size;
+    partitions[i].count = 0;
+  }
 }
 
 BufHashTbl::~BufHashTbl() {
-  for (int i = 0; i < HTSIZE; i++) {
-    hashBucket* tmpBuf = ht[i];
-    while (ht[i]) {
-      tmpBuf = ht[i];
-      ht[i] = ht[i]->next;
-      delete tmpBuf;
+  for (int i = 0; i < NUMPARTITIONS; i++) {
+    delete[] partitions[i].buckets;
+  }
+}
+
+void BufHashTbl::grow(Partition& part) {
+  hashBucket* oldBuckets = part.buckets;
+  int oldSize = part.size;
+  part.size *= 2;
+  part.buckets = new hashBucket[part.size]();
+  for (int i = 0; i < oldSize; i++) {
+    if (oldBuckets[i].file) {
+      int bucket;
+      partitionOf(oldBuckets[i].file, oldBuckets[i].pageNo, bucket);
+      while (part.buckets[bucket].file) {
+        bucket = (bucket + 1) & (part.size - 1);
+      }
+      part.buckets[bucket] = oldBuckets[i];
     }
   }
-  delete[] ht;
+  delete[] oldBuckets;
 }
 
 void BufHashTbl::insert(const File* file, const PageId pageNo,
                         const FrameId frameNo) {
-  int index = hash(file, pageNo);
-
-  hashBucket* tmpBuc = ht[index];
-  while (tmpBuc) {
-    if (tmpBuc->file == file && tmpBuc->pageNo == pageNo)
-      throw HashAlreadyPresentException(tmpBuc->file->filename(),
-                                        tmpBuc->pageNo, tmpBuc->frameNo);
-    tmpBuc = tmpBuc->next;
+  int bucket;
+  Partition& part = partitionOf(file, pageNo, bucket);
+  if (4 * (part.count + 1) > 3 * part.size) {
+    grow(part);
+    partitionOf(file, pageNo, bucket);
   }
 
-  tmpBuc = new hashBucket;
-  if (!tmpBuc) throw HashTableException();
+  while (part.buckets[bucket].file) {
+    hashBucket& tmpBuc = part.buckets[bucket];
+    if (tmpBuc.file == file && tmpBuc.pageNo == pageNo)
+      throw HashAlreadyPresentException(tmpBuc.file->filename(),
+                                        tmpBuc.pageNo, tmpBuc.frameNo);
+    bucket = (bucket + 1) & (part.size - 1);
+  }
 
-  tmpBuc->file = (File*)file;
-  tmpBuc->pageNo = pageNo;
-  tmpBuc->frameNo = frameNo;
-  tmpBuc->next = ht[index];
-  ht[index] = tmpBuc;
+  hashBucket& tmpBuc = part.buckets[bucket];
+  tmpBuc.file = (File*)file;
+  tmpBuc.pageNo = pageNo;
+  tmpBuc.frameNo = frameNo;
+  part.count++;
 }
 
-void BufHashTbl::lookup(const File* file, const PageId pageNo,
-                        FrameId& frameNo) {
-  int index = hash(file, pageNo);
-  hashBucket* tmpBuc = ht[index];
-  while (tmpBuc) {
-    if (tmpBuc->file == file && tmpBuc->pageNo == pageNo) {
-      frameNo = tmpBuc->frameNo;  // return frameNo by reference
-      return;
+bool BufHashTbl::tryLookup(const File* file, const PageId pageNo,
+                           FrameId& frameNo) {
+  int bucket;
+  Partition& part = partitionOf(file, pageNo, bucket);
+  while (part.buckets[bucket].file) {
+    const hashBucket& tmpBuc = part.buckets[bucket];
+    if (tmpBuc.file == file && tmpBuc.pageNo == pageNo) {
+      frameNo = tmpBuc.frameNo;  // return frameNo by reference
+      return true;
     }
-    tmpBuc = tmpBuc->next;
+    bucket = (bucket + 1) & (part.size - 1);
   }
+  return false;
+}
 
-  throw HashNotFoundException(file->filename(), pageNo);
+void BufHashTbl::lookup(const File* file, const PageId pageNo,
+                        FrameId& frameNo) {
+  if (!tryLookup(file, pageNo, frameNo)) {
+    throw HashNotFoundException(file->filename(), pageNo);
+  }
 }
 
 void BufHashTbl::remove(const File* file, const PageId pageNo) {
-  int index = hash(file, pageNo);
-  hashBucket* tmpBuc = ht[index];
-  hashBucket* prevBuc = NULL;
-
-  while (tmpBuc) {
-    if (tmpBuc->file == file && tmpBuc->pageNo == pageNo) {
-      if (prevBuc)
-        prevBuc->next = tmpBuc->next;
-      else
-        ht[index] = tmpBuc->next;
-
-      delete tmpBuc;
-      return;
-    } else {
-      prevBuc = tmpBuc;
-      tmpBuc = tmpBuc->next;
+  int hole;
+  Partition& part = partitionOf(file, pageNo, hole);
+  int mask = part.size - 1;
+  while (part.buckets[hole].file != file ||
+         part.buckets[hole].pageNo != pageNo) {
+    if (!part.buckets[hole].file) {
+      throw HashNotFoundException(file->filename(), pageNo);
     }
+    hole = (hole + 1) & mask;
   }
 
-  throw HashNotFoundException(file->filename(), pageNo);
+  // shift back every later bucket of the run whose first bucket is not
+  // between the hole and itself, so that lookups never stop short of it
+  for (int next = (hole + 1) & mask; part.buckets[next].file;
+       next = (next + 1) & mask) {
+    int home;
+    partitionOf(part.buckets[next].file, part.buckets[next].pageNo, home);
+    if (((next - home) & mask) >= ((next - hole) & mask)) {
+      part.buckets[hole] = part.buckets[next];
+      hole = next;
+    }
+  }
+  part.buckets[hole].file = NULL;
+  part.count--;
 }
 
 }  // namespace badgerdb
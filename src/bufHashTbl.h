@@ -8,6 +8,9 @@
 
 #pragma once
 
+#include <cstdint>
+#include <mutex>
+
 #include "file.h"
 
 namespace badgerdb {
@@ -17,7 +20,7 @@ namespace badgerdb {
  */
 struct hashBucket {
   /**
-   * pointer a file object (more on this below)
+   * pointer a file object (more on this below), null if the bucket is empty
    */
   File* file;
 
@@ -30,49 +33,115 @@ struct hashBucket {
    * frame number of page in the buffer pool
    */
   FrameId frameNo;
-
-  /**
-   * Next node in the hash table
-   */
-  hashBucket* next;
 };
 
 /**
  * @brief Hash table class to keep track of pages in the buffer pool
  *
- * @warning This class is not threadsafe.
+ * The table is split into NUMPARTITIONS partitions, each guarded by a latch
+ * of its own, so threads working on pages of different partitions do not wait
+ * for each other. The table does not take the latches itself: insert(),
+ * lookup() and remove() must be called with the latch of the partition of
+ * (file, pageNo) held, see latch().
+ *
+ * Each partition is an open-addressing table with linear probing, allocated
+ * up front with room for twice its share of the entries. Removal shifts the
+ * buckets after the removed one back rather than leaving a tombstone, so
+ * probe sequences stay short however many pages come and go. A partition
+ * only allocates if it fills up past three quarters, doubling in size.
  */
 class BufHashTbl {
  private:
   /**
-   *	Size of Hash Table
+   * Number of partitions the table is split into
    */
-  int HTSIZE;
+  static const int NUMPARTITIONS = 16;
+
+  /**
+   * @brief One partition of the table.
+   */
+  struct Partition {
+    /**
+     * Buckets of the partition, size of them
+     */
+    hashBucket* buckets;
+
+    /**
+     * Number of buckets, a power of two
+     */
+    int size;
+
+    /**
+     * Number of buckets in use
+     */
+    int count;
+
+    /**
+     * Latch of the partition
+     */
+    std::mutex latch;
+  };
+
   /**
-   * Actual Hash table object
+   * The partitions. The low bits of the hash value of a page select its
+   * partition, the bits above them its first bucket in the partition.
    */
-  hashBucket** ht;
+  Partition partitions[NUMPARTITIONS];
 
   /**
-   * returns hash value between 0 and HTSIZE-1 computed using file and pageNo
+   * returns hash value computed using file and pageNo, every bit of which
+   * depends on every bit of both
    *
    * @param file   	File object
    * @param pageNo  Page number in the file
    * @return  			Hash value.
    */
-  int hash(const File* file, const PageId pageNo);
+  static std::uint64_t hash(const File* file, const PageId pageNo);
+
+  /**
+   * Returns the partition holding (file, pageNo) and its first bucket there.
+   *
+   * @param file   	File object
+   * @param pageNo  Page number in the file
+   * @param bucket  Receives the index of the first bucket to probe
+   * @return  			Partition of the page.
+   */
+  Partition& partitionOf(const File* file, const PageId pageNo, int& bucket);
+
+  /**
+   * Doubles the number of buckets of a partition and reinserts its entries.
+   *
+   * @param part   	Partition to grow
+   */
+  void grow(Partition& part);
+
+  BufHashTbl(const BufHashTbl&) = delete;
+  BufHashTbl& operator=(const BufHashTbl&) = delete;
 
  public:
   /**
    * Constructor of BufHashTbl class
+   *
+   * @param numEntries Number of entries the table is expected to hold at most
    */
-  BufHashTbl(const int htSize);  // constructor
+  BufHashTbl(const int numEntries);  // constructor
 
   /**
    * Destructor of BufHashTbl class
    */
   ~BufHashTbl();  // destructor
 
+  /**
+   * Returns the latch of the partition holding (file, pageNo).
+   *
+   * @param file   	File object
+   * @param pageNo 	Page number in the file
+   * @return  			Latch of the partition.
+   */
+  std::mutex& latch(const File* file, const PageId pageNo) {
+    return partitions[hash(file, pageNo) % NUMPARTITIONS].latch;
+  }
+
   /**
    * Insert entry into hash table mapping (file, pageNo) to frameNo.
    *
@@ -81,8 +150,6 @@ class BufHashTbl {
    * @param frameNo Frame number assigned to that page of the file
    * @throws  HashAlreadyPresentException	if the corresponding page
    * already exists in the hash table
-   * @throws  HashTableException (optional) if could not create a new bucket as
-   * running of memory
    */
   void insert(const File* file, const PageId pageNo, const FrameId frameNo);
 
@@ -98,6 +165,19 @@ class BufHashTbl {
    */
   void lookup(const File* file, const PageId pageNo, FrameId& frameNo);
 
+  /**
+   * Check if (file, pageNo) is currently in the buffer pool, like lookup()
+   * but reporting a miss through the return value. Misses are routine for
+   * the buffer manager, which should not pay for building an exception on
+   * each of them.
+   *
+   * @param file  	File object
+   * @param pageNo	Page number in the file
+   * @param frameNo Frame number reference, set only if the page is found
+   * @return  			True if the page entry is in the hash table.
+   */
+  bool tryLookup(const File* file, const PageId pageNo, FrameId& frameNo);
+
   /**
    * Delete entry (file,pageNo) from hash table.
    *
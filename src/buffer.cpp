@@ -8,12 +8,14 @@
 
 #include "buffer.h"
 
+#include <algorithm>
+#include <chrono>
 #include <iostream>
 #include <memory>
 
 #include "exceptions/bad_buffer_exception.h"
 #include "exceptions/buffer_exceeded_exception.h"
-#include "exceptions/hash_not_found_exception.h"
+#include "exceptions/insufficient_space_exception.h"
 #include "exceptions/page_not_pinned_exception.h"
 #include "exceptions/page_pinned_exception.h"
 
@@ -23,7 +25,12 @@ namespace badgerdb {
 // Constructor of the class BufMgr
 //----------------------------------------
 
-BufMgr::BufMgr(std::uint32_t bufs) : numBufs(bufs) {
+BufMgr::BufMgr(std::uint32_t bufs, ReplacementPolicyType policyType)
+    : numBufs(bufs),
+      prefetchStop(false),
+      flushHand(0),
+      flushEngine(IOEngine::create(URING_IO, MAXFLUSHBATCH)),
+      flusherStop(false) {
   bufDescTable = new BufDesc[bufs];
 
   for (FrameId i = 0; i < bufs; i++) {
@@ -33,13 +40,41 @@ BufMgr::BufMgr(std::uint32_t bufs) : numBufs(bufs) {
 
   bufPool = new Page[bufs];
 
-  int htsize = ((((int)(bufs * 1.2)) * 2) / 2) + 1;
-  hashTable = new BufHashTbl(htsize);  // allocate the buffer hash table
+  // at most one entry per frame
+  hashTable = new BufHashTbl(bufs);  // allocate the buffer hash table
 
-  clockHand = bufs - 1;
+  policy = ReplacementPolicy::create(policyType, bufs);
+
+  // an eighth of the pool for scans, but no more than they need
+  ringSize = std::max<std::uint32_t>(1, std::min<std::uint32_t>(16, bufs / 8));
+
+  // every frame is free, handed out from the first on
+  for (FrameId i = bufs; i > 0; i--) {
+    freeFrames.push_back(i - 1);
+  }
+
+  flusher = std::thread(&BufMgr::flushLoop, this);
 }
 
 BufMgr::~BufMgr() {
+  // stop reading ahead, dropping whatever is left to read
+  {
+    std::lock_guard<std::mutex> prefetchLock(prefetchLatch);
+    prefetchStop = true;
+    prefetchReady.notify_all();
+  }
+  if (prefetcher.joinable()) {
+    prefetcher.join();
+  }
+
+  // stop writing in the background, what is left is written below
+  {
+    std::lock_guard<std::mutex> flusherLock(flusherLatch);
+    flusherStop = true;
+    flusherWake.notify_all();
+  }
+  flusher.join();
+
   // Flush out all unwritten pages
   for (std::uint32_t i = 0; i < numBufs; i++) {
     BufDesc* tmpbuf = &(bufDescTable[i]);
@@ -48,137 +83,767 @@ BufMgr::~BufMgr() {
     }
   }
 
+  delete policy;
   delete hashTable;
   delete[] bufDescTable;
   delete[] bufPool;
 }
 
-void BufMgr::allocBuf(FrameId& frame) {
-  // perform first part of clock algorithm to search for
-  // open buffer frame
-  // Assumes non-concurrent access to buffer manager
-  std::uint32_t numScanned = 0;
-  bool found = 0;
+void BufMgr::allocBuf(FrameId& frame, AccessHint hint) {
+  // a page evicted meanwhile by another thread may be read in again before
+  // this thread claims its victim, try again a while before giving up
+  for (std::uint32_t attempts = 0; attempts < 2 * numBufs; attempts++) {
+    // use a free frame if there is one
+    {
+      std::lock_guard<std::mutex> freeLock(freeLatch);
+      if (!freeFrames.empty()) {
+        frame = freeFrames.back();
+        freeFrames.pop_back();
+        std::lock_guard<std::mutex> frameLock(bufDescTable[frame].latch);
+        bufDescTable[frame].pinCnt = 1;
+        return;
+      }
+    }
 
-  while (numScanned < 2 * numBufs)  // Need to scn twice
-  {
-    // advance the clock
-    advanceClock();
-    numScanned++;
+    // then evict a page on the ring, leaving a scan pages enough to work with
+    if (recycleRing(frame, hint == SEQUENTIAL_ACCESS ? ringSize : 1)) {
+      return;
+    }
 
-    // if invalid, use frame
-    if (!bufDescTable[clockHand].valid) {
+    // otherwise let the policy pick an unpinned page to evict
+    FrameId frameNo;
+    bool found = policy->victim(frameNo, [this](FrameId candidate) {
+      BufDesc& desc = bufDescTable[candidate];
+      std::lock_guard<std::mutex> frameLock(desc.latch);
+      return desc.valid && desc.pinCnt == 0 && !desc.loading;
+    });
+    if (!found) {
       break;
     }
+    if (evictBuf(frameNo)) {
+      frame = frameNo;
+      return;
+    }
+  }
+
+  // full buffer pool
+  throw BufferExceededException();
+}  // end allocBuf
+
+bool BufMgr::evictBuf(FrameId frameNo) {
+  BufDesc& desc = bufDescTable[frameNo];
+  std::unique_lock<std::mutex> frameLock(desc.latch);
+  if (!desc.valid || desc.pinCnt != 0) {
+    return false;
+  }
+  File* file = desc.file;
+  PageId pageNo = desc.pageNo;
+
+  // flush any existing changes to disk if necessary. The page stays pinned
+  // and in the hash table meanwhile, so that a thread reading it finds it
+  // here rather than the stale copy on disk
+  if (desc.dirty) {
+    desc.pinCnt++;
+    desc.dirty = false;
+    frameLock.unlock();
+
+    // the flusher did not get to it in time, have it catch up
+    flusherWake.notify_one();
+    try {
+      SharedLatchGuard ioLock(ioLatch);
+      bufStats.diskwrites++;
+      file->writePage(pageNo, bufPool[frameNo]);
+    } catch (...) {
+      frameLock.lock();
+      desc.dirty = true;
+      desc.pinCnt--;
+      throw;
+    }
+    frameLock.lock();
+    desc.pinCnt--;
+  }
+  frameLock.unlock();
+
+  // evict the page unless another thread pinned or dirtied it meanwhile;
+  // remove previous entry from hash table
+  bool onRing;
+  {
+    std::lock_guard<std::mutex> partitionLock(hashTable->latch(file, pageNo));
+    frameLock.lock();
+    if (!desc.valid || desc.file != file || desc.pageNo != pageNo ||
+        desc.pinCnt != 0 || desc.dirty) {
+      return false;
+    }
+    hashTable->remove(file, pageNo);
 
-    // is valid, check referenced bit
-    if (!bufDescTable[clockHand].refbit) {
-      // check to see if someone has it pinned
-      if (bufDescTable[clockHand].pinCnt == 0) {
-        // hasn't been referenced and is not pinned, use it
-        // remove previous entry from hash table
-        hashTable->remove(bufDescTable[clockHand].file,
-                          bufDescTable[clockHand].pageNo);
+    // Reset all the BufDesc entry for the frame before returning the frame
+    onRing = desc.onRing;
+    desc.Clear();
+    desc.pinCnt = 1;
+    frameLock.unlock();
+  }
+  if (onRing) {
+    leaveRing(frameNo);
+  } else {
+    policy->removed(frameNo, true);
+  }
+  return true;
+}
+
+bool BufMgr::recycleRing(FrameId& frame, std::size_t minPages) {
+  FrameId frameNo = 0;
+  bool found = false;
+  {
+    std::lock_guard<std::mutex> ringLock(ringLatch);
+    if (ringFrames.size() < minPages) {
+      return false;
+    }
+    for (FrameId candidate : ringFrames) {
+      BufDesc& desc = bufDescTable[candidate];
+      std::lock_guard<std::mutex> frameLock(desc.latch);
+      if (desc.valid && desc.pinCnt == 0 && !desc.loading) {
+        frameNo = candidate;
         found = true;
         break;
       }
-    } else {
-      // has been referenced, clear the bit
-      bufStats.accesses++;
-      bufDescTable[clockHand].refbit = false;
     }
   }
+  if (found && evictBuf(frameNo)) {
+    frame = frameNo;
+    return true;
+  }
+  return false;
+}
 
-  // check for full buffer pool
-  if (!found && numScanned >= 2 * numBufs) {
-    throw BufferExceededException();
+void BufMgr::leaveRing(FrameId frame) {
+  std::lock_guard<std::mutex> ringLock(ringLatch);
+  std::deque<FrameId>::iterator it =
+      std::find(ringFrames.begin(), ringFrames.end(), frame);
+  if (it != ringFrames.end()) {
+    ringFrames.erase(it);
   }
+}
 
-  // flush any existing changes to disk if necessary
-  if (bufDescTable[clockHand].dirty) {
-    bufStats.diskwrites++;
-    // status =
-    // bufDescTable[clockHand].file->writePage(bufDescTable[clockHand].pageNo,
-    bufDescTable[clockHand].file->writePage(bufDescTable[clockHand].pageNo,
-                                            bufPool[clockHand]);
+void BufMgr::releaseBuf(FrameId frame) {
+  {
+    std::lock_guard<std::mutex> frameLock(bufDescTable[frame].latch);
+    bufDescTable[frame].Clear();
   }
+  freeFrame(frame);
+}
 
-  // Reset all the BufDesc entry for the frame before returning the frame
-  bufDescTable[clockHand].Clear();
+void BufMgr::freeFrame(FrameId frame) {
+  leaveRing(frame);
+  policy->removed(frame, false);
+  std::lock_guard<std::mutex> freeLock(freeLatch);
+  freeFrames.push_back(frame);
+}
 
-  // return new frame number
-  frame = clockHand;
-}  // end allocBuf
+bool BufMgr::pinIfPresent(File* file, const PageId pageNo, FrameId& frame,
+                          AccessHint hint) {
+  if (!hashTable->tryLookup(file, pageNo, frame)) {
+    return false;
+  }
+
+  // set the referenced bit
+  BufDesc& desc = bufDescTable[frame];
+  bool promote = false;
+  {
+    std::lock_guard<std::mutex> frameLock(desc.latch);
+    desc.refbit = true;
+    desc.pinCnt++;
+    if (hint == NORMAL_ACCESS && desc.onRing) {
+      desc.onRing = false;
+      promote = true;
+    }
+  }
+
+  // only normal accesses count with the policy, a scan passing over a hot
+  // page does not make it any hotter
+  if (promote) {
+    leaveRing(frame);
+    policy->loaded(frame, file, pageNo);
+  } else if (hint == NORMAL_ACCESS) {
+    policy->accessed(frame);
+  }
+  return true;
+}
 
-void BufMgr::readPage(File* file, const PageId pageNo, Page*& page) {
+void BufMgr::readPage(File* file, const PageId pageNo, Page*& page,
+                      AccessHint hint) {
+  bufStats.accesses++;
+  fetchPage(file, pageNo, page, hint);
+}
+
+bool BufMgr::fetchPage(File* file, const PageId pageNo, Page*& page,
+                       AccessHint hint, bool cachedOnly) {
   // check to see if it is already in the buffer pool
   // std::cout << "readPage called on file.page " << file << "." << pageNo <<
   // endl;
   FrameId frameNo = 0;
+  bool found;
+  {
+    std::lock_guard<std::mutex> partitionLock(hashTable->latch(file, pageNo));
+    found = pinIfPresent(file, pageNo, frameNo, hint);
+  }
+  if (!found) {
+    if (cachedOnly) {
+      return false;
+    }
+
+    // not in the buffer pool, read the page into a new frame unless another
+    // thread read it in first
+    if (beginLoad(file, pageNo, hint, frameNo)) {
+      try {
+        SharedLatchGuard ioLock(ioLatch);
+        bufStats.diskreads++;
+        file->readPage(pageNo, &bufPool[frameNo]);
+      } catch (...) {
+        abortLoad(file, pageNo, frameNo);
+        throw;
+      }
+      endLoad(frameNo);
+      page = &bufPool[frameNo];
+      return true;
+    }
+  }
+
+  // the page may still be on its way in from disk, maybe for the prefetcher
+  // itself to read
+  BufDesc& desc = bufDescTable[frameNo];
+  std::unique_lock<std::mutex> frameLock(desc.latch);
+  if (cachedOnly && desc.loading) {
+    desc.pinCnt--;
+    return false;
+  }
+  while (desc.loading) {
+    desc.ioDone.wait(frameLock);
+  }
+  if (!desc.valid || desc.file != file || desc.pageNo != pageNo) {
+    // the read failed, try it once more for this thread
+    frameLock.unlock();
+    return fetchPage(file, pageNo, page, hint, cachedOnly);
+  }
+  page = &bufPool[frameNo];
+  return true;
+}
+
+bool BufMgr::beginLoad(File* file, const PageId pageNo, AccessHint hint,
+                       FrameId& frameNo) {
+  // evicting a page takes partition latches of its own, so the frame is
+  // found without the partition latch of the page held. The miss is claimed
+  // first, and threads missing the same page meanwhile wait for the claim to
+  // be settled rather than each evicting a page of their own
+  const std::pair<const File*, PageId> miss(file, pageNo);
+  auto isPending = [&]() {
+    return std::find(pendingLoads.begin(), pendingLoads.end(), miss) !=
+           pendingLoads.end();
+  };
+  while (true) {
+    std::unique_lock<std::mutex> partitionLock(hashTable->latch(file, pageNo));
+    if (pinIfPresent(file, pageNo, frameNo, hint)) {
+      // another thread read the page in first, or is reading it
+      return false;
+    }
+    std::unique_lock<std::mutex> pendingLock(pendingLatch);
+    if (!isPending()) {
+      pendingLoads.push_back(miss);
+      break;
+    }
+    partitionLock.unlock();
+    pendingDone.wait(pendingLock, [&]() { return !isPending(); });
+  }
+
+  FrameId newFrameNo;
   try {
-    hashTable->lookup(file, pageNo, frameNo);
+    allocBuf(newFrameNo, hint);
+  } catch (...) {
+    std::lock_guard<std::mutex> partitionLock(hashTable->latch(file, pageNo));
+    settleMiss(miss);
+    throw;
+  }
 
-    // set the referenced bit
-    bufDescTable[frameNo].refbit = true;
-    bufDescTable[frameNo].pinCnt++;
-    page = &bufPool[frameNo];
-  } catch (const HashNotFoundException&
-               e)  // not in the buffer pool, must allocate a new page
+  // set up the entry properly and insert it in the hash table before
+  // reading, so that threads asking for the page meanwhile wait for this
+  // read rather than starting their own
+  std::lock_guard<std::mutex> partitionLock(hashTable->latch(file, pageNo));
+  frameNo = newFrameNo;
+  BufDesc& desc = bufDescTable[frameNo];
   {
-    // alloc a new frame
-    allocBuf(frameNo);
+    std::lock_guard<std::mutex> frameLock(desc.latch);
+    desc.Set(file, pageNo);
+    desc.loading = true;
+    desc.onRing = hint != NORMAL_ACCESS;
+  }
+  hashTable->insert(file, pageNo, frameNo);
+  settleMiss(miss);
+  if (hint == NORMAL_ACCESS) {
+    policy->loaded(frameNo, file, pageNo);
+  } else {
+    std::lock_guard<std::mutex> ringLock(ringLatch);
+    ringFrames.push_back(frameNo);
+  }
+  return true;
+}
 
-    // read the page into the new frame
-    bufStats.diskreads++;
-    // status = file->readPage(pageNo, &bufPool[frameNo]);
-    bufPool[frameNo] = file->readPage(pageNo);
+void BufMgr::settleMiss(const std::pair<const File*, PageId>& miss) {
+  std::lock_guard<std::mutex> pendingLock(pendingLatch);
+  pendingLoads.erase(
+      std::find(pendingLoads.begin(), pendingLoads.end(), miss));
+  pendingDone.notify_all();
+}
 
-    // set up the entry properly
-    bufDescTable[frameNo].Set(file, pageNo);
-    page = &bufPool[frameNo];
+void BufMgr::endLoad(FrameId frameNo) {
+  BufDesc& desc = bufDescTable[frameNo];
+  std::lock_guard<std::mutex> frameLock(desc.latch);
+  desc.loading = false;
+  desc.ioDone.notify_all();
+}
 
-    // insert in the hash table
-    hashTable->insert(file, pageNo, frameNo);
+void BufMgr::abortLoad(File* file, const PageId pageNo, FrameId frameNo) {
+  // waiting threads find the frame cleared and try again
+  {
+    std::lock_guard<std::mutex> partitionLock(hashTable->latch(file, pageNo));
+    hashTable->remove(file, pageNo);
+    BufDesc& desc = bufDescTable[frameNo];
+    std::lock_guard<std::mutex> frameLock(desc.latch);
+    desc.Clear();
+    desc.ioDone.notify_all();
   }
+  freeFrame(frameNo);
 }
 
 void BufMgr::unPinPage(File* file, const PageId pageNo, const bool dirty) {
-  // lookup in hashtable
+  // lookup in hashtable, the page cannot leave it while pinned
   FrameId frameNo = 0;
-  hashTable->lookup(file, pageNo, frameNo);
+  {
+    std::lock_guard<std::mutex> partitionLock(hashTable->latch(file, pageNo));
+    hashTable->lookup(file, pageNo, frameNo);
+  }
 
-  if (dirty == true) bufDescTable[frameNo].dirty = dirty;
+  BufDesc& desc = bufDescTable[frameNo];
+  std::lock_guard<std::mutex> frameLock(desc.latch);
+  if (dirty == true) desc.dirty = dirty;
 
   // make sure the page is actually pinned
-  if (bufDescTable[frameNo].pinCnt == 0) {
+  if (desc.pinCnt == 0) {
     throw PageNotPinnedException(file->filename(), pageNo, frameNo);
   } else
-    bufDescTable[frameNo].pinCnt--;
+    desc.pinCnt--;
 }
 
 void BufMgr::allocPage(File* file, PageId& pageNo, Page*& page) {
   FrameId frameNo;
 
   // alloc a new frame
+  bufStats.accesses++;
   allocBuf(frameNo);
 
   // allocate a new page in the file
   // std::cerr << "buffer data size:" << bufPool[frameNo].data_.length() <<
   // "\n";
-  bufPool[frameNo] = file->allocatePage(pageNo);
+  try {
+    std::lock_guard<RWLatch> ioLock(ioLatch);
+    bufStats.diskreads++;
+    file->allocatePage(pageNo, &bufPool[frameNo]);
+  } catch (...) {
+    releaseBuf(frameNo);
+    throw;
+  }
   page = &bufPool[frameNo];
 
-  // set up the entry properly
-  bufDescTable[frameNo].Set(file, pageNo);
+  // set up the entry properly and insert it in the hash table
+  {
+    std::lock_guard<std::mutex> partitionLock(hashTable->latch(file, pageNo));
+    {
+      std::lock_guard<std::mutex> frameLock(bufDescTable[frameNo].latch);
+      bufDescTable[frameNo].Set(file, pageNo);
+    }
+    hashTable->insert(file, pageNo, frameNo);
+    policy->loaded(frameNo, file, pageNo);
+  }
+}
 
-  // insert in the hash table
-  hashTable->insert(file, pageNo, frameNo);
+void BufMgr::prefetch(
+    File* file, const PageId pageNo, int numPages, AccessHint hint,
+    const std::function<PageId(PageId, const Page&)>& nextPage) {
+  // pages read ahead must not push each other out before they are used
+  int maxPages = hint == NORMAL_ACCESS ? numBufs / 4 : ringSize / 2;
+  numPages = std::min(numPages, maxPages);
+  if (numPages <= 0) {
+    return;
+  }
+
+  std::lock_guard<std::mutex> prefetchLock(prefetchLatch);
+  if (prefetchStop ||
+      prefetchQueue.size() >= std::size_t(MAXPREFETCHREQUESTS)) {
+    return;
+  }
+  for (const PrefetchRequest& request : prefetchQueue) {
+    if (request.file == file && request.pageNo == pageNo) {
+      return;
+    }
+  }
+  PrefetchRequest request = {file, pageNo, numPages, true, hint, nextPage};
+  prefetchQueue.push_back(request);
+  if (!prefetcher.joinable()) {
+    prefetcher = std::thread(&BufMgr::prefetchLoop, this);
+  }
+  prefetchReady.notify_one();
 }
 
+void BufMgr::prefetchLoop() {
+  // requests are worked on side by side, so that the pages of several scans
+  // are read at once
+  std::unique_ptr<IOEngine> engine =
+      IOEngine::create(URING_IO, MAXPREFETCHACTIVE);
+  std::vector<PrefetchRequest> active;
+  std::unique_lock<std::mutex> prefetchLock(prefetchLatch);
+  while (true) {
+    prefetchReady.wait(prefetchLock, [this, &active] {
+      return prefetchStop || !prefetchQueue.empty() || !active.empty();
+    });
+    if (prefetchStop) {
+      return;
+    }
+    while (!prefetchQueue.empty() && active.size() < MAXPREFETCHACTIVE) {
+      active.push_back(prefetchQueue.front());
+      prefetchQueue.pop_front();
+    }
+    prefetchFiles.clear();
+    for (const PrefetchRequest& request : active) {
+      prefetchFiles.push_back(request.file);
+    }
+    prefetchLock.unlock();
+
+    readAhead(*engine, active);
+
+    // give up the requests of files being flushed
+    prefetchLock.lock();
+    for (const File* file : prefetchCancelled) {
+      active.erase(std::remove_if(active.begin(), active.end(),
+                                  [file](const PrefetchRequest& request) {
+                                    return request.file == file;
+                                  }),
+                   active.end());
+    }
+    prefetchCancelled.clear();
+    prefetchFiles.clear();
+    for (const PrefetchRequest& request : active) {
+      prefetchFiles.push_back(request.file);
+    }
+    prefetchDone.notify_all();
+  }
+}
+
+void BufMgr::readAhead(IOEngine& engine,
+                       std::vector<PrefetchRequest>& active) {
+  struct PendingRead {
+    std::size_t requestNo;
+    FrameId frameNo;
+    bool submitted;
+    IORequest io;
+  };
+  std::vector<PendingRead> reads;
+  reads.reserve(active.size());
+  std::vector<bool> done(active.size(), false);
+
+  // walk every chain up to its first page not in the pool, and give that
+  // page a frame. Reading ahead is only a hint: a full pool or a page gone
+  // meanwhile ends the request
+  for (std::size_t i = 0; i < active.size(); i++) {
+    PrefetchRequest& request = active[i];
+    try {
+      FrameId frameNo;
+      if (!walkChain(request)) {
+        done[i] = true;
+      } else if (beginLoad(request.file, request.pageNo, request.hint,
+                           frameNo)) {
+        PendingRead read;
+        read.requestNo = i;
+        read.frameNo = frameNo;
+        read.submitted = false;
+        reads.push_back(read);
+      } else {
+        // read in by another thread meanwhile, walked over next time
+        unPinPage(request.file, request.pageNo, false);
+      }
+    } catch (...) {
+      done[i] = true;
+    }
+  }
+
+  // read the pages all at once
+  if (!reads.empty()) {
+    SharedLatchGuard ioLock(ioLatch);
+    for (PendingRead& read : reads) {
+      PrefetchRequest& request = active[read.requestNo];
+      try {
+        request.file->readPageAsync(engine, request.pageNo,
+                                    &bufPool[read.frameNo], &read.io);
+        bufStats.diskreads++;
+        read.submitted = true;
+      } catch (...) {
+      }
+    }
+    std::vector<IORequest*> completed;
+    while (engine.inFlight() > 0) {
+      engine.complete(completed);
+    }
+  }
+
+  // hand the pages over to threads waiting for them, and take each chain on
+  // from its page
+  for (PendingRead& read : reads) {
+    PrefetchRequest& request = active[read.requestNo];
+    bool ok = read.submitted;
+    if (ok) {
+      try {
+        request.file->readPageDone(&read.io, &bufPool[read.frameNo]);
+      } catch (...) {
+        ok = false;
+      }
+    }
+    if (!ok) {
+      abortLoad(request.file, request.pageNo, read.frameNo);
+      done[read.requestNo] = true;
+      continue;
+    }
+    endLoad(read.frameNo);
+    try {
+      done[read.requestNo] = !stepChain(request, bufPool[read.frameNo]);
+    } catch (...) {
+      done[read.requestNo] = true;
+    }
+  }
+
+  std::size_t kept = 0;
+  for (std::size_t i = 0; i < active.size(); i++) {
+    if (!done[i]) {
+      active[kept++] = active[i];
+    }
+  }
+  active.resize(kept);
+}
+
+bool BufMgr::walkChain(PrefetchRequest& request) {
+  while (true) {
+    // the page the chain starts from is the page the scan was on, which is
+    // found in the pool like every page read ahead by an earlier request. If
+    // the page is gone, the scan is past it and the pages after it too, some
+    // of them evicted already
+    Page* page;
+    if (!fetchPage(request.file, request.pageNo, page, request.hint, true)) {
+      return !request.atStart;
+    }
+    if (!stepChain(request, *page)) {
+      return false;
+    }
+  }
+}
+
+bool BufMgr::stepChain(PrefetchRequest& request, const Page& page) {
+  request.atStart = false;
+  PageId nextPageNo = request.numPages > 0
+                          ? request.nextPage(request.pageNo, page)
+                          : Page::INVALID_NUMBER;
+  unPinPage(request.file, request.pageNo, false);
+  if (nextPageNo == Page::INVALID_NUMBER) {
+    return false;
+  }
+  request.pageNo = nextPageNo;
+  request.numPages--;
+  return true;
+}
+
+void BufMgr::cancelPrefetch(const File* file) {
+  std::unique_lock<std::mutex> prefetchLock(prefetchLatch);
+  for (std::deque<PrefetchRequest>::iterator it = prefetchQueue.begin();
+       it != prefetchQueue.end();) {
+    if (it->file == file) {
+      it = prefetchQueue.erase(it);
+    } else {
+      ++it;
+    }
+  }
+  if (std::find(prefetchFiles.begin(), prefetchFiles.end(), file) ==
+      prefetchFiles.end()) {
+    return;
+  }
+  prefetchCancelled.push_back(file);
+  prefetchDone.wait(prefetchLock, [this, file] {
+    return std::find(prefetchFiles.begin(), prefetchFiles.end(), file) ==
+           prefetchFiles.end();
+  });
+}
+
+void BufMgr::flushLoop() {
+  std::unique_lock<std::mutex> flusherLock(flusherLatch);
+  bool more = false;
+  while (true) {
+    // a full batch means more dirty pages are waiting, carry straight on
+    if (!more) {
+      flusherWake.wait_for(flusherLock,
+                           std::chrono::milliseconds(int(FLUSHINTERVALMS)));
+    }
+    if (flusherStop) {
+      return;
+    }
+    flusherLock.unlock();
+    more = writeDirtyPages(MAXFLUSHBATCH, true, false) == MAXFLUSHBATCH;
+    flusherLock.lock();
+  }
+}
+
+std::size_t BufMgr::writeDirtyPages(std::size_t maxPages, bool coldOnly,
+                                    bool syncFiles) {
+  std::lock_guard<std::mutex> batchLock(flushBatchLatch);
+
+  // pick the pages, going round the pool from where the last batch stopped
+  struct DirtyPage {
+    File* file;
+    PageId pageNo;
+    FrameId frameNo;
+    bool pinned;
+    bool ok;
+    IORequest io;
+  };
+  std::vector<DirtyPage> batch;
+  for (std::uint32_t i = 0; i < numBufs && batch.size() < maxPages; i++) {
+    FrameId frameNo = flushHand;
+    flushHand = (flushHand + 1) % numBufs;
+    BufDesc& desc = bufDescTable[frameNo];
+    std::lock_guard<std::mutex> frameLock(desc.latch);
+    if (!desc.valid || !desc.dirty || desc.pinCnt != 0 || desc.loading) {
+      continue;
+    }
+    if (coldOnly && desc.refbit) {
+      desc.refbit = false;
+      continue;
+    }
+    DirtyPage dirtyPage;
+    dirtyPage.file = desc.file;
+    dirtyPage.pageNo = desc.pageNo;
+    dirtyPage.frameNo = frameNo;
+    dirtyPage.pinned = false;
+    dirtyPage.ok = false;
+    batch.push_back(dirtyPage);
+  }
+
+  // write them in the order they are laid out on disk
+  std::sort(batch.begin(), batch.end(),
+            [](const DirtyPage& a, const DirtyPage& b) {
+              return a.file != b.file ? std::less<File*>()(a.file, b.file)
+                                      : a.pageNo < b.pageNo;
+            });
+
+  // pinned while written, as by evictBuf(), so that they are not evicted
+  // before they are on disk. Pages pinned or written meanwhile are left alone
+  for (DirtyPage& dirtyPage : batch) {
+    BufDesc& desc = bufDescTable[dirtyPage.frameNo];
+    std::lock_guard<std::mutex> frameLock(desc.latch);
+    if (!desc.valid || desc.file != dirtyPage.file ||
+        desc.pageNo != dirtyPage.pageNo || !desc.dirty || desc.pinCnt != 0 ||
+        desc.loading) {
+      continue;
+    }
+    desc.pinCnt++;
+    desc.dirty = false;
+    dirtyPage.pinned = true;
+  }
+
+  // pages that failed are left dirty, for whoever evicts or flushes them to
+  // find the error
+  auto unpinBatch = [this, &batch]() {
+    std::size_t written = 0;
+    for (DirtyPage& dirtyPage : batch) {
+      if (!dirtyPage.pinned) {
+        continue;
+      }
+      BufDesc& desc = bufDescTable[dirtyPage.frameNo];
+      std::lock_guard<std::mutex> frameLock(desc.latch);
+      if (dirtyPage.ok) {
+        written++;
+      } else {
+        desc.dirty = true;
+      }
+      desc.pinCnt--;
+    }
+    return written;
+  };
+
+  // write them all at once, alongside any reads
+  try {
+    SharedLatchGuard ioLock(ioLatch);
+    for (DirtyPage& dirtyPage : batch) {
+      if (!dirtyPage.pinned) {
+        continue;
+      }
+      try {
+        dirtyPage.file->writePageAsync(*flushEngine, dirtyPage.pageNo,
+                                       bufPool[dirtyPage.frameNo],
+                                       &dirtyPage.io);
+        bufStats.diskwrites++;
+        dirtyPage.ok = true;
+      } catch (...) {
+      }
+    }
+    std::vector<IORequest*> completed;
+    while (flushEngine->inFlight() > 0) {
+      flushEngine->complete(completed);
+    }
+    for (DirtyPage& dirtyPage : batch) {
+      if (!dirtyPage.ok) {
+        continue;
+      }
+      try {
+        dirtyPage.file->writePageDone(&dirtyPage.io);
+      } catch (...) {
+        dirtyPage.ok = false;
+      }
+    }
+  } catch (...) {
+    unpinBatch();
+    throw;
+  }
+  std::size_t written = unpinBatch();
+
+  // the batch is sorted by file, each file comes up once in a row. Only the
+  // header is written under the latch, the wait for the disk is not
+  if (syncFiles) {
+    for (std::size_t i = 0; i < batch.size(); i++) {
+      if (i == 0 || batch[i].file != batch[i - 1].file) {
+        {
+          std::lock_guard<RWLatch> ioLock(ioLatch);
+          batch[i].file->writeMetadata();
+        }
+        batch[i].file->syncData();
+      }
+    }
+  }
+  return written;
+}
+
+void BufMgr::checkpoint() { writeDirtyPages(numBufs, false, true); }
+
 void BufMgr::flushFile(const File* file) {
+  cancelPrefetch(file);
+  std::lock_guard<std::mutex> batchLock(flushBatchLatch);
   for (std::uint32_t i = 0; i < numBufs; i++) {
     BufDesc* tmpbuf = &(bufDescTable[i]);
+    std::unique_lock<std::mutex> frameLock(tmpbuf->latch);
     if (tmpbuf->file && tmpbuf->valid == true && tmpbuf->file == file) {
+      // take the partition latch first, then make sure the frame still holds
+      // the same page
+      PageId pageNo = tmpbuf->pageNo;
+      frameLock.unlock();
+      std::unique_lock<std::mutex> partitionLock(
+          hashTable->latch(file, pageNo));
+      frameLock.lock();
+      if (!tmpbuf->valid || tmpbuf->file != file || tmpbuf->pageNo != pageNo) {
+        continue;
+      }
+
       if (tmpbuf->pinCnt > 0)
         throw PagePinnedException(file->filename(), tmpbuf->pageNo,
                                   tmpbuf->frameNo);
@@ -186,39 +851,113 @@ void BufMgr::flushFile(const File* file) {
       if (tmpbuf->dirty == true) {
         // if ((status = tmpbuf->file->writePage(tmpbuf->pageNo, &(bufPool[i])))
         // != OK)
+        SharedLatchGuard ioLock(ioLatch);
         tmpbuf->file->writePage(tmpbuf->pageNo, bufPool[i]);
         tmpbuf->dirty = false;
       }
 
       hashTable->remove(file, tmpbuf->pageNo);
       tmpbuf->Clear();
+      frameLock.unlock();
+      partitionLock.unlock();
+      freeFrame(i);
     } else if (tmpbuf->valid == false && tmpbuf->file == file)
       throw BadBufferException(tmpbuf->frameNo, tmpbuf->dirty, tmpbuf->valid,
                                tmpbuf->refbit);
   }
+
+  {
+    std::lock_guard<RWLatch> ioLock(ioLatch);
+    file->writeMetadata();
+  }
+  file->syncData();
 }
 
 void BufMgr::disposePage(File* file, const PageId pageNo) {
   // Deallocate from file altogether
   // See if it is in the buffer pool
   FrameId frameNo = 0;
-  hashTable->lookup(file, pageNo, frameNo);
+  std::lock_guard<std::mutex> batchLock(flushBatchLatch);
+  {
+    std::lock_guard<std::mutex> partitionLock(hashTable->latch(file, pageNo));
+    hashTable->lookup(file, pageNo, frameNo);
 
-  // clear the page
-  bufDescTable[frameNo].Clear();
+    // clear the page
+    {
+      std::lock_guard<std::mutex> frameLock(bufDescTable[frameNo].latch);
+      bufDescTable[frameNo].Clear();
+    }
 
-  hashTable->remove(file, pageNo);
+    hashTable->remove(file, pageNo);
+  }
+  freeFrame(frameNo);
 
   // deallocate it in the file
+  std::lock_guard<RWLatch> ioLock(ioLatch);
   file->deletePage(pageNo);
 }
 
+RecordId BufMgr::insertRecord(PageFile* file, const std::string& data) {
+  // a record that fits nowhere must not leave an empty page behind
+  if (data.length() + sizeof(PageSlot) > Page::DATA_SIZE) {
+    throw InsufficientSpaceException(Page::INVALID_NUMBER, data.length(),
+                                     Page::DATA_SIZE - sizeof(PageSlot));
+  }
+  std::lock_guard<std::mutex> recordLock(recordLatch);
+  while (true) {
+    PageId pageNo;
+    {
+      std::lock_guard<RWLatch> ioLock(ioLatch);
+      pageNo = file->findPageWithSpace(data.length());
+    }
+    Page* page;
+    if (pageNo == Page::INVALID_NUMBER) {
+      allocPage(file, pageNo, page);
+    } else {
+      readPage(file, pageNo, page);
+    }
+
+    // the map may be behind a page changed other than through this
+    const bool fits = page->hasSpaceForRecord(data);
+    RecordId rid;
+    if (fits) {
+      rid = page->insertRecord(data);
+    }
+    {
+      std::lock_guard<RWLatch> ioLock(ioLatch);
+      file->updateFreeSpace(*page);
+    }
+    unPinPage(file, pageNo, fits);
+    if (fits) {
+      return rid;
+    }
+  }
+}
+
+void BufMgr::deleteRecord(PageFile* file, const RecordId& rid) {
+  std::lock_guard<std::mutex> recordLock(recordLatch);
+  Page* page;
+  readPage(file, rid.page_number, page);
+  try {
+    page->deleteRecord(rid);
+  } catch (...) {
+    unPinPage(file, rid.page_number, false);
+    throw;
+  }
+  {
+    std::lock_guard<RWLatch> ioLock(ioLatch);
+    file->updateFreeSpace(*page);
+  }
+  unPinPage(file, rid.page_number, true);
+}
+
 void BufMgr::printSelf(void) {
   BufDesc* tmpbuf;
   int validFrames = 0;
 
   for (std::uint32_t i = 0; i < numBufs; i++) {
     tmpbuf = &(bufDescTable[i]);
+    std::lock_guard<std::mutex> frameLock(tmpbuf->latch);
     std::cout << "FrameNo:" << i << " ";
     tmpbuf->Print();
 
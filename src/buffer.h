@@ -8,10 +8,20 @@
 
 #pragma once
 
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
 #include <iostream>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
 
 #include "bufHashTbl.h"
 #include "file.h"
+#include "latch.h"
+#include "replacement.h"
 
 namespace badgerdb {
 
@@ -21,12 +31,37 @@ namespace badgerdb {
 class BufMgr;
 
 /**
- * @brief Class for maintaining information about buffer pool frames
+ * @brief How a page read through the buffer pool is going to be used.
+ */
+enum AccessHint {
+  NORMAL_ACCESS = 0,     /* Page may well be used again soon */
+  SEQUENTIAL_ACCESS = 1, /* Page read by a scan, which moves on to the next */
+  ONE_SHOT_ACCESS = 2    /* Page used once and then not again for a while */
+};
+
+/**
+ * @brief Number of pages scans ask the buffer manager to read ahead of them.
+ */
+const int READAHEAD_PAGES = 8;
+
+/**
+ * @brief Class for maintaining information about buffer pool frames. Every
+ * member but frameNo is protected by the latch of the frame.
  */
 class BufDesc {
   friend class BufMgr;
 
  private:
+  /**
+   * Latch protecting the state of the frame
+   */
+  std::mutex latch;
+
+  /**
+   * Signalled when the page being read into the frame has arrived
+   */
+  std::condition_variable ioDone;
+
   /**
    * Pointer to file to which corresponding frame is assigned
    */
@@ -58,10 +93,23 @@ class BufDesc {
   bool valid;
 
   /**
-   * Has this buffer frame been reference recently
+   * Has this buffer frame been referenced since the flusher last passed it.
+   * The replacement policy tracks references itself.
    */
   bool refbit;
 
+  /**
+   * True while the page is being read into the frame. Threads that pin the
+   * page meanwhile wait on ioDone before using it.
+   */
+  bool loading;
+
+  /**
+   * True while the page is on the ring of pages read with a hint other than
+   * NORMAL_ACCESS, out of reach of the replacement policy
+   */
+  bool onRing;
+
   /**
    * Initialize buffer frame for a new user
    */
@@ -72,6 +120,8 @@ class BufDesc {
     dirty = false;
     refbit = false;
     valid = false;
+    loading = false;
+    onRing = false;
   };
 
   /**
@@ -89,6 +139,7 @@ class BufDesc {
     dirty = false;
     valid = true;
     refbit = true;
+    onRing = false;
   }
 
   void Print() {
@@ -101,6 +152,8 @@ class BufDesc {
     std::cout << "valid:" << valid << " ";
     std::cout << "pinCnt:" << pinCnt << " ";
     std::cout << "dirty:" << dirty << " ";
+    std::cout << "loading:" << loading << " ";
+    std::cout << "onRing:" << onRing << " ";
     std::cout << "refbit:" << refbit << "\n";
   }
 
@@ -115,19 +168,19 @@ class BufDesc {
  */
 struct BufStats {
   /**
-   * Total number of accesses to buffer pool
+   * Total number of pages read or allocated through the buffer pool
    */
-  int accesses;
+  std::atomic<int> accesses;
 
   /**
    * Number of pages read from disk (including allocs)
    */
-  int diskreads;
+  std::atomic<int> diskreads;
 
   /**
    * Number of pages written back to disk
    */
-  int diskwrites;
+  std::atomic<int> diskwrites;
 
   /**
    * Clear all values
@@ -143,14 +196,29 @@ struct BufStats {
 /**
  * @brief The central class which manages the buffer pool including frame
  * allocation and deallocation to pages in the file
+ *
+ * Any number of threads may call the methods of one BufMgr at once. A page is
+ * found through the partition of the hash table holding it, under the latch
+ * of that partition, and pinned under the latch of its frame before the
+ * partition latch is let go; a frame is only taken out of the hash table
+ * under both latches when unpinned, so a page found cannot be evicted before
+ * it is pinned. Partition latches are always taken before the replacement
+ * policy and frame latches, the policy before frame latches.
+ * Pinned pages are not latched: threads sharing a page must coordinate their
+ * own reads and writes of its contents.
+ *
+ * Frames without a page are kept on a free list; once it is empty, the
+ * replacement policy chosen at construction picks the page to evict. Pages
+ * read with a hint other than NORMAL_ACCESS are kept from the policy on a
+ * ring of their own, and evicted before any page the policy keeps, so that a
+ * scan of a large file does not push every other page out of the pool.
+ *
+ * A flusher thread writes dirty pages no longer in use in the background,
+ * so that the page evicted to make room for another is usually clean and
+ * the thread asking for a frame does not wait for a write.
  */
 class BufMgr {
  private:
-  /**
-   * Current position of clockhand in our buffer pool
-   */
-  FrameId clockHand;
-
   /**
    * Number of frames in the buffer pool
    */
@@ -173,19 +241,365 @@ class BufMgr {
   BufStats bufStats;
 
   /**
-   * Advance clock to next frame in the buffer pool
+   * Held shared to read and write pages already in their file, which any
+   * number of threads may do at once, and exclusively to allocate and delete
+   * pages and to write file headers: File objects change the header of their
+   * file, and the pages linked to the ones they allocate and delete, without
+   * latches of their own. Waiting for a file to reach the disk needs no latch.
    */
-  void advanceClock() { clockHand = (clockHand + 1) % numBufs; }
+  RWLatch ioLatch;
 
   /**
-   * Allocate a free frame.
+   * Held by insertRecord() and deleteRecord() throughout, so that no two of
+   * them change the same page at once. Taken before any other latch.
+   */
+  std::mutex recordLatch;
+
+  /**
+   * Chooses the pages to evict
+   */
+  ReplacementPolicy* policy;
+
+  /**
+   * Protects freeFrames. No other latch is taken while holding it.
+   */
+  std::mutex freeLatch;
+
+  /**
+   * Frames holding no page and not taken by any thread
+   */
+  std::vector<FrameId> freeFrames;
+
+  /**
+   * Protects ringFrames. Taken after partition latches and before frame
+   * latches.
+   */
+  std::mutex ringLatch;
+
+  /**
+   * Frames of the pages on the ring, oldest first
+   */
+  std::deque<FrameId> ringFrames;
+
+  /**
+   * Number of pages a scan keeps on the ring before it reuses their frames
+   */
+  std::size_t ringSize;
+
+  /**
+   * Protects pendingLoads. Taken after partition latches.
+   */
+  std::mutex pendingLatch;
+
+  /**
+   * Signalled whenever a page leaves pendingLoads
+   */
+  std::condition_variable pendingDone;
+
+  /**
+   * Pages missed by a thread still finding them a frame, not yet in the hash
+   * table
+   */
+  std::vector<std::pair<const File*, PageId>> pendingLoads;
+
+  /**
+   * Evicts the page in the frame, writing it out first if dirty. The frame
+   * is returned invalid but pinned once, as by allocBuf().
+   *
+   * @param frame   	Frame ID of the frame
+   * @return  False if the page was pinned or replaced meanwhile.
+   */
+  bool evictBuf(FrameId frame);
+
+  /**
+   * Evicts the oldest unpinned page on the ring, if the ring holds enough
+   * pages. The frame is returned as by allocBuf().
+   *
+   * @param frame   	Frame ID of the frame returned via this variable
+   * @param minPages  Number of pages the ring must hold
+   * @return  False if no page on the ring was evicted.
+   */
+  bool recycleRing(FrameId& frame, std::size_t minPages);
+
+  /**
+   * Takes the frame off the ring, if on it.
+   *
+   * @param frame   	Frame ID of the frame
+   */
+  void leaveRing(FrameId frame);
+
+  /**
+   * @brief Pages to read ahead, as asked for by prefetch().
+   */
+  struct PrefetchRequest {
+    File* file;
+    PageId pageNo;  // the page the chain has got to
+    int numPages;   // pages still to read ahead after it
+    bool atStart;   // true until the page the chain starts from is found
+    AccessHint hint;
+    std::function<PageId(PageId, const Page&)> nextPage;
+  };
+
+  /**
+   * Most requests waiting for the prefetcher; more are dropped
+   */
+  static const int MAXPREFETCHREQUESTS = 64;
+
+  /**
+   * Most requests the prefetcher works on at once, each with a page read in
+   * flight
+   */
+  static const std::size_t MAXPREFETCHACTIVE = 8;
+
+  /**
+   * Protects the prefetcher state below. No other latch is taken while
+   * holding it.
+   */
+  std::mutex prefetchLatch;
+
+  /**
+   * Signalled when a request is queued or the prefetcher is to stop
+   */
+  std::condition_variable prefetchReady;
+
+  /**
+   * Signalled when the prefetcher is done with a request
+   */
+  std::condition_variable prefetchDone;
+
+  /**
+   * Requests waiting for the prefetcher, oldest first
+   */
+  std::deque<PrefetchRequest> prefetchQueue;
+
+  /**
+   * Files of the requests the prefetcher is working on
+   */
+  std::vector<const File*> prefetchFiles;
+
+  /**
+   * Files whose requests the prefetcher is to give up
+   */
+  std::vector<const File*> prefetchCancelled;
+
+  /**
+   * True once the prefetcher is to stop
+   */
+  bool prefetchStop;
+
+  /**
+   * Thread reading pages ahead, started by the first request
+   */
+  std::thread prefetcher;
+
+  /**
+   * Body of the prefetcher thread: works through the requests until told to
+   * stop.
+   */
+  void prefetchLoop();
+
+  /**
+   * Takes every request one step: its chain is followed over the pages
+   * already in the pool, and the next page of every chain is read, all of
+   * them at once. Requests done with are removed.
+   *
+   * @param engine  Engine reading the pages
+   * @param active  Requests under way
+   */
+  void readAhead(IOEngine& engine, std::vector<PrefetchRequest>& active);
+
+  /**
+   * Follows the chain of the request over the pages in the pool.
+   *
+   * @param request  Request under way
+   * @return  True if the chain stopped at a page to read, false if the
+   * request is done with.
+   */
+  bool walkChain(PrefetchRequest& request);
+
+  /**
+   * Moves the request on from the page it has got to, which is pinned, and
+   * unpins it.
+   *
+   * @param request  Request under way
+   * @param page     The page the request has got to
+   * @return  False if the request is done with.
+   */
+  bool stepChain(PrefetchRequest& request, const Page& page);
+
+  /**
+   * Drops the requests for the file not yet started and waits for the one
+   * under way, if any.
+   *
+   * @param file   	File object
+   */
+  void cancelPrefetch(const File* file);
+
+  /**
+   * Most pages the flusher writes in one batch
+   */
+  static const std::size_t MAXFLUSHBATCH = 32;
+
+  /**
+   * Milliseconds the flusher sleeps between batches unless woken
+   */
+  static const int FLUSHINTERVALMS = 50;
+
+  /**
+   * Held while a batch of dirty pages is written, and by flushFile() and
+   * disposePage() so that they never find a page pinned by the writer.
+   * Taken before any other latch.
+   */
+  std::mutex flushBatchLatch;
+
+  /**
+   * Frame the next batch of the flusher starts looking from. Protected by
+   * flushBatchLatch.
+   */
+  FrameId flushHand;
+
+  /**
+   * Protects flusherStop. No other latch is taken while holding it.
+   */
+  std::mutex flusherLatch;
+
+  /**
+   * Writes the batches of dirty pages. Protected by flushBatchLatch.
+   */
+  std::unique_ptr<IOEngine> flushEngine;
+
+  /**
+   * Signalled when a dirty page had to be written to evict it, or the
+   * flusher is to stop
+   */
+  std::condition_variable flusherWake;
+
+  /**
+   * True once the flusher is to stop
+   */
+  bool flusherStop;
+
+  /**
+   * Thread writing dirty pages in the background
+   */
+  std::thread flusher;
+
+  /**
+   * Body of the flusher thread: writes batches of dirty pages until told to
+   * stop.
+   */
+  void flushLoop();
+
+  /**
+   * Writes dirty, unpinned pages to disk, in order of file and page number,
+   * leaving them in the buffer pool. Pinned pages and pages being read in are
+   * skipped.
+   *
+   * @param maxPages  Most pages to write
+   * @param coldOnly  True to skip pages referenced since the last call with
+   * coldOnly set, which are likely to be dirtied again soon
+   * @param syncFiles  True to sync the files written to once the pages are
+   * written
+   * @return  Number of pages written.
+   */
+  std::size_t writeDirtyPages(std::size_t maxPages, bool coldOnly,
+                              bool syncFiles);
+
+  /**
+   * Does the work of readPage() without counting it as an access.
+   *
+   * @param cachedOnly  True to leave a page not in the buffer pool, or still
+   * being read in, alone
+   * @return  False if the page was left alone.
+   */
+  bool fetchPage(File* file, const PageId pageNo, Page*& page,
+                 AccessHint hint, bool cachedOnly = false);
+
+  /**
+   * Gives a page not found in the buffer pool a frame to be read into. The
+   * page is put in the hash table, pinned and marked loading, so that threads
+   * asking for it meanwhile wait for it; the caller then reads it into the
+   * frame and calls endLoad(), or abortLoad() if the read failed. If another
+   * thread has read the page in first, it is pinned instead; a thread that
+   * missed the page too and is still finding it a frame is waited for, so
+   * only one frame is ever taken for the page.
+   *
+   * @param file   	File object
+   * @param pageNo  Page number in the file
+   * @param hint    How the page will be used
+   * @param frame   	Frame ID of the page returned via this variable
+   * @return  True if the page is to be read into the frame.
+   * @throws BufferExceededException If no frame can be had
+   */
+  bool beginLoad(File* file, const PageId pageNo, AccessHint hint,
+                 FrameId& frame);
+
+  /**
+   * Ends the claim beginLoad() put on a page missed, waking the threads
+   * waiting for it. The partition latch of the page must be held.
+   *
+   * @param miss  File and page number of the page
+   */
+  void settleMiss(const std::pair<const File*, PageId>& miss);
+
+  /**
+   * Marks the page read into the frame as there, for waiting threads.
+   *
+   * @param frame   	Frame ID of the frame
+   */
+  void endLoad(FrameId frame);
+
+  /**
+   * Takes a page that could not be read back out of the buffer pool, for
+   * waiting threads to find it gone and try again.
+   *
+   * @param file   	File object
+   * @param pageNo  Page number in the file
+   * @param frame   	Frame ID of the frame
+   */
+  void abortLoad(File* file, const PageId pageNo, FrameId frame);
+
+  /**
+   * Allocate a free frame. The frame is returned invalid but pinned once, so
+   * that no other thread takes it, and must be given a page with Set() or be
+   * released with releaseBuf().
    *
    * @param frame   	Frame reference, frame ID of allocated frame returned
    * via this variable
+   * @param hint    How the page to put in the frame will be used
    * @throws BufferExceededException If no such buffer is found which can be
    * allocated
    */
-  void allocBuf(FrameId& frame);
+  void allocBuf(FrameId& frame, AccessHint hint = NORMAL_ACCESS);
+
+  /**
+   * Gives back a frame returned by allocBuf() without using it.
+   *
+   * @param frame   	Frame ID of the frame
+   */
+  void releaseBuf(FrameId frame);
+
+  /**
+   * Puts a frame just cleared on the free list and tells the replacement
+   * policy its page is gone. No latch of the frame may be held.
+   *
+   * @param frame   	Frame ID of the frame
+   */
+  void freeFrame(FrameId frame);
+
+  /**
+   * Pins the page if it is in the buffer pool. The latch of its hash table
+   * partition must be held. A page on the ring asked for with NORMAL_ACCESS
+   * is handed to the replacement policy.
+   *
+   * @param file   	File object
+   * @param pageNo  Page number in the file
+   * @param frame   	Frame ID of the page returned via this variable
+   * @param hint    How the page will be used
+   * @return  True if the page was found and pinned.
+   */
+  bool pinIfPresent(File* file, const PageId pageNo, FrameId& frame,
+                    AccessHint hint);
 
  public:
   /**
@@ -195,8 +609,11 @@ class BufMgr {
 
   /**
    * Constructor of BufMgr class
+   *
+   * @param bufs        Number of frames in the buffer pool
+   * @param policyType  Replacement policy choosing the pages to evict
    */
-  BufMgr(std::uint32_t bufs);
+  BufMgr(std::uint32_t bufs, ReplacementPolicyType policyType = CLOCK_POLICY);
 
   /**
    * Destructor of BufMgr class
@@ -213,8 +630,35 @@ class BufMgr {
    * @param PageNo  Page number in the file to be read
    * @param page  	Reference to page pointer. Used to fetch the Page object
    * in which requested page from file is read in.
+   * @param hint    How the page will be used. Pages read with a hint other
+   * than NORMAL_ACCESS are evicted first, unless asked for again normally
+   * while still in the pool.
+   */
+  void readPage(File* file, const PageId PageNo, Page*& page,
+                AccessHint hint = NORMAL_ACCESS);
+
+  /**
+   * Asks for the pages following a page of the file to be read into the
+   * buffer pool in the background, so that they are there by the time a scan
+   * gets to them. The pages form a chain: each one is found from the page
+   * before it with nextPage, which is called in the prefetcher thread with
+   * that page pinned, must not throw and must return Page::INVALID_NUMBER at
+   * the end of the chain. It must not wait for any latch either, since the
+   * thread holding it may be waiting for a page the prefetcher is reading.
+   * The request may be dropped or cut short, and is at most a quarter of the
+   * pool, or half the ring for a hint other than NORMAL_ACCESS. A file with
+   * requests pending must be flushed with flushFile() before it is closed.
+   *
+   * @param file   	File object
+   * @param pageNo  Page number of the page the chain starts from, which is
+   * not read ahead itself
+   * @param numPages  Number of pages to read ahead
+   * @param hint    How the pages will be used
+   * @param nextPage  Returns the page number of the page after the given one
    */
-  void readPage(File* file, const PageId PageNo, Page*& page);
+  void prefetch(File* file, const PageId pageNo, int numPages,
+                AccessHint hint,
+                const std::function<PageId(PageId, const Page&)>& nextPage);
 
   /**
    * Unpin a page from memory since it is no longer required for it to remain in
@@ -241,9 +685,10 @@ class BufMgr {
   void allocPage(File* file, PageId& PageNo, Page*& page);
 
   /**
-   * Writes out all dirty pages of the file to disk.
+   * Writes out all dirty pages of the file to disk, and syncs the file.
    * All the frames assigned to the file need to be unpinned from buffer pool
    * before this function can be successfully called. Otherwise Error returned.
+   * Pages of the file still to be read ahead are no longer read.
    *
    * @param file   	File object
    * @throws  PagePinnedException If any page of the file is pinned in the
@@ -253,6 +698,12 @@ class BufMgr {
    */
   void flushFile(const File* file);
 
+  /**
+   * Writes out every dirty page in the buffer pool that is not pinned,
+   * leaving the pages in the pool, and syncs the files written to.
+   */
+  void checkpoint();
+
   /**
    * Delete page from file and also from buffer pool if present.
    * Since the page is entirely deleted from file, its unnecessary to see if the
@@ -263,6 +714,28 @@ class BufMgr {
    */
   void disposePage(File* file, const PageId PageNo);
 
+  /**
+   * Inserts a record into a page of the file with room for it, as found in
+   * the free-space map of the file, or into a new page if there is none. The
+   * free-space map is kept up to date with the page.
+   *
+   * @param file   	File object
+   * @param data    Bytes of the record
+   * @return  ID of the new record
+   * @throws  InsufficientSpaceException If the record does not fit even on an
+   * empty page
+   */
+  RecordId insertRecord(PageFile* file, const std::string& data);
+
+  /**
+   * Deletes a record from its page, and records the room it leaves in the
+   * free-space map of the file.
+   *
+   * @param file   	File object
+   * @param rid     ID of the record
+   */
+  void deleteRecord(PageFile* file, const RecordId& rid);
+
   /**
    * Print member variable values.
    */
@@ -277,6 +750,11 @@ class BufMgr {
    * Clear buffer pool usage statistics
    */
   void clearBufStats() { bufStats.clear(); }
+
+  /**
+   * Get the name of the replacement policy
+   */
+  const char* getPolicyName() const { return policy->name(); }
 };
 
 }  // namespace badgerdb
@@ -8,7 +8,15 @@
 
 #include "file.h"
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
 #include <cassert>
+#include <cerrno>
+#include <cstddef>
 #include <cstdio>
 #include <fstream>
 #include <iostream>
@@ -16,6 +24,7 @@
 #include <string>
 
 #include "exceptions/file_exists_exception.h"
+#include "exceptions/file_io_exception.h"
 #include "exceptions/file_not_found_exception.h"
 #include "exceptions/file_open_exception.h"
 #include "exceptions/invalid_page_exception.h"
@@ -24,8 +33,9 @@
 
 namespace badgerdb {
 
-File::StreamMap File::open_streams_;
+File::DescriptorMap File::open_descriptors_;
 File::CountMap File::open_counts_;
+File::HeaderMap File::open_headers_;
 
 void File::remove(const std::string& filename) {
   if (!exists(filename)) {
@@ -67,8 +77,10 @@ File::File(const std::string& name, const bool create_new) : filename_(name) {
   if (create_new) {
     // File starts with 1 page (the header).
     FileHeader header = {1 /* num_pages */, 0 /* first_used_page */,
-                         0 /* num_free_pages */, 0 /* first_free_page */};
+                         0 /* last_used_page */, 0 /* num_free_pages */,
+                         0 /* first_free_page */, 0 /* first_map_page */};
     writeHeader(header);
+    sync();
   }
 }
 
@@ -76,10 +88,10 @@ void File::openIfNeeded(const bool create_new) {
   if (open_counts_.find(filename_) !=
       open_counts_.end()) {  // exists an entry already
     ++open_counts_[filename_];
-    stream_ = open_streams_[filename_];
+    descriptor_ = open_descriptors_[filename_];
+    header_ = open_headers_[filename_];
   } else {
-    std::ios_base::openmode mode =
-        std::fstream::in | std::fstream::out | std::fstream::binary;
+    int flags = O_RDWR;
     const bool already_exists = exists(filename_);
     if (create_new) {
       // Error if we try to overwrite an existing file.
@@ -87,42 +99,292 @@ void File::openIfNeeded(const bool create_new) {
         throw FileExistsException(filename_);
       }
       // New files have to be truncated on open.
-      mode = mode | std::fstream::trunc;
+      flags |= O_CREAT | O_TRUNC;
     } else {
       // Error if we try to open a file that doesn't exist.
       if (!already_exists) {
         throw FileNotFoundException(filename_);
       }
     }
-    stream_.reset(new std::fstream(filename_, mode));
-    open_streams_[filename_] = stream_;
+    const int fd = ::open(filename_.c_str(), flags, 0666);
+    if (fd < 0) {
+      throw FileIOException(filename_, errno);
+    }
+    descriptor_.reset(new Descriptor(fd));
+
+    // read once, so that threads reading pages never change the header
+    header_.reset(new CachedHeader());
+    header_->dirty = false;
+    if (!create_new) {
+      readAt(&header_->header, sizeof(FileHeader), 0 /* offset */);
+      readFreeSpaceMap();
+    }
+    open_descriptors_[filename_] = descriptor_;
     open_counts_[filename_] = 1;
+    open_headers_[filename_] = header_;
   }
 }
 
 void File::close() {
+  // the last File object of the file writes out what is left. There is no
+  // one to report an error to, whoever cares syncs before
+  if (descriptor_ && open_counts_[filename_] == 1) {
+    try {
+      sync();
+    } catch (const FileIOException&) {
+    }
+  }
+
   if (open_counts_[filename_] > 0) --open_counts_[filename_];
 
-  stream_.reset();
+  descriptor_.reset();
+  header_.reset();
   assert(open_counts_[filename_] >= 0);
 
   if (open_counts_[filename_] == 0) {
-    open_streams_.erase(filename_);
+    open_descriptors_.erase(filename_);
     open_counts_.erase(filename_);
+    open_headers_.erase(filename_);
   }
 }
 
-FileHeader File::readHeader() const {
-  FileHeader header;
-  stream_->seekg(0 /* pos */, std::ios::beg);
-  stream_->read(reinterpret_cast<char*>(&header), sizeof(FileHeader));
-  return header;
+void File::sync() const {
+  writeMetadata();
+  syncData();
+}
+
+void File::writeMetadata() const {
+  // map pages first, so that the header never points at pages not yet written
+  if (header_->free_space.dirty) {
+    writeFreeSpaceMap();
+  }
+  if (header_->dirty) {
+    struct iovec iov = {&header_->header, sizeof(FileHeader)};
+    writeAt(&iov, 1, 0 /* offset */);
+    header_->dirty = false;
+  }
+}
+
+void File::syncData() const {
+  if (::fdatasync(descriptor_->fd) != 0) {
+    throw FileIOException(filename_, errno);
+  }
+}
+
+FileHeader File::readHeader() const { return header_->header; }
+
+void File::readFreeSpaceMap() {
+  FreeSpaceMap& map = header_->free_space;
+  std::vector<std::uint8_t> categories;
+  Page map_page;
+  for (PageId page_number = header_->header.first_map_page;
+       page_number != Page::INVALID_NUMBER;
+       page_number = map_page.next_page_number()) {
+    if (readAt(&map_page, Page::SIZE, pagePosition(page_number)) <
+        Page::SIZE) {
+      map_page.initialize();
+    }
+    map.map_pages.push_back(page_number);
+    // two categories to a byte, the lower page number in the low half
+    for (std::size_t i = 0; i < Page::DATA_SIZE; ++i) {
+      const std::uint8_t packed = map_page.data_[i];
+      categories.push_back(packed & 0x0f);
+      categories.push_back(packed >> 4);
+    }
+  }
+
+  // link the pages last to first, so that each list starts at its lowest page
+  map.categories.resize(categories.size());
+  map.next_in_category.resize(categories.size());
+  map.previous_in_category.resize(categories.size());
+  for (std::size_t page_number = categories.size(); page_number-- > 0;) {
+    if (categories[page_number] != 0) {
+      setFreeSpaceCategory(page_number, categories[page_number]);
+    }
+  }
+  map.dirty = false;
+}
+
+void File::setFreeSpaceCategory(const PageId page_number,
+                                const std::uint8_t category) {
+  FreeSpaceMap& map = header_->free_space;
+  const std::uint8_t old_category = map.categories[page_number];
+  if (old_category == category) {
+    return;
+  }
+  if (old_category != 0) {
+    const PageId previous = map.previous_in_category[page_number];
+    const PageId next = map.next_in_category[page_number];
+    if (previous != Page::INVALID_NUMBER) {
+      map.next_in_category[previous] = next;
+    } else {
+      map.first_in_category[old_category] = next;
+    }
+    if (next != Page::INVALID_NUMBER) {
+      map.previous_in_category[next] = previous;
+    }
+  }
+  if (category != 0) {
+    const PageId next = map.first_in_category[category];
+    map.next_in_category[page_number] = next;
+    map.previous_in_category[page_number] = Page::INVALID_NUMBER;
+    if (next != Page::INVALID_NUMBER) {
+      map.previous_in_category[next] = page_number;
+    }
+    map.first_in_category[category] = page_number;
+  }
+  map.categories[page_number] = category;
+  map.dirty = true;
+}
+
+void File::writeFreeSpaceMap() const {
+  FreeSpaceMap& map = header_->free_space;
+  Page map_page;
+  for (std::size_t k = 0; k < map.map_pages.size(); ++k) {
+    map_page.set_page_number(map.map_pages[k]);
+    map_page.set_next_page_number(k + 1 < map.map_pages.size()
+                                      ? map.map_pages[k + 1]
+                                      : Page::INVALID_NUMBER);
+    const std::uint8_t* categories = &map.categories[k * PAGES_PER_MAP_PAGE];
+    for (std::size_t i = 0; i < Page::DATA_SIZE; ++i) {
+      map_page.data_[i] = categories[2 * i] | (categories[2 * i + 1] << 4);
+    }
+    struct iovec iov = {&map_page, Page::SIZE};
+    writeAt(&iov, 1, pagePosition(map.map_pages[k]));
+  }
+  map.dirty = false;
 }
 
 void File::writeHeader(const FileHeader& header) {
-  stream_->seekp(0 /* pos */, std::ios::beg);
-  stream_->write(reinterpret_cast<const char*>(&header), sizeof(FileHeader));
-  stream_->flush();
+  header_->header = header;
+  header_->dirty = true;
+}
+
+std::size_t File::readAt(void* buf, std::size_t len, off_t offset) const {
+  char* pos = static_cast<char*>(buf);
+  std::size_t total = 0;
+  while (len > 0) {
+    const ssize_t n = ::pread(descriptor_->fd, pos, len, offset);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      throw FileIOException(filename_, errno);
+    }
+    if (n == 0) {
+      // end of the file, the rest of the buffer is left as it was
+      break;
+    }
+    pos += n;
+    len -= n;
+    offset += n;
+    total += n;
+  }
+  return total;
+}
+
+void File::writeAt(const struct iovec* iov, int count, off_t offset) const {
+  // a short write leaves the rest of the buffers to write again
+  struct iovec rest[2];
+  assert(count <= 2);
+  std::copy(iov, iov + count, rest);
+  struct iovec* next = rest;
+  while (count > 0) {
+    const ssize_t n = ::pwritev(descriptor_->fd, next, count, offset);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      throw FileIOException(filename_, errno);
+    }
+    offset += n;
+    std::size_t written = n;
+    while (count > 0 && written >= next->iov_len) {
+      written -= next->iov_len;
+      next++;
+      count--;
+    }
+    if (count > 0) {
+      next->iov_base = static_cast<char*>(next->iov_base) + written;
+      next->iov_len -= written;
+    }
+  }
+}
+
+Page File::allocatePage(PageId& new_page_number) {
+  Page new_page;
+  allocatePage(new_page_number, &new_page);
+  return new_page;
+}
+
+Page File::readPage(const PageId page_number) const {
+  Page page;
+  readPage(page_number, &page);
+  return page;
+}
+
+File::Descriptor::~Descriptor() { ::close(fd); }
+
+void File::setUpRequest(const PageId page_number, const bool write,
+                        IORequest* request) const {
+  request->fd = descriptor_->fd;
+  request->pageNo = page_number;
+  request->offset = pagePosition(page_number);
+  request->write = write;
+  request->result = 0;
+}
+
+void File::readPageAsync(IOEngine& engine, const PageId page_number,
+                         Page* page, IORequest* request) const {
+  setUpRequest(page_number, false /* write */, request);
+  request->iov[0].iov_base = page;
+  request->iov[0].iov_len = Page::SIZE;
+  request->iovcnt = 1;
+  engine.submit(request);
+}
+
+void File::readPageDone(const IORequest* request, Page* page) const {
+  if (request->result < 0) {
+    throw FileIOException(filename_, -request->result);
+  }
+  // a short read leaves the rest to read
+  std::size_t n = request->result;
+  if (n > 0 && n < Page::SIZE) {
+    n += readAt(reinterpret_cast<char*>(page) + n, Page::SIZE - n,
+                request->offset + n);
+  }
+  if (n < Page::SIZE) {
+    // past the end of the file, which holds no page there
+    page->initialize();
+  }
+}
+
+void File::writePageAsync(IOEngine& engine, const PageId page_number,
+                          const Page& new_page, IORequest* request) {
+  setUpRequest(page_number, true /* write */, request);
+  request->iov[0].iov_base = const_cast<Page*>(&new_page);
+  request->iov[0].iov_len = Page::SIZE;
+  request->iovcnt = 1;
+  engine.submit(request);
+}
+
+void File::writePageDone(const IORequest* request) const {
+  if (request->result < 0) {
+    throw FileIOException(filename_, -request->result);
+  }
+  // a short write leaves the rest to write
+  std::size_t skip = request->result;
+  struct iovec rest[2];
+  int count = 0;
+  for (int i = 0; i < request->iovcnt; i++) {
+    if (skip >= request->iov[i].iov_len) {
+      skip -= request->iov[i].iov_len;
+      continue;
+    }
+    rest[count].iov_base = static_cast<char*>(request->iov[i].iov_base) + skip;
+    rest[count].iov_len = request->iov[i].iov_len - skip;
+    skip = 0;
+    count++;
+  }
+  if (count > 0) {
+    writeAt(rest, count, request->offset + request->result);
+  }
 }
 
 PageFile PageFile::create(const std::string& filename) {
@@ -150,94 +412,54 @@ PageFile& PageFile::operator=(const PageFile& rhs) {
   return *this;
 }
 
-Page PageFile::allocatePage(PageId& new_page_number) {
+void PageFile::allocatePage(PageId& new_page_number, Page* new_page) {
   FileHeader header = readHeader();
-  Page new_page;
-  Page existing_page;
   if (header.num_free_pages > 0) {
-    new_page = readPage(header.first_free_page, true /* allow_free */);
-    new_page.set_page_number(header.first_free_page);
-    new_page_number = new_page.page_number();
-    header.first_free_page = new_page.next_page_number();
+    readPage(header.first_free_page, new_page, true /* allow_free */);
+    new_page->set_page_number(header.first_free_page);
+    header.first_free_page = new_page->next_page_number();
     --header.num_free_pages;
 
-    if (header.first_used_page == Page::INVALID_NUMBER ||
-        header.first_used_page > new_page.page_number()) {
-      // Either have no pages used or the head of the used list is a page later
-      // than the one we just allocated, so add the new page to the head.
-      if (header.first_used_page > new_page.page_number()) {
-        new_page.set_next_page_number(header.first_used_page);
-      }
-      header.first_used_page = new_page.page_number();
-    } else {
-      // New page is reused from somewhere after the beginning, so we need to
-      // find where in the used list to insert it.
-      PageId next_page_number = Page::INVALID_NUMBER;
-      for (FileIterator iter = begin(); iter != end(); ++iter) {
-        next_page_number = (*iter).next_page_number();
-        if (next_page_number > new_page.page_number() ||
-            next_page_number == Page::INVALID_NUMBER) {
-          existing_page = *iter;
-          break;
-        }
-      }
-      existing_page.set_next_page_number(new_page.page_number());
-      new_page.set_next_page_number(next_page_number);
-    }
-
     assert((header.num_free_pages == 0) ==
            (header.first_free_page == Page::INVALID_NUMBER));
   } else {
-    new_page.set_page_number(header.num_pages);
-    new_page_number = new_page.page_number();
-
-    if (header.first_used_page == Page::INVALID_NUMBER) {
-      header.first_used_page = new_page.page_number();
-    } else {
-      // If we have pages allocated, we need to add the new page to the tail
-      // of the linked list.
-      for (FileIterator iter = begin(); iter != end(); ++iter) {
-        if ((*iter).next_page_number() == Page::INVALID_NUMBER) {
-          existing_page = *iter;
-          break;
-        }
-      }
-      assert(existing_page.isUsed());
-      existing_page.set_next_page_number(new_page.page_number());
-    }
+    new_page->initialize();
+    new_page->set_page_number(header.num_pages);
     ++header.num_pages;
   }
-  writePage(new_page_number, new_page.header_, new_page);
-  if (existing_page.page_number() != Page::INVALID_NUMBER) {
-    // If we updated an existing page by inserting the new page into the
-    // used list, we need to write it out.
-    writePage(existing_page.page_number(), existing_page.header_,
-              existing_page);
+  new_page_number = new_page->page_number();
+
+  // Link the new page in at the tail of the used list, which takes updating
+  // only the page that was last.
+  new_page->set_next_page_number(Page::INVALID_NUMBER);
+  if (header.first_used_page == Page::INVALID_NUMBER) {
+    header.first_used_page = new_page_number;
+  } else {
+    writeNextPageNumber(header.last_used_page, new_page_number);
   }
-  writeHeader(header);
+  header.last_used_page = new_page_number;
 
-  return new_page;
+  writePage(new_page_number, new_page->header_, *new_page);
+  writeHeader(header);
 }
 
-Page PageFile::readPage(const PageId page_number) const {
+void PageFile::readPage(const PageId page_number, Page* page) const {
   FileHeader header = readHeader();
 
   if (page_number >= header.num_pages) {
     throw InvalidPageException(page_number, filename_);
   }
-  return readPage(page_number, false /* allow_free */);
+  readPage(page_number, page, false /* allow_free */);
 }
 
-Page PageFile::readPage(const PageId page_number, const bool allow_free) const {
-  Page page;
-  stream_->seekg(pagePosition(page_number), std::ios::beg);
-  stream_->read(reinterpret_cast<char*>(&page.header_), sizeof(PageHeader));
-  stream_->read(&page.data_[0], Page::DATA_SIZE);
-  if (!allow_free && !page.isUsed()) {
+void PageFile::readPage(const PageId page_number, Page* page,
+                        const bool allow_free) const {
+  if (readAt(page, Page::SIZE, pagePosition(page_number)) < Page::SIZE) {
+    page->initialize();
+  }
+  if (!allow_free && !page->isUsed()) {
     throw InvalidPageException(page_number, filename_);
   }
-
-  return page;
 }
 
 void PageFile::writePage(const PageId new_page_number, const Page& new_page) {
@@ -258,35 +480,126 @@ void PageFile::writePage(const PageId new_page_number, const Page& new_page) {
 void PageFile::deletePage(const PageId page_number) {
   FileHeader header = readHeader();
 
-  Page existing_page = readPage(page_number);
-  Page previous_page;
+  if (page_number >= header.num_pages) {
+    throw InvalidPageException(page_number, filename_);
+  }
+  // Pages of the free-space map are not on the used list.
+  const std::vector<PageId>& map_pages = header_->free_space.map_pages;
+  PageHeader existing_header = readPageHeader(page_number);
+  if (existing_header.current_page_number == Page::INVALID_NUMBER ||
+      std::find(map_pages.begin(), map_pages.end(), page_number) !=
+          map_pages.end()) {
+    throw InvalidPageException(page_number, filename_);
+  }
   // If this page is the head of the used list, update the header to point to
   // the next page in line.
+  PageId previous_page_number = Page::INVALID_NUMBER;
   if (page_number == header.first_used_page) {
-    header.first_used_page = existing_page.next_page_number();
+    header.first_used_page = existing_header.next_page_number;
   } else {
     // Walk the used list so we can update the page that points to this one.
-    for (FileIterator iter = begin(); iter != end(); ++iter) {
-      previous_page = *iter;
-      if (previous_page.next_page_number() == existing_page.page_number()) {
-        previous_page.set_next_page_number(existing_page.next_page_number());
-        break;
-      }
-    }
+    previous_page_number = usedPageBefore(page_number);
+    writeNextPageNumber(previous_page_number,
+                        existing_header.next_page_number);
+  }
+  if (page_number == header.last_used_page) {
+    header.last_used_page = previous_page_number;
+  }
+  // A free page has no room for records until it is allocated again.
+  if (page_number < header_->free_space.categories.size()) {
+    setFreeSpaceCategory(page_number, 0);
   }
   // Clear the page and add it to the head of the free list.
-  existing_page.initialize();
+  Page existing_page;
   existing_page.set_next_page_number(header.first_free_page);
   header.first_free_page = page_number;
   ++header.num_free_pages;
-  if (previous_page.isUsed()) {
-    writePage(previous_page.page_number(), previous_page.header_,
-              previous_page);
-  }
   writePage(page_number, existing_page.header_, existing_page);
   writeHeader(header);
 }
 
+PageId PageFile::findPageWithSpace(const std::size_t record_size) const {
+  const FreeSpaceMap& map = header_->free_space;
+  // Round up, so that any page in the category has room; even an empty record
+  // needs a page in a category above zero.
+  std::size_t needed = (record_size + FREE_SPACE_UNIT - 1) / FREE_SPACE_UNIT;
+  if (needed == 0) needed = 1;
+  // The smallest category with room, to keep the roomier pages for bigger
+  // records.
+  for (std::size_t category = needed; category < FREE_SPACE_CATEGORIES;
+       ++category) {
+    if (map.first_in_category[category] != Page::INVALID_NUMBER) {
+      return map.first_in_category[category];
+    }
+  }
+  return Page::INVALID_NUMBER;
+}
+
+void PageFile::updateFreeSpace(const Page& page) {
+  FreeSpaceMap& map = header_->free_space;
+  const PageId page_number = page.page_number();
+  // A new record may need a new slot as well as its bytes.
+  const std::size_t free_space = page.getFreeSpace();
+  const std::size_t room =
+      free_space > sizeof(PageSlot) ? free_space - sizeof(PageSlot) : 0;
+  std::size_t category = room / FREE_SPACE_UNIT;
+  if (category >= FREE_SPACE_CATEGORIES) {
+    category = FREE_SPACE_CATEGORIES - 1;
+  }
+
+  if (page_number >= map.categories.size()) {
+    // The map grows by whole pages at the end of the file.
+    FileHeader header = readHeader();
+    while (page_number >= map.categories.size()) {
+      const PageId map_page_number = header.num_pages++;
+      if (map.map_pages.empty()) {
+        header.first_map_page = map_page_number;
+      }
+      map.map_pages.push_back(map_page_number);
+      const std::size_t covered = map.categories.size() + PAGES_PER_MAP_PAGE;
+      map.categories.resize(covered);
+      map.next_in_category.resize(covered);
+      map.previous_in_category.resize(covered);
+    }
+    writeHeader(header);
+    map.dirty = true;
+  }
+  setFreeSpaceCategory(page_number, category);
+}
+
+void PageFile::readPageAsync(IOEngine& engine, const PageId page_number,
+                             Page* page, IORequest* request) const {
+  if (page_number >= readHeader().num_pages) {
+    throw InvalidPageException(page_number, filename_);
+  }
+  File::readPageAsync(engine, page_number, page, request);
+}
+
+void PageFile::readPageDone(const IORequest* request, Page* page) const {
+  File::readPageDone(request, page);
+  if (!page->isUsed()) {
+    throw InvalidPageException(request->pageNo, filename_);
+  }
+}
+
+void PageFile::writePageAsync(IOEngine& engine, const PageId page_number,
+                              const Page& new_page, IORequest* request) {
+  // as writePage(), keeping the next page pointer on disk
+  PageHeader header = readPageHeader(page_number);
+  if (header.current_page_number == Page::INVALID_NUMBER) {
+    throw InvalidPageException(page_number, filename_);
+  }
+  setUpRequest(page_number, true /* write */, request);
+  request->header = new_page.header_;
+  request->header.next_page_number = header.next_page_number;
+  request->iov[0].iov_base = &request->header;
+  request->iov[0].iov_len = sizeof(PageHeader);
+  request->iov[1].iov_base = const_cast<char*>(&new_page.data_[0]);
+  request->iov[1].iov_len = Page::DATA_SIZE;
+  request->iovcnt = 2;
+  engine.submit(request);
+}
+
 FileIterator PageFile::begin() {
   const FileHeader& header = readHeader();
   return FileIterator(this, header.first_used_page);
@@ -298,19 +611,37 @@ FileIterator PageFile::end() {
 
 void PageFile::writePage(const PageId page_number, const PageHeader& header,
                          const Page& new_page) {
-  stream_->seekp(pagePosition(page_number), std::ios::beg);
-  stream_->write(reinterpret_cast<const char*>(&header), sizeof(PageHeader));
-  stream_->write(&new_page.data_[0], Page::DATA_SIZE);
-  stream_->flush();
+  // header and data straight from where they are, in one call
+  struct iovec iov[2] = {
+      {const_cast<PageHeader*>(&header), sizeof(PageHeader)},
+      {const_cast<char*>(&new_page.data_[0]), Page::DATA_SIZE}};
+  writeAt(iov, 2, pagePosition(page_number));
 }
 
 PageHeader PageFile::readPageHeader(PageId page_number) const {
   PageHeader header;
-  stream_->seekg(pagePosition(page_number), std::ios::beg);
-  stream_->read(reinterpret_cast<char*>(&header), sizeof(PageHeader));
+  readAt(&header, sizeof(PageHeader), pagePosition(page_number));
   return header;
 }
 
+void PageFile::writeNextPageNumber(const PageId page_number,
+                                   const PageId next_page_number) {
+  struct iovec iov = {const_cast<PageId*>(&next_page_number), sizeof(PageId)};
+  writeAt(&iov, 1,
+          pagePosition(page_number) + offsetof(PageHeader, next_page_number));
+}
+
+PageId PageFile::usedPageBefore(const PageId page_number) const {
+  PageId current_page_number = readHeader().first_used_page;
+  PageHeader header = readPageHeader(current_page_number);
+  while (header.next_page_number != page_number &&
+         header.next_page_number != Page::INVALID_NUMBER) {
+    current_page_number = header.next_page_number;
+    header = readPageHeader(current_page_number);
+  }
+  return current_page_number;
+}
+
 BlobFile BlobFile::create(const std::string& filename) {
   return BlobFile(filename, true /* create_new */);
 }
@@ -330,41 +661,39 @@ BlobFile::BlobFile(const BlobFile& other)
 BlobFile& BlobFile::operator=(const BlobFile& rhs) {
   // This accounts for self-assignment and assignment of a File object for the
   // same file.
+  mapping_.reset();
   close();  // close my file and associate me with the new one
   filename_ = rhs.filename_;
   openIfNeeded(false /* create_new */);
   return *this;
 }
 
-Page BlobFile::allocatePage(PageId& new_page_number) {
+void BlobFile::allocatePage(PageId& new_page_number, Page* new_page) {
   FileHeader header = readHeader();
-  Page new_page;
+  new_page->initialize();
 
   new_page_number = header.num_pages;
 
   if (header.first_used_page == Page::INVALID_NUMBER) {
     header.first_used_page = header.num_pages;
   }
+  header.last_used_page = header.num_pages;
 
   ++header.num_pages;
 
-  writePage(new_page_number, new_page);
+  writePage(new_page_number, *new_page);
   writeHeader(header);
-
-  return new_page;
 }
 
-Page BlobFile::readPage(const PageId page_number) const {
-  Page page;
-  stream_->seekg(pagePosition(page_number), std::ios::beg);
-  stream_->read(reinterpret_cast<char*>(&page), Page::SIZE);
-  return page;
+void BlobFile::readPage(const PageId page_number, Page* page) const {
+  if (readAt(page, Page::SIZE, pagePosition(page_number)) < Page::SIZE) {
+    page->initialize();
+  }
 }
 
 void BlobFile::writePage(const PageId new_page_number, const Page& new_page) {
-  stream_->seekp(pagePosition(new_page_number), std::ios::beg);
-  stream_->write(reinterpret_cast<const char*>(&new_page), Page::SIZE);
-  stream_->flush();
+  struct iovec iov = {const_cast<Page*>(&new_page), Page::SIZE};
+  writeAt(&iov, 1, pagePosition(new_page_number));
 }
 
 // delePage should not be called for a blob_file, not supported
@@ -372,4 +701,54 @@ void BlobFile::deletePage(const PageId page_number) {
   throw InvalidPageException(page_number, filename_);
 }
 
+void BlobFile::map() {
+  if (mapping_) {
+    return;
+  }
+  struct stat status;
+  if (::fstat(descriptor_->fd, &status) != 0) {
+    throw FileIOException(filename_, errno);
+  }
+  // pages past the end of the file would fault when touched
+  std::size_t size = std::min<off_t>(status.st_size,
+                                     pagePosition(header_->header.num_pages));
+  void* addr = ::mmap(NULL, size, PROT_READ, MAP_SHARED, descriptor_->fd, 0);
+  if (addr == MAP_FAILED) {
+    throw FileIOException(filename_, errno);
+  }
+  mapping_.reset(new Mapping(static_cast<const char*>(addr), size));
+}
+
+const Page* BlobFile::mappedPage(const PageId page_number) const {
+  if (!mapping_ || page_number == Page::INVALID_NUMBER ||
+      pagePosition(page_number) + Page::SIZE > mapping_->size) {
+    throw InvalidPageException(page_number, filename_);
+  }
+  return reinterpret_cast<const Page*>(mapping_->addr +
+                                       pagePosition(page_number));
+}
+
+void BlobFile::adviseSequential(const PageId first_page,
+                                const PageId num_pages) const {
+  if (!mapping_ || first_page == Page::INVALID_NUMBER) {
+    return;
+  }
+  std::size_t begin = pagePosition(first_page);
+  std::size_t end =
+      std::min<std::size_t>(pagePosition(first_page + num_pages),
+                            mapping_->size);
+  if (begin >= end) {
+    return;
+  }
+  // advice is given for whole pages of memory
+  begin -= begin % ::sysconf(_SC_PAGESIZE);
+  char* addr = const_cast<char*>(mapping_->addr) + begin;
+  ::madvise(addr, end - begin, MADV_SEQUENTIAL);
+  ::madvise(addr, end - begin, MADV_WILLNEED);
+}
+
+BlobFile::Mapping::~Mapping() {
+  ::munmap(const_cast<char*>(addr), size);
+}
+
 }  // namespace badgerdb
@@ -8,11 +8,16 @@
 
 #pragma once
 
-#include <fstream>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#include <cstdint>
 #include <map>
 #include <memory>
 #include <string>
+#include <vector>
 
+#include "io_engine.h"
 #include "page.h"
 
 namespace badgerdb {
@@ -33,6 +38,12 @@ struct FileHeader {
    */
   PageId first_used_page;
 
+  /**
+   * Page number of the last used page in the file, after which new pages are
+   * linked into the list of used pages.
+   */
+  PageId last_used_page;
+
   /**
    * Number of free pages (allocated but unused) in the file.
    */
@@ -43,6 +54,11 @@ struct FileHeader {
    */
   PageId first_free_page;
 
+  /**
+   * Page number of the first page of the free-space map, 0 if there is none.
+   */
+  PageId first_map_page;
+
   /**
    * Returns true if this file header is equal to the other.
    *
@@ -52,7 +68,9 @@ struct FileHeader {
   bool operator==(const FileHeader& rhs) const {
     return num_pages == rhs.num_pages && num_free_pages == rhs.num_free_pages &&
            first_used_page == rhs.first_used_page &&
-           first_free_page == rhs.first_free_page;
+           last_used_page == rhs.last_used_page &&
+           first_free_page == rhs.first_free_page &&
+           first_map_page == rhs.first_map_page;
   }
 };
 
@@ -60,16 +78,24 @@ struct FileHeader {
  * @brief Class which represents a file in the filesystem containing database
  *        pages.
  *
- * The File class wraps a stream to an underlying file on disk.  Files contain
- * fixed-sized pages, and they never deallocate space (though they do reuse
- * deleted pages if possible).  If multiple File objects refer to the same
- * underlying file, they will share the stream in memory.
+ * The File class wraps a descriptor of an underlying file on disk, which it
+ * reads and writes at given positions with pread() and pwrite().  Files
+ * contain fixed-sized pages, and they never deallocate space (though they do
+ * reuse deleted pages if possible).  If multiple File objects refer to the
+ * same underlying file, they will share the descriptor.
  * If a file that has already been opened (possibly by another query), then the
- * File class detects this (by looking in the open_streams_ map) and just
- * returns a file object with the already created stream for the file without
- * actually opening the UNIX file again.
+ * File class detects this (by looking in the open_descriptors_ map) and just
+ * returns a file object with the already opened descriptor for the file
+ * without actually opening the UNIX file again.
+ *
+ * The file header is kept in memory, shared like the descriptor, and written
+ * to disk only when sync() is called or the last File object of the file is
+ * closed. Closing cannot report errors, so sync() before the last File object
+ * goes to find out about them.
  *
- * @warning This class is not threadsafe.
+ * @warning This class is not threadsafe, except that pages of a file may be
+ * read and written, each page by one thread at a time, by several threads at
+ * once while no thread allocates or deletes pages or writes the header.
  */
 
 class File {
@@ -111,16 +137,35 @@ class File {
 
   /**
    * Destructor that automatically closes the underlying file if no other
-   * File objects are using it.
+   * File objects are using it. The file is synced first, ignoring errors.
    */
   virtual ~File();
 
+  /**
+   * Allocates a new page in the file.
+   *
+   * @param new_page_number   Set to the number of the new page.
+   * @param new_page          Set to the new page, in place.
+   */
+  virtual void allocatePage(PageId& new_page_number, Page* new_page) = 0;
+
   /**
    * Allocates a new page in the file.
    *
    * @return The new page.
    */
-  virtual Page allocatePage(PageId& new_page_number) = 0;
+  Page allocatePage(PageId& new_page_number);
+
+  /**
+   * Reads an existing page from the file straight into the given page, such
+   * as a frame of the buffer pool.
+   *
+   * @param page_number   Number of page to read.
+   * @param page          Page to read into.
+   * @throws  InvalidPageException  If the page doesn't exist in the file or is
+   *                                not currently used.
+   */
+  virtual void readPage(const PageId page_number, Page* page) const = 0;
 
   /**
    * Reads an existing page from the file.
@@ -130,7 +175,7 @@ class File {
    * @throws  InvalidPageException  If the page doesn't exist in the file or is
    *                                not currently used.
    */
-  virtual Page readPage(const PageId page_number) const = 0;
+  Page readPage(const PageId page_number) const;
 
   /**
    * Writes a page into the file at the given page number.
@@ -148,6 +193,50 @@ class File {
    */
   virtual void deletePage(const PageId page_number) = 0;
 
+  /**
+   * Starts reading a page through the engine. Once the engine has completed
+   * the request, readPageDone() finishes the read.
+   *
+   * @param engine        Engine to read with.
+   * @param page_number   Number of page to read.
+   * @param page          Page to read into, left alone until then.
+   * @param request       Request for the read, left alone until then.
+   * @throws  InvalidPageException  If the page doesn't exist in the file.
+   */
+  virtual void readPageAsync(IOEngine& engine, const PageId page_number,
+                             Page* page, IORequest* request) const;
+
+  /**
+   * Finishes a read started by readPageAsync().
+   *
+   * @param request   Request completed by the engine.
+   * @param page      Page read into.
+   * @throws  InvalidPageException  If the page is not currently used.
+   * @throws  FileIOException       If the read failed.
+   */
+  virtual void readPageDone(const IORequest* request, Page* page) const;
+
+  /**
+   * Starts writing a page through the engine. Once the engine has completed
+   * the request, writePageDone() finishes the write.
+   *
+   * @param engine        Engine to write with.
+   * @param page_number   Number of page whose contents to replace.
+   * @param new_page      Page to write, left alone until then.
+   * @param request       Request for the write, left alone until then.
+   * @throws  InvalidPageException  If the page has been deleted.
+   */
+  virtual void writePageAsync(IOEngine& engine, const PageId page_number,
+                              const Page& new_page, IORequest* request);
+
+  /**
+   * Finishes a write started by writePageAsync().
+   *
+   * @param request   Request completed by the engine.
+   * @throws  FileIOException  If the write failed.
+   */
+  void writePageDone(const IORequest* request) const;
+
   /**
    * Returns the name of the file this object represents.
    *
@@ -162,6 +251,24 @@ class File {
    */
   PageId getFirstPageNo();
 
+  /**
+   * Writes the free-space map and the file header, if changed, and waits for
+   * everything written to the file to reach the disk.
+   */
+  void sync() const;
+
+  /**
+   * Writes the free-space map and the file header, if changed. The first half
+   * of sync(), which reads what allocating and deleting pages change.
+   */
+  void writeMetadata() const;
+
+  /**
+   * Waits for everything written to the file to reach the disk. The second
+   * half of sync(), which may run alongside any other operation on the file.
+   */
+  void syncData() const;
+
  protected:
   /**
    * Returns the position of the page with the given number in the file (as an
@@ -170,27 +277,29 @@ class File {
    * @param page_number   Number of page.
    * @return  Position of page in file.
    */
-  static std::streampos pagePosition(const PageId page_number) {
+  static off_t pagePosition(const PageId page_number) {
     return sizeof(FileHeader) + ((page_number - 1) * Page::SIZE);
   }
 
   /**
    * Opens the underlying file named in filename_.
    * This method only opens the file if no other File objects exist that access
-   * the same filesystem file; otherwise, it reuses the existing stream.
+   * the same filesystem file; otherwise, it reuses the existing descriptor.
    *
    * @param create_new  Whether to create a new file.
    * @throws  FileExistsException     If the underlying file exists and
    *                                  create_new is true.
    * @throws  FileNotFoundException   If the underlying file doesn't exist and
    *                                  create_new is false.
+   * @throws  FileIOException         If the file cannot be opened.
    */
   void openIfNeeded(const bool create_new);
 
   /**
-   * Closes the underlying file stream in <stream_>.
+   * Closes the underlying file descriptor in <descriptor_>.
    * This method only closes the file if no other File objects exist that access
-   * the same file.
+   * the same file, syncing it first. It never throws, since it runs from the
+   * destructor.
    */
   void close();
 
@@ -202,34 +311,201 @@ class File {
   FileHeader readHeader() const;
 
   /**
-   * Writes the given header to the disk as the header for this file.
+   * Sets the header for this file. It is written to disk by sync().
    *
    * @param header  File header to write.
    */
   void writeHeader(const FileHeader& header);
 
-  typedef std::map<std::string, std::shared_ptr<std::fstream> > StreamMap;
+  /**
+   * Reads from the file at the given position, until len bytes are read or
+   * the end of the file is reached.
+   *
+   * @param buf     Buffer to read into.
+   * @param len     Number of bytes to read.
+   * @param offset  Position in the file to read from.
+   * @return  Number of bytes read.
+   * @throws  FileIOException  If the read fails.
+   */
+  std::size_t readAt(void* buf, std::size_t len, off_t offset) const;
+
+  /**
+   * Sets up a request for the given page.
+   *
+   * @param page_number   Number of page.
+   * @param write         True for a write, false for a read.
+   * @param request       Request to set up.
+   */
+  void setUpRequest(const PageId page_number, const bool write,
+                    IORequest* request) const;
+
+  /**
+   * Writes to the file at the given position, one buffer after another.
+   *
+   * @param iov     Buffers to write.
+   * @param count   Number of buffers.
+   * @param offset  Position in the file to write to.
+   * @throws  FileIOException  If the write fails.
+   */
+  void writeAt(const struct iovec* iov, int count, off_t offset) const;
+
+  /**
+   * @brief Descriptor of an open file, closed once no File object uses it.
+   */
+  class Descriptor {
+   public:
+    /**
+     * Takes over the given file descriptor.
+     */
+    explicit Descriptor(int fd) : fd(fd) {}
+
+    /**
+     * Closes the file descriptor.
+     */
+    ~Descriptor();
+
+    /**
+     * The file descriptor
+     */
+    const int fd;
+
+   private:
+    Descriptor(const Descriptor&) = delete;
+    Descriptor& operator=(const Descriptor&) = delete;
+  };
+
+  /**
+   * Number of categories of room for records a page can be in, for the
+   * free-space map
+   */
+  static const int FREE_SPACE_CATEGORIES = 16;
+
+  /**
+   * Bytes of room for records each category of the free-space map stands for
+   */
+  static const std::size_t FREE_SPACE_UNIT =
+      Page::DATA_SIZE / FREE_SPACE_CATEGORIES;
+
+  /**
+   * Number of pages one page of the free-space map has the categories of, two
+   * to a byte
+   */
+  static const PageId PAGES_PER_MAP_PAGE = Page::DATA_SIZE * 2;
+
+  /**
+   * @brief Free-space map of an open file: the category of room for records
+   * of every page, kept on disk in pages of the file outside the list of used
+   * pages. In memory, the pages of each category above zero are also linked
+   * in a list of their own, so that a page with room is found without a
+   * search.
+   */
+  struct FreeSpaceMap {
+    /**
+     * Category of every page the map pages cover, by page number
+     */
+    std::vector<std::uint8_t> categories;
+
+    /**
+     * Pages of the file holding the map, in order
+     */
+    std::vector<PageId> map_pages;
+
+    /**
+     * Next page in the list of the category of each page, by page number
+     */
+    std::vector<PageId> next_in_category;
+
+    /**
+     * Previous page in the list of the category of each page, by page number
+     */
+    std::vector<PageId> previous_in_category;
+
+    /**
+     * First page of the list of each category, Page::INVALID_NUMBER (zero)
+     * for an empty list
+     */
+    PageId first_in_category[FREE_SPACE_CATEGORIES];
+
+    /**
+     * True if the map has changed since it was last synced
+     */
+    bool dirty;
+  };
+
+  /**
+   * @brief Header of an open file, as last read or written, and its
+   * free-space map.
+   */
+  struct CachedHeader {
+    /**
+     * The header
+     */
+    FileHeader header;
+
+    /**
+     * True if the header has been written since it was last synced
+     */
+    bool dirty;
+
+    /**
+     * The free-space map
+     */
+    FreeSpaceMap free_space;
+  };
+
+  /**
+   * Reads the free-space map from the pages of the file holding it.
+   */
+  void readFreeSpaceMap();
+
+  /**
+   * Sets the category of a page covered by the free-space map, moving the
+   * page to the list of the new category.
+   *
+   * @param page_number   Number of the page.
+   * @param category      Category of room for records.
+   */
+  void setFreeSpaceCategory(const PageId page_number,
+                            const std::uint8_t category);
+
+  /**
+   * Writes the free-space map to the pages of the file holding it.
+   */
+  void writeFreeSpaceMap() const;
+
+  typedef std::map<std::string, std::shared_ptr<Descriptor> > DescriptorMap;
   typedef std::map<std::string, int> CountMap;
+  typedef std::map<std::string, std::shared_ptr<CachedHeader> > HeaderMap;
 
   /**
-   * Streams for opened files.
+   * Descriptors of opened files.
    */
-  static StreamMap open_streams_;
+  static DescriptorMap open_descriptors_;
 
   /**
    * Counts for opened files.
    */
   static CountMap open_counts_;
 
+  /**
+   * Headers of opened files.
+   */
+  static HeaderMap open_headers_;
+
   /**
    * Name of the file this object represents.
    */
   std::string filename_;
 
   /**
-   * Stream for underlying filesystem object.
+   * Descriptor of underlying filesystem object.
    */
-  std::shared_ptr<std::fstream> stream_;
+  std::shared_ptr<Descriptor> descriptor_;
+
+  /**
+   * Header of the underlying file, shared by all File objects of the file.
+   */
+  std::shared_ptr<CachedHeader> header_;
 
   friend class FileIterator;
 };
@@ -247,12 +523,12 @@ class PageFile : public File {
   /**
    * Opens the file named fileName and returns the corresponding File object.
    * It first checks if the file is already open. If so, then the new File
-   * object created uses the same input-output stream to read to or write fom
+   * object created uses the same file descriptor to read to or write fom
    * that already open file. Reference count (open_counts_ static variable
    * inside the File object) is incremented whenever an already open file is
    * opened again. Otherwise the UNIX file is actually opened. The fileName and
-   * the stream associated with this File object are inserted into the
-   * open_streams_ map.
+   * the descriptor associated with this File object are inserted into the
+   * open_descriptors_ map.
    *
    * @param filename  Name of the file.
    * @throws  FileNotFoundException   If the requested file doesn't exist.
@@ -289,26 +565,32 @@ class PageFile : public File {
 
   /**
    * Destructor that automatically closes the underlying file if no other
-   * File objects are using it.
+   * File objects are using it. The file is synced first, ignoring errors.
    */
   ~PageFile();
 
+  using File::allocatePage;
+  using File::readPage;
+
   /**
-   * Allocates a new page in the file.
+   * Allocates a new page in the file, reusing a free page if there is one.
+   * The new page is linked in at the end of the list of used pages, so pages
+   * are iterated over in the order they were allocated.
    *
-   * @return The new page.
+   * @param new_page_number   Set to the number of the new page.
+   * @param new_page          Set to the new page, in place.
    */
-  Page allocatePage(PageId& new_page_number) override;
+  void allocatePage(PageId& new_page_number, Page* new_page) override;
 
   /**
-   * Reads an existing page from the file.
+   * Reads an existing page from the file into the given page.
    *
    * @param page_number   Number of page to read.
-   * @return  The page.
+   * @param page          Page to read into.
    * @throws  InvalidPageException  If the page doesn't exist in the file or is
    *                                not currently used.
    */
-  Page readPage(const PageId page_number) const override;
+  void readPage(const PageId page_number, Page* page) const override;
 
   /**
    * Writes a page into the file at the given page number.
@@ -326,6 +608,34 @@ class PageFile : public File {
    */
   void deletePage(const PageId page_number) override;
 
+  /**
+   * Finds a page that the free-space map says has room for a record of the
+   * given size: the first page of the smallest category with room, found in
+   * constant time from the lists of the categories.
+   *
+   * @param record_size   Size of the record in bytes.
+   * @return  Number of the page, or Page::INVALID_NUMBER if no page is known
+   *          to have room.
+   */
+  PageId findPageWithSpace(const std::size_t record_size) const;
+
+  /**
+   * Records in the free-space map how much room for records the given page
+   * has, growing the map if it does not cover the page yet.  The map is
+   * written to disk by sync().
+   *
+   * @param page  Used page of this file, as it is now.
+   */
+  void updateFreeSpace(const Page& page);
+
+  void readPageAsync(IOEngine& engine, const PageId page_number, Page* page,
+                     IORequest* request) const override;
+
+  void readPageDone(const IORequest* request, Page* page) const override;
+
+  void writePageAsync(IOEngine& engine, const PageId page_number,
+                      const Page& new_page, IORequest* request) override;
+
   /**
    * Returns an iterator at the first page in the file.
    *
@@ -343,19 +653,21 @@ class PageFile : public File {
 
  private:
   /**
-   * Reads a page from the file.  If <allow_free> is not set, an exception
-   * will be thrown if the page read from disk is not currently in use.
+   * Reads a page from the file into the given page.  If <allow_free> is not
+   * set, an exception will be thrown if the page read from disk is not
+   * currently in use.
    *
-   * No bounds checking is performed; the underlying file stream will throw
-   * an exception if the page is past the end of the file.
+   * No bounds checking is performed; a page past the end of the file is read
+   * as a free page.
    *
    * @param page_number   Number of page to read.
+   * @param page          Page to read into.
    * @param allow_free    Whether to allow reading a free (unused) page.
-   * @return  The page.
    * @throws  InvalidPageException  If the page is free (unused) and
    *                                allow_free is false.
    */
-  Page readPage(const PageId page_number, const bool allow_free) const;
+  void readPage(const PageId page_number, Page* page,
+                const bool allow_free) const;
 
   /**
    * Writes a page into the file at the given page number with the given header.
@@ -378,6 +690,27 @@ class PageFile : public File {
    */
   PageHeader readPageHeader(const PageId page_number) const;
 
+  /**
+   * Writes only the next page pointer in the header of the given page to
+   * disk, leaving the rest of the page as it is.  No bounds checking is
+   * performed.
+   *
+   * @param page_number       Number of page to update.
+   * @param next_page_number  Number of the page after it in its list.
+   */
+  void writeNextPageNumber(const PageId page_number,
+                           const PageId next_page_number);
+
+  /**
+   * Walks the list of used pages, reading only their headers, to the page
+   * linked to the given one.  The given page must be a used page other than
+   * the first.
+   *
+   * @param page_number   Number of a used page.
+   * @return  Number of the used page before it.
+   */
+  PageId usedPageBefore(const PageId page_number) const;
+
   friend class FileIterator;
 };
 
@@ -394,12 +727,12 @@ class BlobFile : public File {
   /**
    * Opens the file named fileName and returns the corresponding File object.
    * It first checks if the file is already open. If so, then the new File
-   * object created uses the same input-output stream to read to or write fom
+   * object created uses the same file descriptor to read to or write fom
    * that already open file. Reference count (open_counts_ static variable
    * inside the File object) is incremented whenever an already open file is
    * opened again. Otherwise the UNIX file is actually opened. The fileName and
-   * the stream associated with this File object are inserted into the
-   * open_streams_ map.
+   * the descriptor associated with this File object are inserted into the
+   * open_descriptors_ map.
    *
    * @param filename  Name of the file.
    * @throws  FileNotFoundException   If the requested file doesn't exist.
@@ -438,26 +771,28 @@ class BlobFile : public File {
 
   /**
    * Destructor that automatically closes the underlying file if no other
-   * File objects are using it.
+   * File objects are using it. The file is synced first, ignoring errors.
    */
   ~BlobFile();
 
+  using File::allocatePage;
+  using File::readPage;
+
   /**
-   * Allocates a new page in the file.
+   * Allocates a new page at the end of the file.
    *
-   * @return The new page.
+   * @param new_page_number   Set to the number of the new page.
+   * @param new_page          Set to the new page, in place.
    */
-  Page allocatePage(PageId& new_page_number) override;
+  void allocatePage(PageId& new_page_number, Page* new_page) override;
 
   /**
-   * Reads an existing page from the file.
+   * Reads an existing page from the file into the given page.
    *
    * @param page_number   Number of page to read.
-   * @return  The page.
-   * @throws  InvalidPageException  If the page doesn't exist in the file or is
-   *                                not currently used.
+   * @param page          Page to read into.
    */
-  Page readPage(const PageId page_number) const override;
+  void readPage(const PageId page_number, Page* page) const override;
 
   /**
    * Writes a page into the file at the given page number.
@@ -474,6 +809,77 @@ class BlobFile : public File {
    * @param page_number   Number of page to delete.
    */
   void deletePage(const PageId page_number) override;
+
+  /**
+   * Maps the pages of the file into memory, read only, so that they can be
+   * used where they are instead of being read. Pages written later are seen
+   * through the mapping, but pages allocated later are not mapped. Copies of
+   * this object do not share the mapping.
+   *
+   * @throws  FileIOException  If the file cannot be mapped.
+   */
+  void map();
+
+  /**
+   * Returns true if map() has been called.
+   */
+  bool isMapped() const { return mapping_ != nullptr; }
+
+  /**
+   * Returns an existing page of the mapped file where it lies in memory.
+   *
+   * @param page_number   Number of page.
+   * @return  The page, which must not be changed.
+   * @throws  InvalidPageException  If the file is not mapped or the page was
+   *                                not in the file when it was mapped.
+   */
+  const Page* mappedPage(const PageId page_number) const;
+
+  /**
+   * Advises the kernel that the given pages of the mapped file are about to
+   * be read one after another, so that it reads them in ahead of time. Pages
+   * out of the mapping are ignored.
+   *
+   * @param first_page    Number of the first page.
+   * @param num_pages     Number of pages.
+   */
+  void adviseSequential(const PageId first_page, const PageId num_pages) const;
+
+ private:
+  /**
+   * @brief Read-only mapping of a file, unmapped once destroyed.
+   */
+  class Mapping {
+   public:
+    /**
+     * Takes over the given mapping.
+     */
+    Mapping(const char* addr, std::size_t size) : addr(addr), size(size) {}
+
+    /**
+     * Unmaps the file.
+     */
+    ~Mapping();
+
+    /**
+     * Start of the mapping, the first byte of the file
+     */
+    const char* const addr;
+
+    /**
+     * Number of bytes mapped
+     */
+    const std::size_t size;
+
+   private:
+    Mapping(const Mapping&) = delete;
+    Mapping& operator=(const Mapping&) = delete;
+  };
+
+  /**
+   * Mapping of the file, if map() has been called.
+   */
+  std::unique_ptr<Mapping> mapping_;
 };
 
 }  // namespace badgerdb
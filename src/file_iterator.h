@@ -89,9 +89,17 @@ class FileIterator {
            (current_page_number_ != rhs.current_page_number_);
   }
 
+  /**
+   * Returns the number of the current page, without reading it.
+   *
+   * @return  Number of page in file.
+   */
+  inline PageId page_number() const { return current_page_number_; }
+
   /**
    * Dereferences the iterator, returning a copy of the current page in the
-   * file.
+   * file.  Moving on needs only the header of the page, so there is no need
+   * to dereference the iterator just to walk the file.
    *
    * @return  Page in file.
    */
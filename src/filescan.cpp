@@ -17,39 +17,59 @@ FileScan::FileScan(const std::string &name, BufMgr *bufferMgr) {
   bufMgr = bufferMgr;
   curDirtyFlag = false;
   curPage = NULL;
-  filePageIter = file->begin();
+  pagesRead = 0;
+
+  // later pages are found from the header of the page before them, as read
+  // into the buffer pool, so that the scan leaves the file to the prefetcher
+  firstPageNo = file->begin().page_number();
+  curPageNo = firstPageNo;
 }
 
 FileScan::~FileScan() {
   // generally must unpin last page of the scan
   if (curPage != NULL) {
-    bufMgr->unPinPage(file, (*filePageIter).page_number(), curDirtyFlag);
+    bufMgr->unPinPage(file, curPageNo, curDirtyFlag);
     curPage = NULL;
     curDirtyFlag = false;
-    filePageIter = file->begin();
+    curPageNo = firstPageNo;
   }
   bufMgr->flushFile(file);
   delete file;
 }
 
+void FileScan::readCurrentPage() {
+  // read the page without pushing pages more likely to be used again out of
+  // the buffer pool
+  bufMgr->readPage(file, curPageNo, curPage, SEQUENTIAL_ACCESS);
+  curDirtyFlag = false;
+
+  // have the next pages read while this one is scanned, asking again once
+  // half of them are used
+  if (pagesRead++ % (READAHEAD_PAGES / 2) == 0) {
+    bufMgr->prefetch(file, curPageNo, READAHEAD_PAGES, SEQUENTIAL_ACCESS,
+                     [](PageId pageNo, const Page &page) {
+                       return page.next_page_number();
+                     });
+  }
+}
+
 void FileScan::scanNext(RecordId &outRid) {
   std::string rec;
 
-  if (filePageIter == file->end()) {
+  if (curPageNo == Page::INVALID_NUMBER) {
     throw EndOfFileException();
   }
 
   // special case of the first record of the first page of the file
   if (curPage == NULL) {
     // need to get the first page of the file
-    filePageIter = file->begin();
-    if (filePageIter == file->end()) {
+    curPageNo = firstPageNo;
+    if (curPageNo == Page::INVALID_NUMBER) {
       throw EndOfFileException();
     }
 
     // read the first page of the file
-    bufMgr->readPage(file, (*filePageIter).page_number(), curPage);
-    curDirtyFlag = false;
+    readCurrentPage();
 
     // get the first record off the page
     pageRecordIter = curPage->begin();
@@ -69,18 +89,18 @@ void FileScan::scanNext(RecordId &outRid) {
 
   while (pageRecordIter == curPage->end()) {
     // unpin the current page
-    bufMgr->unPinPage(file, (*filePageIter).page_number(), curDirtyFlag);
+    PageId nextPageNo = curPage->next_page_number();
+    bufMgr->unPinPage(file, curPageNo, curDirtyFlag);
     curPage = NULL;
     curDirtyFlag = false;
 
-    filePageIter++;
-    if (filePageIter == file->end()) {
-      curPage = NULL;
+    curPageNo = nextPageNo;
+    if (curPageNo == Page::INVALID_NUMBER) {
       throw EndOfFileException();
     }
 
     // read the next page of the file
-    bufMgr->readPage(file, (*filePageIter).page_number(), curPage);
+    readCurrentPage();
 
     // get the first record off the page
     pageRecordIter = curPage->begin();
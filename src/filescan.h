@@ -19,7 +19,10 @@
 namespace badgerdb {
 
 /**
- * @brief This class is used to sequentially scan records in a relation.
+ * @brief This class is used to sequentially scan records in a relation. Its
+ * pages are read with SEQUENTIAL_ACCESS, so that a scan keeps to a few frames
+ * of the buffer pool, and the next few pages are read ahead while it is on
+ * one.
  */
 class FileScan {
  public:
@@ -37,6 +40,12 @@ class FileScan {
   void markDirty();
 
  private:
+  /**
+   * Reads the page the scan is on and asks for the next ones to be read
+   * ahead.
+   */
+  void readCurrentPage();
+
   /**
    * File which is being scanned.
    */
@@ -52,7 +61,22 @@ class FileScan {
    */
   Page *curPage;
 
-  FileIterator filePageIter;
+  /**
+   * Number of the first page of the file, Page::INVALID_NUMBER if it has
+   * none.
+   */
+  PageId firstPageNo;
+
+  /**
+   * Number of the page being scanned, Page::INVALID_NUMBER past the last.
+   */
+  PageId curPageNo;
+
+  /**
+   * Number of pages read so far.
+   */
+  int pagesRead;
+
   PageIterator pageRecordIter;
 
   /**
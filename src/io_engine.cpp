@@ -0,0 +1,191 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University
+ * of Wisconsin-Madison.
+ */
+
+#include "io_engine.h"
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+
+namespace badgerdb {
+
+// -----------------------------------------------------------------------------
+// IOEngine
+// -----------------------------------------------------------------------------
+
+std::unique_ptr<IOEngine> IOEngine::create(IOEngineType type,
+                                           unsigned depth) {
+  if (type == URING_IO) {
+    UringIOEngine* engine = UringIOEngine::open(depth);
+    if (engine != NULL) {
+      return std::unique_ptr<IOEngine>(engine);
+    }
+  }
+  return std::unique_ptr<IOEngine>(new SyncIOEngine());
+}
+
+// -----------------------------------------------------------------------------
+// SyncIOEngine
+// -----------------------------------------------------------------------------
+
+void SyncIOEngine::submit(IORequest* request) {
+  ssize_t n;
+  do {
+    n = request->write
+            ? ::pwritev(request->fd, request->iov, request->iovcnt,
+                        request->offset)
+            : ::preadv(request->fd, request->iov, request->iovcnt,
+                       request->offset);
+  } while (n < 0 && errno == EINTR);
+  request->result = n < 0 ? -errno : n;
+  ready.push_back(request);
+  numInFlight++;
+}
+
+void SyncIOEngine::complete(std::vector<IORequest*>& done) {
+  done.insert(done.end(), ready.begin(), ready.end());
+  numInFlight -= ready.size();
+  ready.clear();
+}
+
+// -----------------------------------------------------------------------------
+// UringIOEngine
+// -----------------------------------------------------------------------------
+
+namespace {
+
+int uringSetup(unsigned entries, struct io_uring_params* params) {
+  return ::syscall(__NR_io_uring_setup, entries, params);
+}
+
+int uringEnter(int ringFd, unsigned toSubmit, unsigned minComplete,
+               unsigned flags) {
+  return ::syscall(__NR_io_uring_enter, ringFd, toSubmit, minComplete, flags,
+                   NULL, 0);
+}
+
+}  // namespace
+
+UringIOEngine* UringIOEngine::open(unsigned depth) {
+  struct io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  int ringFd = uringSetup(depth, &params);
+  if (ringFd < 0) {
+    return NULL;
+  }
+
+  UringIOEngine* engine = new UringIOEngine();
+  engine->ringFd = ringFd;
+  engine->depth = params.sq_entries;
+  engine->sqRingSize =
+      params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  engine->cqRingSize = params.cq_off.cqes +
+                       params.cq_entries * sizeof(struct io_uring_cqe);
+  engine->sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+  engine->sqRing = mmap(NULL, engine->sqRingSize, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+  engine->cqRing = mmap(NULL, engine->cqRingSize, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_CQ_RING);
+  void* sqes = mmap(NULL, engine->sqesSize, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES);
+  engine->sqes = static_cast<struct io_uring_sqe*>(sqes);
+  if (engine->sqRing == MAP_FAILED || engine->cqRing == MAP_FAILED ||
+      sqes == MAP_FAILED) {
+    // the destructor unmaps only what was mapped
+    if (sqes == MAP_FAILED) engine->sqes = NULL;
+    delete engine;
+    return NULL;
+  }
+
+  char* sq = static_cast<char*>(engine->sqRing);
+  engine->sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+  engine->sqMask = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+  engine->sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+  char* cq = static_cast<char*>(engine->cqRing);
+  engine->cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+  engine->cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+  engine->cqMask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+  engine->cqes =
+      reinterpret_cast<struct io_uring_cqe*>(cq + params.cq_off.cqes);
+  return engine;
+}
+
+UringIOEngine::~UringIOEngine() {
+  if (sqes != NULL) munmap(sqes, sqesSize);
+  if (cqRing != MAP_FAILED) munmap(cqRing, cqRingSize);
+  if (sqRing != MAP_FAILED) munmap(sqRing, sqRingSize);
+  ::close(ringFd);
+}
+
+void UringIOEngine::submit(IORequest* request) {
+  // no more in flight than the completion queue is sure to hold
+  while (numInFlight - ready.size() >= depth) {
+    if (reap(ready) == 0) {
+      uringEnter(ringFd, 0, 1, IORING_ENTER_GETEVENTS);
+    }
+  }
+
+  // only this thread moves the tail, the kernel reads it
+  unsigned tail = *sqTail;
+  unsigned index = tail & *sqMask;
+  struct io_uring_sqe* sqe = &sqes[index];
+  memset(sqe, 0, sizeof(*sqe));
+  sqe->opcode = request->write ? IORING_OP_WRITEV : IORING_OP_READV;
+  sqe->fd = request->fd;
+  sqe->off = request->offset;
+  sqe->addr = reinterpret_cast<unsigned long>(request->iov);
+  sqe->len = request->iovcnt;
+  sqe->user_data = reinterpret_cast<unsigned long>(request);
+  sqArray[index] = index;
+  __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+
+  int submitted;
+  do {
+    submitted = uringEnter(ringFd, 1, 0, 0);
+  } while (submitted < 0 && (errno == EINTR || errno == EAGAIN));
+  if (submitted < 0) {
+    // the kernel only takes entries during the call, so the entry can be
+    // taken back and the request failed
+    __atomic_store_n(sqTail, tail, __ATOMIC_RELEASE);
+    request->result = -errno;
+    ready.push_back(request);
+  }
+  numInFlight++;
+}
+
+void UringIOEngine::complete(std::vector<IORequest*>& done) {
+  std::size_t found = ready.size();
+  done.insert(done.end(), ready.begin(), ready.end());
+  ready.clear();
+  found += reap(done);
+  while (found == 0 && numInFlight > 0) {
+    uringEnter(ringFd, 0, 1, IORING_ENTER_GETEVENTS);
+    found = reap(done);
+  }
+  numInFlight -= found;
+}
+
+std::size_t UringIOEngine::reap(std::vector<IORequest*>& done) {
+  unsigned head = *cqHead;
+  unsigned tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+  std::size_t found = 0;
+  for (; head != tail; head++, found++) {
+    struct io_uring_cqe* cqe = &cqes[head & *cqMask];
+    IORequest* request = reinterpret_cast<IORequest*>(cqe->user_data);
+    request->result = cqe->res;
+    done.push_back(request);
+  }
+  __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+  return found;
+}
+
+}  // namespace badgerdb
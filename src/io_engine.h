@@ -0,0 +1,225 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University
+ * of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#include <memory>
+#include <vector>
+
+#include "page.h"
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+namespace badgerdb {
+
+/**
+ * @brief Ways of carrying out the reads and writes handed to an IOEngine.
+ */
+enum IOEngineType {
+  SYNC_IO = 0, /* One at a time, as they are submitted */
+  URING_IO = 1 /* Many at a time through io_uring, if the kernel allows it */
+};
+
+/**
+ * @brief A read or write of a page, set up by a File and carried out by an
+ * IOEngine.
+ */
+struct IORequest {
+  /**
+   * Descriptor of the file
+   */
+  int fd;
+
+  /**
+   * Number of the page
+   */
+  PageId pageNo;
+
+  /**
+   * Position in the file of the first byte to read or write
+   */
+  off_t offset;
+
+  /**
+   * Buffers read into or written from, one after another
+   */
+  struct iovec iov[2];
+
+  /**
+   * Number of buffers in iov
+   */
+  int iovcnt;
+
+  /**
+   * True for a write, false for a read
+   */
+  bool write;
+
+  /**
+   * Number of bytes read or written once complete, or minus the errno of the
+   * failure
+   */
+  ssize_t result;
+
+  /**
+   * Header of a page written by a file that keeps part of it from the page on
+   * disk
+   */
+  PageHeader header;
+};
+
+/**
+ * @brief Carries out reads and writes of files in the background, many of
+ * them at a time. One thread at a time may use an engine.
+ */
+class IOEngine {
+ public:
+  /**
+   * Creates an engine.
+   *
+   * @param type   How to carry out the requests; URING_IO falls back to
+   * SYNC_IO if io_uring is not available
+   * @param depth  Most requests in flight at once
+   */
+  static std::unique_ptr<IOEngine> create(IOEngineType type, unsigned depth);
+
+  virtual ~IOEngine() {}
+
+  /**
+   * Name of the engine, for printing
+   */
+  virtual const char* name() const = 0;
+
+  /**
+   * Starts the request, waiting first for others to complete if depth of
+   * them are in flight. The request and its buffers must be left alone until
+   * complete() returns it.
+   *
+   * @param request  Request set up by a File
+   */
+  virtual void submit(IORequest* request) = 0;
+
+  /**
+   * Returns requests that have completed since the last call, waiting for at
+   * least one if none has but some are in flight.
+   *
+   * @param done  Vector the completed requests are added to
+   */
+  virtual void complete(std::vector<IORequest*>& done) = 0;
+
+  /**
+   * Number of requests submitted and not yet returned by complete()
+   */
+  std::size_t inFlight() const { return numInFlight; }
+
+ protected:
+  IOEngine() : numInFlight(0) {}
+
+  /**
+   * Number of requests submitted and not yet returned by complete()
+   */
+  std::size_t numInFlight;
+
+ private:
+  IOEngine(const IOEngine&) = delete;
+  IOEngine& operator=(const IOEngine&) = delete;
+};
+
+/**
+ * @brief Carries out each request as it is submitted, with preadv() and
+ * pwritev().
+ */
+class SyncIOEngine : public IOEngine {
+ public:
+  const char* name() const override { return "sync"; }
+  void submit(IORequest* request) override;
+  void complete(std::vector<IORequest*>& done) override;
+
+ private:
+  /**
+   * Requests carried out and not yet returned by complete()
+   */
+  std::vector<IORequest*> ready;
+};
+
+/**
+ * @brief Hands requests to the kernel through an io_uring, set up with the
+ * system calls directly.
+ */
+class UringIOEngine : public IOEngine {
+ public:
+  /**
+   * Sets up an io_uring for depth requests.
+   *
+   * @return  The engine, or NULL if the kernel does not allow io_uring.
+   */
+  static UringIOEngine* open(unsigned depth);
+
+  ~UringIOEngine();
+
+  const char* name() const override { return "io_uring"; }
+  void submit(IORequest* request) override;
+  void complete(std::vector<IORequest*>& done) override;
+
+ private:
+  UringIOEngine() {}
+
+  /**
+   * Moves the completions the kernel has posted to the vector.
+   *
+   * @return  Number of completions moved.
+   */
+  std::size_t reap(std::vector<IORequest*>& done);
+
+  /**
+   * Descriptor of the io_uring
+   */
+  int ringFd;
+
+  /**
+   * Most requests in flight at once
+   */
+  unsigned depth;
+
+  /**
+   * Submission queue ring, shared with the kernel
+   */
+  void* sqRing;
+  std::size_t sqRingSize;
+  unsigned* sqTail;
+  unsigned* sqMask;
+  unsigned* sqArray;
+
+  /**
+   * Submission queue entries, shared with the kernel
+   */
+  struct io_uring_sqe* sqes;
+  std::size_t sqesSize;
+
+  /**
+   * Completion queue ring, shared with the kernel
+   */
+  void* cqRing;
+  std::size_t cqRingSize;
+  unsigned* cqHead;
+  unsigned* cqTail;
+  unsigned* cqMask;
+  struct io_uring_cqe* cqes;
+
+  /**
+   * Requests completed while waiting for room to submit, not yet returned by
+   * complete()
+   */
+  std::vector<IORequest*> ready;
+};
+
+}  // namespace badgerdb
@@ -0,0 +1,279 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University
+ * of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace badgerdb {
+
+/**
+ * @brief A reader-writer latch. Any number of threads may hold it shared, or a
+ * single thread exclusively. A waiting writer keeps new readers out, so that a
+ * steady stream of readers cannot starve it; a thread must therefore never
+ * take a latch it already holds, even shared.
+ */
+class RWLatch {
+ private:
+  /**
+   * Protects the counts below.
+   */
+  std::mutex mutex;
+
+  /**
+   * Signalled whenever the latch is let go of.
+   */
+  std::condition_variable released;
+
+  /**
+   * Number of threads holding the latch shared.
+   */
+  int readers;
+
+  /**
+   * True if a thread holds the latch exclusively.
+   */
+  bool writer;
+
+  /**
+   * Number of threads waiting to take the latch exclusively.
+   */
+  int waitingWriters;
+
+  RWLatch(const RWLatch&) = delete;
+  RWLatch& operator=(const RWLatch&) = delete;
+
+ public:
+  RWLatch() : readers(0), writer(false), waitingWriters(0) {}
+
+  /**
+   * Takes the latch exclusively, waiting for every holder to let go of it.
+   */
+  void lock() {
+    std::unique_lock<std::mutex> guard(mutex);
+    waitingWriters++;
+    released.wait(guard, [this] { return !writer && readers == 0; });
+    waitingWriters--;
+    writer = true;
+  }
+
+  /**
+   * Lets go of the latch taken with lock().
+   */
+  void unlock() {
+    std::lock_guard<std::mutex> guard(mutex);
+    writer = false;
+    released.notify_all();
+  }
+
+  /**
+   * Takes the latch shared, waiting for writers holding or waiting for it.
+   */
+  void lockShared() {
+    std::unique_lock<std::mutex> guard(mutex);
+    released.wait(guard, [this] { return !writer && waitingWriters == 0; });
+    readers++;
+  }
+
+  /**
+   * Takes the latch shared if that needs no waiting.
+   *
+   * @return true if the latch was taken
+   */
+  bool tryLockShared() {
+    std::lock_guard<std::mutex> guard(mutex);
+    if (writer || waitingWriters != 0) {
+      return false;
+    }
+    readers++;
+    return true;
+  }
+
+  /**
+   * Lets go of the latch taken with lockShared().
+   */
+  void unlockShared() {
+    std::lock_guard<std::mutex> guard(mutex);
+    if (--readers == 0) {
+      released.notify_all();
+    }
+  }
+};
+
+/**
+ * @brief Holds a RWLatch shared for the lifetime of the guard, the counterpart
+ * of std::lock_guard for lockShared().
+ */
+class SharedLatchGuard {
+ private:
+  RWLatch& latch;
+
+  SharedLatchGuard(const SharedLatchGuard&) = delete;
+  SharedLatchGuard& operator=(const SharedLatchGuard&) = delete;
+
+ public:
+  explicit SharedLatchGuard(RWLatch& latchIn) : latch(latchIn) {
+    latch.lockShared();
+  }
+  ~SharedLatchGuard() { latch.unlockShared(); }
+};
+
+/**
+ * @brief Reader-writer latches for any number of keys, such as page numbers,
+ * that behave each as a RWLatch. The keys are spread over a fixed number of
+ * stripes, whose mutex is held only while a latch changes hands. Keys that
+ * share a stripe never wait for each other, so a thread may hold the latches
+ * of several keys of one stripe at once, and a latch takes memory only while
+ * it is held or waited for.
+ */
+class LatchTable {
+ private:
+  /**
+   * @brief State of the latch of one key.
+   */
+  struct Entry {
+    std::uint32_t key;
+    int readers;
+    bool writer;
+    int waitingWriters;
+
+    /**
+     * Number of threads holding or waiting for the latch. The entry goes
+     * when the last one leaves.
+     */
+    int users;
+  };
+
+  /**
+   * @brief Latches of the keys of one stripe.
+   */
+  struct Stripe {
+    std::mutex mutex;
+    std::condition_variable released;
+    std::vector<Entry> entries;
+  };
+
+  std::unique_ptr<Stripe[]> stripes;
+  std::size_t numStripes;
+
+  LatchTable(const LatchTable&) = delete;
+  LatchTable& operator=(const LatchTable&) = delete;
+
+  Stripe& stripeOf(std::uint32_t key) { return stripes[key % numStripes]; }
+
+  /**
+   * Returns the entry of a key, adding it if missing. The stripe mutex is
+   * held.
+   */
+  static Entry& find(Stripe& stripe, std::uint32_t key) {
+    for (Entry& entry : stripe.entries) {
+      if (entry.key == key) {
+        return entry;
+      }
+    }
+    stripe.entries.push_back(Entry{key, 0, false, 0, 0});
+    return stripe.entries.back();
+  }
+
+  /**
+   * Lets a thread done with the latch of a key go, and wakes the threads
+   * waiting in the stripe. The stripe mutex is held.
+   */
+  static void leave(Stripe& stripe, Entry& entry) {
+    if (--entry.users == 0) {
+      entry = stripe.entries.back();
+      stripe.entries.pop_back();
+    }
+    stripe.released.notify_all();
+  }
+
+ public:
+  explicit LatchTable(std::size_t numStripesIn)
+      : stripes(new Stripe[numStripesIn]), numStripes(numStripesIn) {}
+
+  /**
+   * Takes the latch of a key exclusively.
+   */
+  void lock(std::uint32_t key) {
+    Stripe& stripe = stripeOf(key);
+    std::unique_lock<std::mutex> guard(stripe.mutex);
+    Entry* entry = &find(stripe, key);
+    entry->users++;
+    entry->waitingWriters++;
+    // entries move as others come and go, look it up again after each wait
+    stripe.released.wait(guard, [&] {
+      entry = &find(stripe, key);
+      return !entry->writer && entry->readers == 0;
+    });
+    entry->waitingWriters--;
+    entry->writer = true;
+  }
+
+  /**
+   * Lets go of the latch of a key taken with lock().
+   */
+  void unlock(std::uint32_t key) {
+    Stripe& stripe = stripeOf(key);
+    std::lock_guard<std::mutex> guard(stripe.mutex);
+    Entry& entry = find(stripe, key);
+    entry.writer = false;
+    leave(stripe, entry);
+  }
+
+  /**
+   * Takes the latch of a key shared.
+   */
+  void lockShared(std::uint32_t key) {
+    Stripe& stripe = stripeOf(key);
+    std::unique_lock<std::mutex> guard(stripe.mutex);
+    Entry* entry = &find(stripe, key);
+    entry->users++;
+    stripe.released.wait(guard, [&] {
+      entry = &find(stripe, key);
+      return !entry->writer && entry->waitingWriters == 0;
+    });
+    entry->readers++;
+  }
+
+  /**
+   * Takes the latch of a key shared if that needs no waiting.
+   *
+   * @return true if the latch was taken
+   */
+  bool tryLockShared(std::uint32_t key) {
+    Stripe& stripe = stripeOf(key);
+    std::lock_guard<std::mutex> guard(stripe.mutex);
+    Entry& entry = find(stripe, key);
+    if (entry.writer || entry.waitingWriters != 0) {
+      // a writer holds or waits for it, so the entry stays
+      return false;
+    }
+    entry.users++;
+    entry.readers++;
+    return true;
+  }
+
+  /**
+   * Lets go of the latch of a key taken with lockShared() or
+   * tryLockShared().
+   */
+  void unlockShared(std::uint32_t key) {
+    Stripe& stripe = stripeOf(key);
+    std::lock_guard<std::mutex> guard(stripe.mutex);
+    Entry& entry = find(stripe, key);
+    entry.readers--;
+    leave(stripe, entry);
+  }
+};
+
+}  // namespace badgerdb
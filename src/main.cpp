@@ -6,13 +6,19 @@
  * of Wisconsin-Madison.
  */
 
+#include <chrono>
+#include <fstream>
+#include <set>
+#include <thread>
 #include <vector>
 
 #include "btree.h"
 #include "exceptions/bad_opcodes_exception.h"
 #include "exceptions/bad_scanrange_exception.h"
+#include "exceptions/buffer_exceeded_exception.h"
 #include "exceptions/end_of_file_exception.h"
 #include "exceptions/file_not_found_exception.h"
+#include "exceptions/index_read_only_exception.h"
 #include "exceptions/index_scan_completed_exception.h"
 #include "exceptions/insufficient_space_exception.h"
 #include "exceptions/no_such_key_found_exception.h"
@@ -72,6 +78,12 @@ void createRelationRandom();
 void intTests();
 int intScan(BTreeIndex *index, int lowVal, Operator lowOp, int highVal,
             Operator highOp);
+void doubleTests();
+int doubleScan(BTreeIndex *index, double lowVal, Operator lowOp,
+               double highVal, Operator highOp);
+void stringTests();
+int stringScan(BTreeIndex *index, int lowVal, Operator lowOp, int highVal,
+               Operator highOp);
 void indexTests();
 void test1();
 void test2();
@@ -86,6 +98,37 @@ void test4();
 void test5();
 void test6();
 void test7();
+void test8();
+void test9();
+void test10();
+void test11();
+int intScanBatch(BTreeIndex *index, int lowVal, Operator lowOp, int highVal,
+                 Operator highOp);
+int intLookup(BTreeIndex *index, int key);
+void test12();
+int intDelete(BTreeIndex *index, int lowKey, int highKey, int step,
+              DeletePolicy policy);
+void test13();
+void test14();
+void createRelationComposite();
+int compositeScan(BTreeIndex *index, int lowI, double lowD, Operator lowOp,
+                  int highI, double highD, Operator highOp, int numKeyAttrs);
+void test15();
+int coveringScan(BTreeIndex *index, int lowVal, Operator lowOp, int highVal,
+                 Operator highOp, bool batched);
+void test16();
+void test17();
+void test18();
+void test19();
+void test20();
+void test21();
+void test22();
+void test23();
+void test24();
+void test25();
+void test26();
+void test27();
+void test28();
 
 void errorTests();
 void deleteRelation();
@@ -148,6 +191,27 @@ int main(int argc, char **argv) {
   test5();
   test6();
   test7();
+  test8();
+  test9();
+  test10();
+  test11();
+  test12();
+  test13();
+  test14();
+  test15();
+  test16();
+  test17();
+  test18();
+  test19();
+  test20();
+  test21();
+  test22();
+  test23();
+  test24();
+  test25();
+  test26();
+  test27();
+  test28();
 
   errorTests();
 
@@ -267,6 +331,1406 @@ void test7() {
 }
 
 
+void test8() {
+  // Create a relation with tuples valued 0 to relationSize in random order and
+  // bulk load indexes with half-full and completely full nodes
+  std::cout << "--------------------" << std::endl;
+  std::cout << "createRelationRandom with fill factors" << std::endl;
+  createRelationRandom();
+  try {
+    File::remove(intIndexName);
+  } catch (const FileNotFoundException &e) {
+  }
+
+  const double fillFactors[] = {0.5, 1.0};
+  for (double fillFactor : fillFactors) {
+    std::cout << "Bulk load with fill factor " << fillFactor << std::endl;
+    {
+      BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                       INTEGER, fillFactor);
+      checkPassFail(intScan(&index, 25, GT, 40, LT), 14)
+      checkPassFail(intScan(&index, -3, GT, 3, LT), 3)
+      checkPassFail(intScan(&index, 3000, GTE, 4000, LT), 1000)
+      checkPassFail(intScan(&index, 0, GTE, relationSize, LT), relationSize)
+    }
+    File::remove(intIndexName);
+  }
+
+  deleteRelation();
+}
+
+void test9() {
+  // Create a relation with tuples valued 0 to relationSize in random order and
+  // probe single keys without starting a scan
+  std::cout << "--------------------" << std::endl;
+  std::cout << "createRelationRandom with point lookups" << std::endl;
+  createRelationRandom();
+  try {
+    File::remove(intIndexName);
+  } catch (const FileNotFoundException &e) {
+  }
+
+  {
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER);
+    checkPassFail(intLookup(&index, 0), 1)
+    checkPassFail(intLookup(&index, 2500), 1)
+    checkPassFail(intLookup(&index, relationSize - 1), 1)
+    checkPassFail(intLookup(&index, -1), 0)
+    checkPassFail(intLookup(&index, relationSize), 0)
+
+    // lookups leave a running scan alone
+    int lowVal = 100, highVal = 110;
+    RecordId scanRid;
+    index.startScan(&lowVal, GTE, &highVal, LT);
+    index.scanNext(scanRid);
+    checkPassFail(index.contains(&highVal), true)
+    int numResults = 1;
+    try {
+      while (true) {
+        index.scanNext(scanRid);
+        numResults++;
+      }
+    } catch (const IndexScanCompletedException &e) {
+    }
+    index.endScan();
+    checkPassFail(numResults, 10)
+  }
+  File::remove(intIndexName);
+
+  deleteRelation();
+}
+
+void test10() {
+  // Create a relation with tuples valued 0 to relationSize in random order and
+  // interleave several scans over one index
+  std::cout << "--------------------" << std::endl;
+  std::cout << "createRelationRandom with concurrent cursors" << std::endl;
+  createRelationRandom();
+  try {
+    File::remove(intIndexName);
+  } catch (const FileNotFoundException &e) {
+  }
+
+  {
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER);
+    int low1 = 0, high1 = 1000, low2 = 500, high2 = 3000;
+    IndexCursor cursor1(&index), cursor2(&index);
+    cursor1.startScan(&low1, GTE, &high1, LT);
+    cursor2.startScan(&low2, GT, &high2, LTE);
+    // the built-in scan does not end either cursor
+    checkPassFail(intScan(&index, 25, GT, 40, LT), 14)
+
+    RecordId scanRid;
+    int numResults1 = 0, numResults2 = 0;
+    bool done1 = false, done2 = false;
+    while (!done1 || !done2) {
+      try {
+        if (!done1) {
+          cursor1.scanNext(scanRid);
+          numResults1++;
+        }
+      } catch (const IndexScanCompletedException &e) {
+        done1 = true;
+      }
+      try {
+        if (!done2) {
+          cursor2.scanNext(scanRid);
+          numResults2++;
+        }
+      } catch (const IndexScanCompletedException &e) {
+        done2 = true;
+      }
+    }
+    cursor1.endScan();
+    checkPassFail(numResults1, 1000)
+    checkPassFail(numResults2, 2500)
+    // cursor2 is still executing and is ended by its destructor
+  }
+  File::remove(intIndexName);
+
+  deleteRelation();
+}
+
+void test11() {
+  // Create a relation with tuples valued 0 to relationSize in random order and
+  // fetch scan results a batch at a time
+  std::cout << "--------------------" << std::endl;
+  std::cout << "createRelationRandom with batched scans" << std::endl;
+  createRelationRandom();
+  try {
+    File::remove(intIndexName);
+  } catch (const FileNotFoundException &e) {
+  }
+
+  {
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER);
+    checkPassFail(intScanBatch(&index, 25, GT, 40, LT), 14)
+    checkPassFail(intScanBatch(&index, 20, GTE, 35, LTE), 16)
+    checkPassFail(intScanBatch(&index, -3, GT, 3, LT), 3)
+    checkPassFail(intScanBatch(&index, 0, GT, 1, LT), 0)
+    checkPassFail(intScanBatch(&index, 3000, GTE, 4000, LT), 1000)
+    checkPassFail(intScanBatch(&index, 0, GTE, relationSize, LTE),
+                  relationSize)
+  }
+  File::remove(intIndexName);
+
+  deleteRelation();
+}
+
+void test12() {
+  // Create a relation with tuples valued 0 to relationSize in random order,
+  // delete entries from its index and check the scans over what is left
+  std::cout << "--------------------" << std::endl;
+  std::cout << "createRelationRandom with deletes" << std::endl;
+  createRelationRandom();
+  try {
+    File::remove(intIndexName);
+  } catch (const FileNotFoundException &e) {
+  }
+
+  {
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER);
+    // merging deletes of every even key
+    checkPassFail(intDelete(&index, 0, relationSize, 2, MERGE_DELETE),
+                  relationSize / 2)
+    checkPassFail(intDelete(&index, 0, relationSize, 2, MERGE_DELETE), 0)
+    checkPassFail(intScan(&index, 25, GT, 40, LT), 7)
+    checkPassFail(intScan(&index, 0, GTE, relationSize, LT), relationSize / 2)
+    checkPassFail(intLookup(&index, 2), 0)
+    checkPassFail(intLookup(&index, 3), 1)
+
+    // lazy deletes of the odd keys in the lower half, then a rebuild
+    checkPassFail(intDelete(&index, 1, relationSize / 2, 2, LAZY_DELETE),
+                  relationSize / 4)
+    checkPassFail(intScan(&index, 0, GTE, relationSize / 2, LT), 0)
+    index.compact();
+    checkPassFail(intScan(&index, 0, GTE, relationSize, LT), relationSize / 4)
+    checkPassFail(intScan(&index, 3000, GTE, 4000, LT), 500)
+  }
+
+  {
+    // the free list survives reopening and is reused by inserts
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER);
+    checkPassFail(intDelete(&index, relationSize / 2 + 1, relationSize, 2,
+                            MERGE_DELETE),
+                  relationSize / 4)
+    checkPassFail(intScan(&index, 0, GTE, relationSize, LT), 0)
+    RecordId rid;
+    rid.page_number = 1;
+    rid.slot_number = 1;
+    for (int key = 0; key < relationSize; key++) {
+      index.insertEntry(&key, rid);
+    }
+    checkPassFail(intScan(&index, 25, GT, 40, LT), 14)
+  }
+  File::remove(intIndexName);
+
+  deleteRelation();
+}
+
+int intDelete(BTreeIndex *index, int lowKey, int highKey, int step,
+              DeletePolicy policy) {
+  std::cout << "Delete every " << step << " key from " << lowKey << " to "
+            << highKey << std::endl;
+  // the record ids of the keys still in the index come from the relation
+  std::vector<RecordId> rids(relationSize);
+  std::vector<bool> hasRid(relationSize, false);
+  FileScan fscan(relationName, bufMgr);
+  try {
+    RecordId scanRid;
+    while (1) {
+      fscan.scanNext(scanRid);
+      std::string recordStr = fscan.getRecord();
+      int key = *((int *)(recordStr.c_str() + offsetof(RECORD, i)));
+      rids[key] = scanRid;
+      hasRid[key] = true;
+    }
+  } catch (const EndOfFileException &e) {
+  }
+
+  int numDeleted = 0;
+  for (int key = lowKey; key < highKey; key += step) {
+    if (hasRid[key] && index->deleteEntry(&key, rids[key], policy)) {
+      numDeleted++;
+    }
+  }
+  return numDeleted;
+}
+
+void test13() {
+  // Create a relation with tuples valued 0 to relationSize in random order,
+  // then delete and re-insert entries of the string and double indexes
+  std::cout << "--------------------" << std::endl;
+  std::cout << "createRelationRandom with string and double updates"
+            << std::endl;
+  createRelationRandom();
+  try {
+    File::remove(stringIndexName);
+  } catch (const FileNotFoundException &e) {
+  }
+  try {
+    File::remove(doubleIndexName);
+  } catch (const FileNotFoundException &e) {
+  }
+
+  {
+    BTreeIndex stringIndex(relationName, stringIndexName, bufMgr,
+                           offsetof(tuple, s), STRING);
+    BTreeIndex doubleIndex(relationName, doubleIndexName, bufMgr,
+                           offsetof(tuple, d), DOUBLE);
+
+    // delete every even record from both indexes
+    std::vector<RecordId> rids(relationSize);
+    std::vector<RECORD> records(relationSize);
+    {
+      FileScan fscan(relationName, bufMgr);
+      try {
+        RecordId scanRid;
+        while (1) {
+          fscan.scanNext(scanRid);
+          RECORD myRec =
+              *(reinterpret_cast<const RECORD *>(fscan.getRecord().data()));
+          rids[myRec.i] = scanRid;
+          records[myRec.i] = myRec;
+        }
+      } catch (const EndOfFileException &e) {
+      }
+    }
+    int numDeleted = 0;
+    for (int i = 0; i < relationSize; i += 2) {
+      numDeleted += stringIndex.deleteEntry(records[i].s, rids[i]);
+      numDeleted += doubleIndex.deleteEntry(&records[i].d, rids[i]);
+    }
+    checkPassFail(numDeleted, relationSize)
+    checkPassFail(stringScan(&stringIndex, 25, GT, 40, LT), 7)
+    checkPassFail(doubleScan(&doubleIndex, 25, GT, 40, LT), 7)
+    checkPassFail(stringScan(&stringIndex, 0, GTE, relationSize, LT),
+                  relationSize / 2)
+
+    // and put them back through insertEntry
+    for (int i = 0; i < relationSize; i += 2) {
+      stringIndex.insertEntry(records[i].s, rids[i]);
+      doubleIndex.insertEntry(&records[i].d, rids[i]);
+    }
+    checkPassFail(stringScan(&stringIndex, 25, GT, 40, LT), 14)
+    checkPassFail(doubleScan(&doubleIndex, 20, GTE, 35, LTE), 16)
+    checkPassFail(doubleScan(&doubleIndex, 0, GTE, relationSize, LT),
+                  relationSize)
+  }
+  File::remove(stringIndexName);
+  File::remove(doubleIndexName);
+
+  deleteRelation();
+}
+
+void test14() {
+  // Create a relation with tuples valued 0 to relationSize in random order,
+  // then add longer string keys that extend the existing ones
+  std::cout << "--------------------" << std::endl;
+  std::cout << "createRelationRandom with shared string prefixes" << std::endl;
+  createRelationRandom();
+  try {
+    File::remove(stringIndexName);
+  } catch (const FileNotFoundException &e) {
+  }
+
+  {
+    BTreeIndex index(relationName, stringIndexName, bufMgr, offsetof(tuple, s),
+                     STRING);
+    std::vector<RecordId> rids(relationSize);
+    {
+      FileScan fscan(relationName, bufMgr);
+      try {
+        RecordId scanRid;
+        while (1) {
+          fscan.scanNext(scanRid);
+          RECORD myRec =
+              *(reinterpret_cast<const RECORD *>(fscan.getRecord().data()));
+          rids[myRec.i] = scanRid;
+        }
+      } catch (const EndOfFileException &e) {
+      }
+    }
+
+    // "00025 string record" < "00025 string record of ..." < "00026 ..."
+    char key[STRINGSIZE];
+    for (int i = 0; i < relationSize; i++) {
+      sprintf(key, "%05d string record of a customer account, region 07", i);
+      index.insertEntry(key, rids[i]);
+    }
+    checkPassFail(stringScan(&index, 25, GT, 40, LT), 29)
+    checkPassFail(stringScan(&index, 20, GTE, 35, LTE), 31)
+    checkPassFail(stringScan(&index, 0, GTE, relationSize, LT),
+                  2 * relationSize)
+    sprintf(key, "%05d string", 25);
+    checkPassFail(index.contains(key), false)
+
+    for (int i = 0; i < relationSize; i++) {
+      sprintf(key, "%05d string record of a customer account, region 07", i);
+      index.deleteEntry(key, rids[i]);
+    }
+    checkPassFail(stringScan(&index, 25, GT, 40, LT), 14)
+    checkPassFail(stringScan(&index, 0, GTE, relationSize, LT), relationSize)
+  }
+  File::remove(stringIndexName);
+
+  deleteRelation();
+}
+
+void test15() {
+  // Create a relation of ten tenants (i = -5 to 4) with 500 tuples each
+  // (d = 0 to 499) and index it on the composite key (i, d)
+  std::cout << "--------------------" << std::endl;
+  std::cout << "createRelationComposite" << std::endl;
+  createRelationComposite();
+  std::vector<KeyAttribute> keyAttrs;
+  keyAttrs.push_back(KeyAttribute{offsetof(tuple, i), INTEGER});
+  keyAttrs.push_back(KeyAttribute{offsetof(tuple, d), DOUBLE});
+  std::string compositeIndexName;
+
+  {
+    BTreeIndex index(relationName, compositeIndexName, bufMgr, keyAttrs);
+    // prefix scans on the tenant alone
+    checkPassFail(compositeScan(&index, -2, 0, GTE, 1, 0, LTE, 1), 2000)
+    checkPassFail(compositeScan(&index, -2, 0, GT, 1, 0, LT, 1), 1000)
+    checkPassFail(compositeScan(&index, -5, 0, GTE, 4, 0, LTE, 1), relationSize)
+    // full key ranges within and across tenants
+    checkPassFail(compositeScan(&index, 0, 100, GTE, 0, 200, LT, 2), 100)
+    checkPassFail(compositeScan(&index, -1, 450, GT, 0, 49, LTE, 2), 99)
+
+    RECORD key;
+    key.i = 3;
+    key.d = 7;
+    checkPassFail(index.contains(&key), true)
+    key.d = 7.5;
+    checkPassFail(index.contains(&key), false)
+  }
+
+  {
+    // reopening checks the attributes stored in the meta page
+    BTreeIndex index(relationName, compositeIndexName, bufMgr, keyAttrs);
+    checkPassFail(compositeScan(&index, -5, 0, GTE, 4, 0, LTE, 1), relationSize)
+  }
+  File::remove(compositeIndexName);
+
+  {
+    // each tenant is a run of 500 equal keys; loaded as sparse as the loader
+    // goes, the run spans many leaves and every non-leaf node is underfull.
+    // A miss leaves the tree alone, and merging deletes each find their
+    // entry, from the last leaves of the run back to the first
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER, 0.0);
+    const int tenant = 0;
+    std::vector<RecordId> rids;
+    index.lookup(&tenant, rids);
+    checkPassFail(int(rids.size()), 500)
+    RecordId missing;
+    missing.page_number = 1;
+    missing.slot_number = 0;
+    checkPassFail(index.deleteEntry(&tenant, missing, MERGE_DELETE), false)
+    int numDeleted = 0;
+    for (size_t n = rids.size(); n > 0; n--) {
+      numDeleted += index.deleteEntry(&tenant, rids[n - 1], MERGE_DELETE);
+    }
+    checkPassFail(numDeleted, 500)
+    checkPassFail(index.contains(&tenant), false)
+    const int other = 1;
+    rids.clear();
+    index.lookup(&other, rids);
+    checkPassFail(int(rids.size()), 500)
+  }
+  File::remove(intIndexName);
+
+  deleteRelation();
+}
+
+int compositeScan(BTreeIndex *index, int lowI, double lowD, Operator lowOp,
+                  int highI, double highD, Operator highOp, int numKeyAttrs) {
+  std::cout << "Composite scan for " << (lowOp == GT ? "(" : "[") << lowI;
+  if (numKeyAttrs > 1) std::cout << ":" << lowD;
+  std::cout << "," << highI;
+  if (numKeyAttrs > 1) std::cout << ":" << highD;
+  std::cout << (highOp == LT ? ")" : "]") << std::endl;
+
+  RECORD lowKey, highKey;
+  lowKey.i = lowI;
+  lowKey.d = lowD;
+  highKey.i = highI;
+  highKey.d = highD;
+  try {
+    index->startScan(&lowKey, lowOp, &highKey, highOp, numKeyAttrs);
+  } catch (const NoSuchKeyFoundException &e) {
+    std::cout << "No Key Found satisfying the scan criteria." << std::endl;
+    return 0;
+  }
+
+  // entries must come back ordered by tenant, then by d
+  RecordId scanRid;
+  int numResults = 0;
+  RECORD prev;
+  while (1) {
+    try {
+      index->scanNext(scanRid);
+    } catch (const IndexScanCompletedException &e) {
+      break;
+    }
+    Page *curPage;
+    bufMgr->readPage(file1, scanRid.page_number, curPage);
+    RECORD myRec = *(reinterpret_cast<const RECORD *>(
+        curPage->getRecord(scanRid).data()));
+    bufMgr->unPinPage(file1, scanRid.page_number, false);
+    if (numResults > 0 &&
+        (myRec.i < prev.i || (myRec.i == prev.i && myRec.d <= prev.d))) {
+      index->endScan();
+      return -1;
+    }
+    prev = myRec;
+    numResults++;
+  }
+  index->endScan();
+
+  return numResults;
+}
+
+void test16() {
+  // Create a relation with tuples valued 0 to relationSize in random order and
+  // index it on i, covering the string column
+  std::cout << "--------------------" << std::endl;
+  std::cout << "createRelationRandom with a covering index" << std::endl;
+  createRelationRandom();
+  std::vector<KeyAttribute> keyAttrs;
+  keyAttrs.push_back(KeyAttribute{offsetof(tuple, i), INTEGER});
+  IncludedColumns included = {offsetof(tuple, s), 20};
+  std::string coveringIndexName;
+
+  {
+    BTreeIndex index(relationName, coveringIndexName, bufMgr, keyAttrs,
+                     included);
+    checkPassFail(coveringScan(&index, 25, GT, 40, LT, false), 14)
+    checkPassFail(coveringScan(&index, 0, GTE, relationSize, LT, true),
+                  relationSize)
+
+    // entries inserted later carry their payload as well
+    char payload[20];
+    RecordId newRid;
+    newRid.page_number = 1;
+    newRid.slot_number = 1;
+    for (int i = relationSize; i < relationSize + 1000; i++) {
+      sprintf(payload, "%05d string record", i);
+      index.insertEntry(&i, newRid, payload);
+      newRid.slot_number++;
+    }
+    checkPassFail(coveringScan(&index, 4990, GTE, 6000, LT, false), 1010)
+
+    // merges and compaction move payloads along with their entries
+    std::vector<RecordId> rids(relationSize);
+    {
+      FileScan fscan(relationName, bufMgr);
+      try {
+        RecordId scanRid;
+        while (1) {
+          fscan.scanNext(scanRid);
+          RECORD myRec =
+              *(reinterpret_cast<const RECORD *>(fscan.getRecord().data()));
+          rids[myRec.i] = scanRid;
+        }
+      } catch (const EndOfFileException &e) {
+      }
+    }
+    for (int i = 0; i < relationSize / 2; i++) {
+      index.deleteEntry(&i, rids[i], MERGE_DELETE);
+    }
+    checkPassFail(coveringScan(&index, 0, GTE, 6000, LT, true),
+                  relationSize / 2 + 1000)
+    index.compact(1.0);
+    checkPassFail(coveringScan(&index, 0, GTE, 6000, LT, false),
+                  relationSize / 2 + 1000)
+    int key = 3000;
+    checkPassFail(index.contains(&key), true)
+  }
+  File::remove(coveringIndexName);
+
+  deleteRelation();
+}
+
+int coveringScan(BTreeIndex *index, int lowVal, Operator lowOp, int highVal,
+                 Operator highOp, bool batched) {
+  std::cout << "Covering scan for " << (lowOp == GT ? "(" : "[") << lowVal
+            << "," << highVal << (highOp == LT ? ")" : "]") << std::endl;
+
+  try {
+    index->startScan(&lowVal, lowOp, &highVal, highOp);
+  } catch (const NoSuchKeyFoundException &e) {
+    std::cout << "No Key Found satisfying the scan criteria." << std::endl;
+    return 0;
+  }
+
+  // the payloads alone must show every value of the range, in order, without
+  // fetching a single record
+  RecordId scanRids[64];
+  char payloads[64][20];
+  int numResults = 0;
+  int prev = lowOp == GT ? lowVal : lowVal - 1;
+  while (1) {
+    size_t numRids = 1;
+    if (batched) {
+      numRids = index->scanNextBatch(scanRids, 64, payloads);
+      if (numRids == 0) {
+        break;
+      }
+    } else {
+      try {
+        index->scanNext(scanRids[0], payloads[0]);
+      } catch (const IndexScanCompletedException &e) {
+        break;
+      }
+    }
+    for (size_t i = 0; i < numRids; i++) {
+      int val = atoi(payloads[i]);
+      if (val <= prev || strcmp(payloads[i] + 5, " string record") != 0) {
+        index->endScan();
+        return -1;
+      }
+      prev = val;
+    }
+    numResults += numRids;
+  }
+  index->endScan();
+  if (prev > highVal || (highOp == LT && prev == highVal)) {
+    return -1;
+  }
+
+  return numResults;
+}
+
+void test17() {
+  // Several threads read the pages of a relation through a buffer pool much
+  // smaller than the relation, so that they keep evicting each others pages
+  std::cout << "--------------------" << std::endl;
+  std::cout << "Concurrent readers on a small buffer pool" << std::endl;
+  createRelationForward();
+
+  // the first key on each page, as the file has it
+  std::vector<PageId> pageNos;
+  std::vector<int> firstKeys;
+  for (FileIterator it = file1->begin(); it != file1->end(); ++it) {
+    Page filePage = *it;
+    pageNos.push_back(filePage.page_number());
+    std::string firstRecord = *filePage.begin();
+    firstKeys.push_back(
+        reinterpret_cast<const RECORD *>(firstRecord.data())->i);
+  }
+
+  const int numThreads = 8;
+  const int numReads = 4000;
+  BufMgr smallBufMgr(10);
+  std::atomic<int> mismatches(0);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < numThreads; t++) {
+    threads.push_back(std::thread([&, t]() {
+      unsigned int seed = t;
+      for (int n = 0; n < numReads; n++) {
+        size_t i = rand_r(&seed) % pageNos.size();
+        Page *curPage;
+        try {
+          smallBufMgr.readPage(file1, pageNos[i], curPage);
+        } catch (const BufferExceededException &e) {
+          // every frame is pinned by the other threads for the moment
+          continue;
+        }
+        std::string firstRecord = *curPage->begin();
+        const RECORD *myRec =
+            reinterpret_cast<const RECORD *>(firstRecord.data());
+        if (curPage->page_number() != pageNos[i] || myRec->i != firstKeys[i]) {
+          mismatches++;
+        }
+        smallBufMgr.unPinPage(file1, pageNos[i], n % 3 == 0);
+      }
+    }));
+  }
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+  checkPassFail(mismatches.load(), 0)
+
+  smallBufMgr.flushFile(file1);
+  deleteRelation();
+}
+
+void test18() {
+  // Several threads insert into one index at once, interleaving their keys so
+  // that they split the same leaves, while other threads look up the entries
+  // already there and scan the whole index
+  std::cout << "--------------------" << std::endl;
+  std::cout << "Concurrent inserts, lookups and scans" << std::endl;
+  createRelationForward();
+  try {
+    File::remove(intIndexName);
+  } catch (const FileNotFoundException &e) {
+  }
+  const int numThreads = 4;
+  const int numInserts = 5000;
+
+  {
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER);
+    std::atomic<int> errors(0);
+    std::atomic<bool> inserting(true);
+    std::vector<std::thread> writers, readers;
+    for (int t = 0; t < numThreads; t++) {
+      writers.push_back(std::thread([&, t]() {
+        RecordId newRid;
+        newRid.page_number = 1;
+        for (int n = 0; n < numInserts; n++) {
+          int key = relationSize + n * numThreads + t;
+          newRid.slot_number = n + 1;
+          index.insertEntry(&key, newRid);
+        }
+      }));
+    }
+    for (int t = 0; t < 2; t++) {
+      readers.push_back(std::thread([&, t]() {
+        unsigned int seed = t;
+        while (inserting) {
+          int key = rand_r(&seed) % relationSize;
+          std::vector<RecordId> rids;
+          if (!index.lookup(&key, rids) || rids.size() != 1) {
+            errors++;
+          }
+        }
+      }));
+    }
+    readers.push_back(std::thread([&]() {
+      while (inserting) {
+        IndexCursor cursor(&index);
+        int lowVal = 0, highVal = relationSize + numThreads * numInserts;
+        cursor.startScan(&lowVal, GTE, &highVal, LT);
+        RecordId scanRids[64];
+        size_t numRids;
+        int numResults = 0;
+        while ((numRids = cursor.scanNextBatch(scanRids, 64)) > 0) {
+          numResults += numRids;
+        }
+        cursor.endScan();
+        if (numResults < relationSize) {
+          errors++;
+        }
+      }
+    }));
+    for (std::thread &thread : writers) {
+      thread.join();
+    }
+    inserting = false;
+    for (std::thread &thread : readers) {
+      thread.join();
+    }
+    checkPassFail(errors.load(), 0)
+
+    for (int key = relationSize; key < relationSize + numThreads * numInserts;
+         key++) {
+      if (!index.contains(&key)) {
+        errors++;
+      }
+    }
+    checkPassFail(errors.load(), 0)
+    checkPassFail(intScan(&index, 0, GTE, relationSize, LT), relationSize)
+  }
+
+  try {
+    File::remove(intIndexName);
+  } catch (const FileNotFoundException &e) {
+  }
+  deleteRelation();
+}
+
+void test19() {
+  // Every replacement policy keeps pinned pages, evicts others once the pool
+  // is full and keeps the contents of pages read by several threads apart
+  std::cout << "--------------------" << std::endl;
+  std::cout << "Replacement policies" << std::endl;
+  createRelationForward();
+
+  std::vector<PageId> pageNos;
+  std::vector<int> firstKeys;
+  for (FileIterator it = file1->begin(); it != file1->end(); ++it) {
+    Page filePage = *it;
+    pageNos.push_back(filePage.page_number());
+    std::string firstRecord = *filePage.begin();
+    firstKeys.push_back(
+        reinterpret_cast<const RECORD *>(firstRecord.data())->i);
+  }
+
+  const ReplacementPolicyType policies[] = {CLOCK_POLICY, LRUK_POLICY,
+                                            TWOQ_POLICY, ARC_POLICY,
+                                            CLOCKPRO_POLICY};
+  for (ReplacementPolicyType policy : policies) {
+    const std::uint32_t numFrames = 10;
+    BufMgr smallBufMgr(numFrames, policy);
+    std::cout << smallBufMgr.getPolicyName() << std::endl;
+
+    // a pool full of pinned pages has nothing to evict
+    Page *curPage;
+    for (std::uint32_t i = 0; i < numFrames; i++) {
+      smallBufMgr.readPage(file1, pageNos[i], curPage);
+    }
+    int exceeded = 0;
+    try {
+      smallBufMgr.readPage(file1, pageNos[numFrames], curPage);
+    } catch (const BufferExceededException &e) {
+      exceeded = 1;
+    }
+    checkPassFail(exceeded, 1)
+
+    // a page read again while in the pool is not read from disk
+    for (std::uint32_t i = 0; i < numFrames; i++) {
+      smallBufMgr.unPinPage(file1, pageNos[i], false);
+    }
+    smallBufMgr.readPage(file1, pageNos[numFrames], curPage);
+    smallBufMgr.unPinPage(file1, pageNos[numFrames], false);
+    int diskreads = smallBufMgr.getBufStats().diskreads;
+    smallBufMgr.readPage(file1, pageNos[numFrames], curPage);
+    smallBufMgr.unPinPage(file1, pageNos[numFrames], false);
+    checkPassFail(smallBufMgr.getBufStats().diskreads - diskreads, 0)
+
+    const int numThreads = 4;
+    const int numReads = 2000;
+    std::atomic<int> mismatches(0);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < numThreads; t++) {
+      threads.push_back(std::thread([&, t]() {
+        unsigned int seed = t;
+        for (int n = 0; n < numReads; n++) {
+          // half the reads go to a few pages, for the policies to keep
+          size_t i = rand_r(&seed) % (n % 2 == 0 ? 4 : pageNos.size());
+          Page *page;
+          try {
+            smallBufMgr.readPage(file1, pageNos[i], page);
+          } catch (const BufferExceededException &e) {
+            continue;
+          }
+          std::string firstRecord = *page->begin();
+          const RECORD *myRec =
+              reinterpret_cast<const RECORD *>(firstRecord.data());
+          if (page->page_number() != pageNos[i] || myRec->i != firstKeys[i]) {
+            mismatches++;
+          }
+          smallBufMgr.unPinPage(file1, pageNos[i], n % 3 == 0);
+        }
+      }));
+    }
+    for (std::thread &thread : threads) {
+      thread.join();
+    }
+    checkPassFail(mismatches.load(), 0)
+
+    smallBufMgr.flushFile(file1);
+  }
+  deleteRelation();
+}
+
+void test20() {
+  // Pages read by a scan or read once do not push the pages read normally
+  // out of a buffer pool much smaller than the relation
+  std::cout << "--------------------" << std::endl;
+  std::cout << "Scan resistant buffer pool" << std::endl;
+  createRelationForward();
+
+  std::vector<PageId> pageNos;
+  for (FileIterator it = file1->begin(); it != file1->end(); ++it) {
+    pageNos.push_back(it.page_number());
+  }
+
+  const size_t numHot = 10;
+  BufMgr smallBufMgr(20);
+  Page *curPage;
+  for (size_t i = 0; i < numHot; i++) {
+    smallBufMgr.readPage(file1, pageNos[i], curPage);
+    smallBufMgr.unPinPage(file1, pageNos[i], false);
+  }
+
+  // a full scan of the relation
+  int numScanned = 0;
+  {
+    FileScan fscan(relationName, &smallBufMgr);
+    try {
+      RecordId scanRid;
+      while (1) {
+        fscan.scanNext(scanRid);
+        numScanned++;
+      }
+    } catch (const EndOfFileException &e) {
+    }
+  }
+  checkPassFail(numScanned, relationSize)
+
+  // pages used once
+  for (size_t i = numHot; i < pageNos.size(); i++) {
+    smallBufMgr.readPage(file1, pageNos[i], curPage, ONE_SHOT_ACCESS);
+    smallBufMgr.unPinPage(file1, pageNos[i], false);
+  }
+
+  int diskreads = smallBufMgr.getBufStats().diskreads;
+  for (size_t i = 0; i < numHot; i++) {
+    smallBufMgr.readPage(file1, pageNos[i], curPage);
+    smallBufMgr.unPinPage(file1, pageNos[i], false);
+  }
+  checkPassFail(smallBufMgr.getBufStats().diskreads - diskreads, 0)
+
+  smallBufMgr.flushFile(file1);
+  deleteRelation();
+}
+
+void test21() {
+  // Pages asked to be read ahead arrive in the buffer pool in the background,
+  // following the chain of pages of the file
+  std::cout << "--------------------" << std::endl;
+  std::cout << "Read ahead" << std::endl;
+  createRelationForward();
+
+  std::vector<PageId> pageNos;
+  for (FileIterator it = file1->begin(); it != file1->end(); ++it) {
+    pageNos.push_back(it.page_number());
+  }
+
+  const int numAhead = 4;
+  BufMgr smallBufMgr(20);
+  Page *curPage;
+  smallBufMgr.readPage(file1, pageNos[0], curPage);
+  smallBufMgr.prefetch(file1, pageNos[0], numAhead, NORMAL_ACCESS,
+                       [](PageId pageNo, const Page &page) {
+                         return page.next_page_number();
+                       });
+  smallBufMgr.unPinPage(file1, pageNos[0], false);
+  for (int waited = 0;
+       smallBufMgr.getBufStats().diskreads < 1 + numAhead && waited < 500;
+       waited++) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  checkPassFail(smallBufMgr.getBufStats().diskreads.load(), 1 + numAhead)
+
+  // the pages are found in the pool
+  for (int i = 1; i <= numAhead; i++) {
+    smallBufMgr.readPage(file1, pageNos[i], curPage);
+    smallBufMgr.unPinPage(file1, pageNos[i], false);
+  }
+  checkPassFail(smallBufMgr.getBufStats().diskreads.load(), 1 + numAhead)
+
+  // a scan reading ahead on a small pool still sees every record once
+  int numScanned = 0;
+  {
+    FileScan fscan(relationName, &smallBufMgr);
+    try {
+      RecordId scanRid;
+      while (1) {
+        fscan.scanNext(scanRid);
+        numScanned++;
+      }
+    } catch (const EndOfFileException &e) {
+    }
+  }
+  checkPassFail(numScanned, relationSize)
+
+  smallBufMgr.flushFile(file1);
+  deleteRelation();
+}
+
+void test22() {
+  // Dirty pages left alone are written in the background, so evicting them
+  // later costs no write; a checkpoint writes the rest at once
+  std::cout << "--------------------" << std::endl;
+  std::cout << "Background flusher" << std::endl;
+  createRelationForward();
+
+  std::vector<PageId> pageNos;
+  for (FileIterator it = file1->begin(); it != file1->end(); ++it) {
+    pageNos.push_back(it.page_number());
+  }
+
+  const int numDirty = 10;
+  BufMgr smallBufMgr(20);
+  Page *curPage;
+  for (int i = 0; i < numDirty; i++) {
+    smallBufMgr.readPage(file1, pageNos[i], curPage);
+    smallBufMgr.unPinPage(file1, pageNos[i], true);
+  }
+  for (int waited = 0;
+       smallBufMgr.getBufStats().diskwrites < numDirty && waited < 500;
+       waited++) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  checkPassFail(smallBufMgr.getBufStats().diskwrites.load(), numDirty)
+
+  // filling the pool with other pages evicts the written ones as they are
+  for (int i = numDirty; i < numDirty + 20; i++) {
+    smallBufMgr.readPage(file1, pageNos[i], curPage);
+    smallBufMgr.unPinPage(file1, pageNos[i], false);
+  }
+  checkPassFail(smallBufMgr.getBufStats().diskwrites.load(), numDirty)
+
+  for (int i = 0; i < numDirty / 2; i++) {
+    smallBufMgr.readPage(file1, pageNos[i], curPage);
+    smallBufMgr.unPinPage(file1, pageNos[i], true);
+  }
+  smallBufMgr.checkpoint();
+  checkPassFail(smallBufMgr.getBufStats().diskwrites.load(),
+                numDirty + numDirty / 2)
+
+  smallBufMgr.flushFile(file1);
+  deleteRelation();
+}
+
+void test23() {
+  // Pages allocated leave the file header on disk alone until the file is
+  // synced, while every File object of the file sees them at once
+  std::cout << "--------------------" << std::endl;
+  std::cout << "Deferred file writes" << std::endl;
+  try {
+    File::remove(relationName);
+  } catch (const FileNotFoundException &e) {
+  }
+
+  // number of pages recorded in the header on disk
+  auto pagesOnDisk = []() {
+    FileHeader header;
+    std::ifstream raw(relationName, std::ios::binary);
+    raw.read(reinterpret_cast<char *>(&header), sizeof(header));
+    return int(header.num_pages);
+  };
+
+  {
+    const int numPages = 10;
+    PageFile file = PageFile::create(relationName);
+    for (int i = 0; i < numPages; i++) {
+      PageId pageNo;
+      file.allocatePage(pageNo);
+    }
+
+    PageFile other = PageFile::open(relationName);
+    int numSeen = 0;
+    for (FileIterator it = other.begin(); it != other.end(); ++it) {
+      numSeen++;
+    }
+    checkPassFail(numSeen, numPages)
+    checkPassFail(pagesOnDisk(), 1)
+
+    file.sync();
+    checkPassFail(pagesOnDisk(), 1 + numPages)
+  }
+
+  File::remove(relationName);
+}
+
+void test24() {
+  // Threads missing in the buffer pool read their pages from one file at
+  // once, each page once and into the right frame
+  std::cout << "--------------------" << std::endl;
+  std::cout << "Concurrent file reads" << std::endl;
+  createRelationForward();
+
+  std::vector<PageId> pageNos;
+  for (FileIterator it = file1->begin(); it != file1->end(); ++it) {
+    pageNos.push_back(it.page_number());
+  }
+
+  // the pool has exactly one frame per page, so a page given a frame twice
+  // pushes another page out and has it read again. Threads only collide on
+  // a miss now and then, hence the rounds
+  const int numThreads = 8;
+  const int numRounds = 20;
+  int mismatches = 0;
+  int extraReads = 0;
+  for (int round = 0; round < numRounds; round++) {
+    BufMgr bigBufMgr(pageNos.size());
+    std::atomic<int> roundMismatches(0);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < numThreads; t++) {
+      threads.push_back(std::thread([&, t]() {
+        // every thread goes through all the pages, starting at its own
+        for (size_t n = 0; n < pageNos.size(); n++) {
+          size_t i = (n + t * pageNos.size() / numThreads) % pageNos.size();
+          Page *page;
+          bigBufMgr.readPage(file1, pageNos[i], page);
+          if (page->page_number() != pageNos[i]) {
+            roundMismatches++;
+          }
+          bigBufMgr.unPinPage(file1, pageNos[i], false);
+        }
+      }));
+    }
+    for (std::thread &thread : threads) {
+      thread.join();
+    }
+    mismatches += roundMismatches.load();
+    extraReads +=
+        bigBufMgr.getBufStats().diskreads.load() - int(pageNos.size());
+    bigBufMgr.flushFile(file1);
+  }
+  checkPassFail(mismatches, 0)
+  checkPassFail(extraReads, 0)
+  deleteRelation();
+}
+
+void test25() {
+  // Pages read and written through an I/O engine, more of them than it
+  // keeps in flight, match the pages read and written one at a time
+  std::cout << "--------------------" << std::endl;
+  std::cout << "I/O engines" << std::endl;
+  createRelationForward();
+
+  std::vector<PageId> pageNos;
+  for (FileIterator it = file1->begin(); it != file1->end(); ++it) {
+    pageNos.push_back(it.page_number());
+  }
+
+  const IOEngineType types[] = {SYNC_IO, URING_IO};
+  for (IOEngineType type : types) {
+    std::unique_ptr<IOEngine> engine = IOEngine::create(type, 4);
+    std::cout << "engine: " << engine->name() << std::endl;
+
+    std::vector<Page> pages(pageNos.size());
+    std::vector<IORequest> requests(pageNos.size());
+    std::vector<IORequest *> done;
+    for (size_t i = 0; i < pageNos.size(); i++) {
+      file1->readPageAsync(*engine, pageNos[i], &pages[i], &requests[i]);
+    }
+    while (engine->inFlight() > 0) {
+      engine->complete(done);
+    }
+    checkPassFail(int(done.size()), int(pageNos.size()))
+
+    int mismatches = 0;
+    for (size_t i = 0; i < pageNos.size(); i++) {
+      file1->readPageDone(&requests[i], &pages[i]);
+      Page filePage = file1->readPage(pageNos[i]);
+      if (pages[i].page_number() != pageNos[i] ||
+          *pages[i].begin() != *filePage.begin()) {
+        mismatches++;
+      }
+    }
+    checkPassFail(mismatches, 0)
+
+    // negate the key of the first record of every page and write them back
+    for (size_t i = 0; i < pageNos.size(); i++) {
+      RecordId rid = {pageNos[i], 1};
+      std::string record = pages[i].getRecord(rid);
+      reinterpret_cast<RECORD *>(&record[0])->i *= -1;
+      pages[i].updateRecord(rid, record);
+      file1->writePageAsync(*engine, pageNos[i], pages[i], &requests[i]);
+    }
+    while (engine->inFlight() > 0) {
+      engine->complete(done);
+    }
+    mismatches = 0;
+    for (size_t i = 0; i < pageNos.size(); i++) {
+      file1->writePageDone(&requests[i]);
+      Page filePage = file1->readPage(pageNos[i]);
+      if (*pages[i].begin() != *filePage.begin()) {
+        mismatches++;
+      }
+    }
+    checkPassFail(mismatches, 0)
+  }
+
+  deleteRelation();
+}
+
+void test26() {
+  // An index mapped read only answers lookups and scans without the buffer
+  // pool, and refuses to change
+  std::cout << "--------------------" << std::endl;
+  std::cout << "createRelationRandom with a mapped index" << std::endl;
+  createRelationRandom();
+  try {
+    File::remove(intIndexName);
+  } catch (const FileNotFoundException &e) {
+  }
+
+  {
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER);
+    index.mapReadOnly();
+    checkPassFail(index.isReadOnly(), true)
+
+    bufMgr->clearBufStats();
+    int key = 42;
+    std::vector<RecordId> rids;
+    checkPassFail(index.lookup(&key, rids) && index.contains(&key), true)
+    checkPassFail(bufMgr->getBufStats().accesses.load(), 0)
+
+    checkPassFail(intScan(&index, 25, GT, 40, LT), 14)
+    checkPassFail(intScanBatch(&index, 0, GTE, relationSize, LT),
+                  relationSize)
+    checkPassFail(intLookup(&index, 3), 1)
+
+    bool refused = false;
+    try {
+      RecordId rid = {1, 1};
+      index.insertEntry(&key, rid);
+    } catch (const IndexReadOnlyException &e) {
+      refused = true;
+    }
+    checkPassFail(refused, true)
+  }
+  File::remove(intIndexName);
+
+  // mapping right after a scan, with read-ahead still queued, neither hangs
+  // nor loses entries. Each scan stops a little further, so that some stop
+  // just after moving to a leaf that read-ahead was queued from
+  bool allMapped = true;
+  for (int stop = 0; stop < relationSize; stop += 97) {
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER);
+    int lowVal = 0;
+    int highVal = relationSize;
+    RecordId scanRid;
+    index.startScan(&lowVal, GTE, &highVal, LT);
+    for (int i = 0; i < stop; i++) {
+      index.scanNext(scanRid);
+    }
+    index.mapReadOnly();
+    allMapped = allMapped && index.isReadOnly() &&
+                intScan(&index, 0, GTE, relationSize, LT) == relationSize;
+  }
+  checkPassFail(allMapped, true)
+  File::remove(intIndexName);
+
+  deleteRelation();
+}
+
+void test27() {
+  // Pages read straight into a page of the caller match pages read by value,
+  // and the used list keeps the order of allocation as pages are deleted and
+  // reused
+  std::cout << "--------------------" << std::endl;
+  std::cout << "Pages read in place" << std::endl;
+  createRelationForward();
+
+  std::vector<PageId> pageNos;
+  for (FileIterator it = file1->begin(); it != file1->end(); ++it) {
+    pageNos.push_back(it.page_number());
+  }
+
+  int mismatches = 0;
+  Page page;
+  for (PageId pageNo : pageNos) {
+    file1->readPage(pageNo, &page);
+    Page copy = file1->readPage(pageNo);
+    if (page.page_number() != pageNo || *page.begin() != *copy.begin()) {
+      mismatches++;
+    }
+  }
+  checkPassFail(mismatches, 0)
+
+  // delete every page, the last one first, and allocate twice as many, which
+  // reuses them all in page number order before growing the file
+  for (size_t i = pageNos.size(); i-- > 0;) {
+    file1->deletePage(pageNos[i]);
+  }
+  checkPassFail(int(file1->begin() == file1->end()), 1)
+  std::vector<PageId> allocated;
+  for (size_t i = 0; i < 2 * pageNos.size(); i++) {
+    PageId pageNo;
+    file1->allocatePage(pageNo, &page);
+    allocated.push_back(pageNo);
+  }
+  checkPassFail(int(allocated[0] == pageNos[0]), 1)
+
+  // drop a page from the middle and the last one, then allocate another,
+  // which is linked in after the page that became the last
+  file1->deletePage(allocated[1]);
+  allocated.erase(allocated.begin() + 1);
+  file1->deletePage(allocated.back());
+  allocated.pop_back();
+  PageId pageNo;
+  file1->allocatePage(pageNo, &page);
+  allocated.push_back(pageNo);
+
+  // pages are iterated over in the order they were allocated
+  std::vector<PageId> iterated;
+  for (FileIterator it = file1->begin();
+       it != file1->end() && iterated.size() <= allocated.size(); ++it) {
+    iterated.push_back(it.page_number());
+  }
+  checkPassFail(int(iterated == allocated), 1)
+
+  deleteRelation();
+}
+
+void test28() {
+  // Records inserted through the free-space map fill the room left by deleted
+  // records before the file grows, also after the file is reopened
+  std::cout << "--------------------" << std::endl;
+  std::cout << "Free-space map" << std::endl;
+  deleteRelation();
+  file1 = new PageFile(relationName, true);
+
+  const std::string record(100, 'r');
+  std::vector<RecordId> rids;
+  for (int i = 0; i < 2000; i++) {
+    rids.push_back(bufMgr->insertRecord(file1, record));
+  }
+  std::set<PageId> recordPages;
+  for (const RecordId &rid : rids) {
+    recordPages.insert(rid.page_number);
+  }
+  // pages of the map are not on the used list
+  int usedPages = 0;
+  for (FileIterator it = file1->begin(); it != file1->end(); ++it) {
+    usedPages++;
+  }
+  checkPassFail(usedPages, int(recordPages.size()))
+
+  // free half the room on every page, and write the map out
+  for (size_t i = 0; i < rids.size(); i += 2) {
+    bufMgr->deleteRecord(file1, rids[i]);
+  }
+  bufMgr->flushFile(file1);
+  delete file1;
+  file1 = new PageFile(relationName, false);
+
+  // the room is found again without a new page
+  int mismatches = 0;
+  const std::string other(100, 'o');
+  for (int i = 0; i < 1000; i++) {
+    RecordId rid = bufMgr->insertRecord(file1, other);
+    if (recordPages.count(rid.page_number) == 0) {
+      mismatches++;
+    }
+    Page *page;
+    bufMgr->readPage(file1, rid.page_number, page);
+    if (page->getRecord(rid) != other) {
+      mismatches++;
+    }
+    bufMgr->unPinPage(file1, rid.page_number, false);
+  }
+  checkPassFail(mismatches, 0)
+  usedPages = 0;
+  for (FileIterator it = file1->begin(); it != file1->end(); ++it) {
+    usedPages++;
+  }
+  checkPassFail(usedPages, int(recordPages.size()))
+
+  // a record bigger than the room left on any page gets a new page
+  RecordId bigRid = bufMgr->insertRecord(file1, std::string(5000, 'b'));
+  checkPassFail(int(recordPages.count(bigRid.page_number)), 0)
+
+  // records of mixed sizes deleted and inserted again in turn stay intact
+  std::vector<std::pair<RecordId, std::string>> live;
+  mismatches = 0;
+  for (int round = 0; round < 5; round++) {
+    for (int i = 0; i < 1000; i++) {
+      std::string data(random() % 600 + 1, char('a' + i % 26));
+      live.push_back(
+          std::make_pair(bufMgr->insertRecord(file1, data), data));
+    }
+    for (size_t i = live.size() / 2; i > 0; i--) {
+      size_t pos = random() % live.size();
+      bufMgr->deleteRecord(file1, live[pos].first);
+      live[pos] = live.back();
+      live.pop_back();
+    }
+  }
+  for (const std::pair<RecordId, std::string> &record : live) {
+    Page *page;
+    bufMgr->readPage(file1, record.first.page_number, page);
+    if (page->getRecord(record.first) != record.second) {
+      mismatches++;
+    }
+    bufMgr->unPinPage(file1, record.first.page_number, false);
+  }
+  checkPassFail(mismatches, 0)
+
+  // on a page filled to the last byte, a record inserted in a new slot after
+  // a deletion moved the others finds the slot free
+  Page full;
+  std::vector<RecordId> fullRids;
+  const std::string filler(1000, 'f');
+  while (full.hasSpaceForRecord(filler)) {
+    fullRids.push_back(full.insertRecord(filler));
+  }
+  full.insertRecord(
+      std::string(full.getFreeSpace() - sizeof(PageSlot), 'l'));
+  full.deleteRecord(fullRids[0]);
+  full.insertRecord("s");
+  RecordId newSlotRid = full.insertRecord("t");
+  checkPassFail(int(full.getRecord(newSlotRid) == "t"), 1)
+
+  // a record too big for any page is refused, without a page left behind
+  int thrown = 0;
+  try {
+    bufMgr->insertRecord(file1, std::string(Page::DATA_SIZE, 'x'));
+  } catch (const InsufficientSpaceException &e) {
+    thrown = 1;
+  }
+  checkPassFail(thrown, 1)
+
+  deleteRelation();
+}
+
+int intScanBatch(BTreeIndex *index, int lowVal, Operator lowOp, int highVal,
+                 Operator highOp) {
+  std::cout << "Batched scan for " << (lowOp == GT ? "(" : "[") << lowVal
+            << "," << highVal << (highOp == LT ? ")" : "]") << std::endl;
+
+  try {
+    index->startScan(&lowVal, lowOp, &highVal, highOp);
+  } catch (const NoSuchKeyFoundException &e) {
+    std::cout << "No Key Found satisfying the scan criteria." << std::endl;
+    return 0;
+  }
+
+  // every entry returned must point at a record inside the range
+  RecordId scanRids[64];
+  int numResults = 0;
+  size_t numRids;
+  while ((numRids = index->scanNextBatch(scanRids, 64)) > 0) {
+    for (size_t i = 0; i < numRids; i++) {
+      Page *curPage;
+      bufMgr->readPage(file1, scanRids[i].page_number, curPage);
+      RECORD myRec = *(reinterpret_cast<const RECORD *>(
+          curPage->getRecord(scanRids[i]).data()));
+      bufMgr->unPinPage(file1, scanRids[i].page_number, false);
+      if (!(lowOp == GT ? myRec.i > lowVal : myRec.i >= lowVal) ||
+          !(highOp == LT ? myRec.i < highVal : myRec.i <= highVal)) {
+        index->endScan();
+        return -1;
+      }
+    }
+    numResults += numRids;
+  }
+  index->endScan();
+
+  return numResults;
+}
+
+int intLookup(BTreeIndex *index, int key) {
+  std::cout << "Lookup for " << key << std::endl;
+  std::vector<RecordId> rids;
+  bool found = index->lookup(&key, rids);
+  if (found != index->contains(&key) || found != !rids.empty()) {
+    return -1;
+  }
+
+  // count only the entries pointing at a record with that key
+  int numResults = 0;
+  for (const RecordId &lookupRid : rids) {
+    Page *curPage;
+    bufMgr->readPage(file1, lookupRid.page_number, curPage);
+    RECORD myRec = *(
+        reinterpret_cast<const RECORD *>(curPage->getRecord(lookupRid).data()));
+    bufMgr->unPinPage(file1, lookupRid.page_number, false);
+    if (myRec.i == key) {
+      numResults++;
+    }
+  }
+  return numResults;
+}
+
 // -----------------------------------------------------------------------------
 // createRelationForward
 // -----------------------------------------------------------------------------
@@ -401,6 +1865,59 @@ void createRelationRandom() {
   file1->writePage(new_page_number, new_page);
 }
 
+// -----------------------------------------------------------------------------
+// createRelationComposite
+// -----------------------------------------------------------------------------
+
+void createRelationComposite() {
+  // destroy any old copies of relation file
+  try {
+    File::remove(relationName);
+  } catch (const FileNotFoundException &e) {
+  }
+  file1 = new PageFile(relationName, true);
+
+  // initialize all of record1.s to keep purify happy
+  memset(record1.s, ' ', sizeof(record1.s));
+  PageId new_page_number;
+  Page new_page = file1->allocatePage(new_page_number);
+
+  // insert records in random order, val split into a tenant and an offset
+  std::vector<int> intvec(relationSize);
+  for (int i = 0; i < relationSize; i++) {
+    intvec[i] = i;
+  }
+
+  long pos;
+  int val;
+  int i = 0;
+  while (i < relationSize) {
+    pos = random() % (relationSize - i);
+    val = intvec[pos];
+    sprintf(record1.s, "%05d string record", val);
+    record1.i = val / 500 - 5;
+    record1.d = val % 500;
+
+    std::string new_data(reinterpret_cast<char *>(&record1), sizeof(RECORD));
+
+    while (1) {
+      try {
+        new_page.insertRecord(new_data);
+        break;
+      } catch (const InsufficientSpaceException &e) {
+        file1->writePage(new_page_number, new_page);
+        new_page = file1->allocatePage(new_page_number);
+      }
+    }
+
+    int temp = intvec[relationSize - 1 - i];
+    intvec[relationSize - 1 - i] = intvec[pos];
+    intvec[pos] = temp;
+    i++;
+  }
+
+  file1->writePage(new_page_number, new_page);
+}
 
 // -----------------------------------------------------------------------------
 // createRelationForwardMiddle
@@ -580,6 +2097,16 @@ void indexTests() {
     File::remove(intIndexName);
   } catch (const FileNotFoundException &e) {
   }
+  doubleTests();
+  try {
+    File::remove(doubleIndexName);
+  } catch (const FileNotFoundException &e) {
+  }
+  stringTests();
+  try {
+    File::remove(stringIndexName);
+  } catch (const FileNotFoundException &e) {
+  }
 }
 
 // -----------------------------------------------------------------------------
@@ -661,123 +2188,105 @@ int intScan(BTreeIndex *index, int lowVal, Operator lowOp, int highVal,
 }
 
 // -----------------------------------------------------------------------------
-// errorTests
+// doubleTests
 // -----------------------------------------------------------------------------
 
-void errorTests() {
-  {
-    std::cout << "Error handling tests" << std::endl;
-    std::cout << "--------------------" << std::endl;
-    // Given error test
-
-    try {
-      File::remove(relationName);
-    } catch (const FileNotFoundException &e) {
-    }
-
-    file1 = new PageFile(relationName, true);
-
-    // initialize all of record1.s to keep purify happy
-    memset(record1.s, ' ', sizeof(record1.s));
-    PageId new_page_number;
-    Page new_page = file1->allocatePage(new_page_number);
-
-    // Insert a bunch of tuples into the relation.
-    for (int i = 0; i < 10; i++) {
-      sprintf(record1.s, "%05d string record", i);
-      record1.i = i;
-      record1.d = (double)i;
-      std::string new_data(reinterpret_cast<char *>(&record1), sizeof(record1));
-
-      while (1) {
-        try {
-          new_page.insertRecord(new_data);
-          break;
-        } catch (const InsufficientSpaceException &e) {
-          file1->writePage(new_page_number, new_page);
-          new_page = file1->allocatePage(new_page_number);
-        }
-      }
-    }
-
-    file1->writePage(new_page_number, new_page);
+void doubleTests() {
+  std::cout << "Create a B+ Tree index on the double field" << std::endl;
+  BTreeIndex index(relationName, doubleIndexName, bufMgr, offsetof(tuple, d),
+                   DOUBLE);
 
-    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
-                     INTEGER);
+  // run some tests
+  checkPassFail(doubleScan(&index, 25, GT, 40, LT), 14)
+  checkPassFail(doubleScan(&index, 20, GTE, 35, LTE), 16)
+  checkPassFail(doubleScan(&index, -3, GT, 3, LT), 3)
+  checkPassFail(doubleScan(&index, 996, GT, 1001, LT), 4)
+  checkPassFail(doubleScan(&index, 0, GT, 1, LT), 0)
+  checkPassFail(doubleScan(&index, 300, GT, 400, LT), 99)
+  checkPassFail(doubleScan(&index, 3000, GTE, 4000, LT), 1000)
+  checkPassFail(doubleScan(&index, 24.5, GT, 40.5, LT), 16)
+}
 
-    int int2 = 2;
-    int int5 = 5;
+int doubleScan(BTreeIndex *index, double lowVal, Operator lowOp,
+               double highVal, Operator highOp) {
+  RecordId scanRid;
+  Page *curPage;
 
-    // Scan Tests
-    std::cout << "Call endScan before startScan" << std::endl;
-    try {
-      index.endScan();
-      std::cout << "ScanNotInitialized Test 1 Failed." << std::endl;
-    } catch (const ScanNotInitializedException &e) {
-      std::cout << "ScanNotInitialized Test 1 Passed." << std::endl;
-    }
+  std::cout << "Scan for ";
+  if (lowOp == GT) {
+    std::cout << "(";
+  } else {
+    std::cout << "[";
+  }
+  std::cout << lowVal << "," << highVal;
+  if (highOp == LT) {
+    std::cout << ")";
+  } else {
+    std::cout << "]";
+  }
+  std::cout << std::endl;
 
-    std::cout << "Call scanNext before startScan" << std::endl;
-    try {
-      RecordId foo;
-      index.scanNext(foo);
-      std::cout << "ScanNotInitialized Test 2 Failed." << std::endl;
-    } catch (const ScanNotInitializedException &e) {
-      std::cout << "ScanNotInitialized Test 2 Passed." << std::endl;
-    }
+  int numResults = 0;
 
-    std::cout << "Scan with bad lowOp" << std::endl;
-    try {
-      index.startScan(&int2, LTE, &int5, LTE);
-      std::cout << "BadOpcodesException Test 1 Failed." << std::endl;
-    } catch (const BadOpcodesException &e) {
-      std::cout << "BadOpcodesException Test 1 Passed." << std::endl;
-    }
+  try {
+    index->startScan(&lowVal, lowOp, &highVal, highOp);
+  } catch (const NoSuchKeyFoundException &e) {
+    std::cout << "No Key Found satisfying the scan criteria." << std::endl;
+    return 0;
+  }
 
-    std::cout << "Scan with bad highOp" << std::endl;
+  while (1) {
     try {
-      index.startScan(&int2, GTE, &int5, GTE);
-      std::cout << "BadOpcodesException Test 2 Failed." << std::endl;
-    } catch (const BadOpcodesException &e) {
-      std::cout << "BadOpcodesException Test 2 Passed." << std::endl;
-    }
+      index->scanNext(scanRid);
+      bufMgr->readPage(file1, scanRid.page_number, curPage);
+      RECORD myRec = *(
+          reinterpret_cast<const RECORD *>(curPage->getRecord(scanRid).data()));
+      bufMgr->unPinPage(file1, scanRid.page_number, false);
 
-    std::cout << "Scan with bad range" << std::endl;
-    try {
-      index.startScan(&int5, GTE, &int2, LTE);
-      std::cout << "BadScanrangeException Test 1 Failed." << std::endl;
-    } catch (const BadScanrangeException &e) {
-      std::cout << "BadScanrangeException Test 1 Passed." << std::endl;
+      if (numResults < 5) {
+        std::cout << "at:" << scanRid.page_number << "," << scanRid.slot_number;
+        std::cout << " -->:" << myRec.i << ":" << myRec.d << ":" << myRec.s
+                  << ":" << std::endl;
+      } else if (numResults == 5) {
+        std::cout << "..." << std::endl;
+      }
+    } catch (const IndexScanCompletedException &e) {
+      break;
     }
 
-    deleteRelation();
+    numResults++;
   }
 
-  try {
-    File::remove(intIndexName);
-  } catch (const FileNotFoundException &e) {
+  if (numResults >= 5) {
+    std::cout << "Number of results: " << numResults << std::endl;
   }
+  index->endScan();
+  std::cout << std::endl;
+
+  return numResults;
 }
 
-void deleteRelation() {
-  if (file1) {
-    bufMgr->flushFile(file1);
-    delete file1;
-    file1 = NULL;
-  }
-  try {
-    File::remove(relationName);
-  } catch (const FileNotFoundException &e) {
-  }
-}         checkPassFail(intScan(&index, -3, GT, 3, LT), 3)
-              checkPassFail(intScan(&index, 996, GT, 1001, LT), 4)
-                  checkPassFail(intScan(&index, 0, GT, 1, LT), 0) checkPassFail(
-                      intScan(&index, 300, GT, 400, LT), 99)
-                      checkPassFail(intScan(&index, 3000, GTE, 4000, LT), 1000)
+// -----------------------------------------------------------------------------
+// stringTests
+// -----------------------------------------------------------------------------
+
+void stringTests() {
+  std::cout << "Create a B+ Tree index on the string field" << std::endl;
+  BTreeIndex index(relationName, stringIndexName, bufMgr, offsetof(tuple, s),
+                   STRING);
+
+  // run some tests
+  checkPassFail(stringScan(&index, 25, GT, 40, LT), 14)
+  checkPassFail(stringScan(&index, 20, GTE, 35, LTE), 16)
+  checkPassFail(stringScan(&index, -3, GT, 3, LT), 3)
+  checkPassFail(stringScan(&index, 996, GT, 1001, LT), 4)
+  checkPassFail(stringScan(&index, 0, GT, 1, LT), 0)
+  checkPassFail(stringScan(&index, 300, GT, 400, LT), 99)
+  checkPassFail(stringScan(&index, 3000, GTE, 4000, LT), 1000)
 }
 
-int intScan(BTreeIndex *index, int lowVal, Operator lowOp, int highVal,
-            Operator highOp) {
+int stringScan(BTreeIndex *index, int lowVal, Operator lowOp, int highVal,
+               Operator highOp) {
   RecordId scanRid;
   Page *curPage;
 
@@ -795,10 +2304,16 @@ int intScan(BTreeIndex *index, int lowVal, Operator lowOp, int highVal,
   }
   std::cout << std::endl;
 
+  // keys are the first STRINGSIZE characters of the string field
+  char lowValStr[100];
+  sprintf(lowValStr, "%05d string record", lowVal);
+  char highValStr[100];
+  sprintf(highValStr, "%05d string record", highVal);
+
   int numResults = 0;
 
   try {
-    index->startScan(&lowVal, lowOp, &highVal, highOp);
+    index->startScan(lowValStr, lowOp, highValStr, highOp);
   } catch (const NoSuchKeyFoundException &e) {
     std::cout << "No Key Found satisfying the scan criteria." << std::endl;
     return 0;
@@ -10,6 +10,7 @@
  *     <li> @ref prereq_sec
  *     <li> @ref commands_sec
  *     <li> @ref modify_run_main_sec
+ *     <li> @ref benchmark_sec
  *     <li> @ref documentation_sec
  *   </ol>
  *   <li> @ref api_sec
@@ -68,6 +69,15 @@
  * If you want to edit what <code>badgerdb_main</code> does, edit
  * <code>src/main.cpp</code>.
  *
+ * @subsection benchmark_sec Comparing buffer replacement policies
+ *
+ * <code>BufMgr</code> takes the replacement policy to use as a constructor
+ * argument. To compare the hit rates of the policies on a few workloads, run:
+ * @code
+ *   $ make bench
+ *   $ ./src/badgerdb_bench [frames [records]]
+ * @endcode
+ *
  * @subsection documentation_sec Rebuilding the documentation
  *
  * Documentation is generated by using Doxygen.  If you have updated the
@@ -0,0 +1,576 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University
+ * of Wisconsin-Madison.
+ */
+
+#include "replacement.h"
+
+#include <algorithm>
+
+namespace badgerdb {
+
+ReplacementPolicy* ReplacementPolicy::create(ReplacementPolicyType type,
+                                             std::uint32_t numBufs) {
+  switch (type) {
+    case LRUK_POLICY:
+      return new LRUKPolicy(numBufs, 2);
+    case TWOQ_POLICY:
+      return new TwoQPolicy(numBufs);
+    case ARC_POLICY:
+      return new ARCPolicy(numBufs);
+    case CLOCKPRO_POLICY:
+      return new ClockProPolicy(numBufs);
+    case CLOCK_POLICY:
+    default:
+      return new ClockPolicy(numBufs);
+  }
+}
+
+// -----------------------------------------------------------------------------
+// ClockPolicy
+// -----------------------------------------------------------------------------
+
+ClockPolicy::ClockPolicy(std::uint32_t numBufs)
+    : numBufs(numBufs), refbits(new std::atomic<bool>[numBufs]) {
+  for (std::uint32_t i = 0; i < numBufs; i++) {
+    refbits[i] = false;
+  }
+  clockHand = numBufs - 1;
+}
+
+FrameId ClockPolicy::advanceClock() {
+  FrameId hand = clockHand.load();
+  FrameId next;
+  do {
+    next = (hand + 1) % numBufs;
+  } while (!clockHand.compare_exchange_weak(hand, next));
+  return next;
+}
+
+void ClockPolicy::loaded(FrameId frame, const File* file, PageId pageNo) {
+  refbits[frame] = true;
+}
+
+void ClockPolicy::accessed(FrameId frame) { refbits[frame] = true; }
+
+void ClockPolicy::removed(FrameId frame, bool evicted) {
+  refbits[frame] = false;
+}
+
+bool ClockPolicy::victim(FrameId& frame,
+                         const std::function<bool(FrameId)>& evictable) {
+  for (std::uint32_t numScanned = 0; numScanned < 2 * numBufs;
+       numScanned++) {  // Need to scan twice
+    FrameId frameNo = advanceClock();
+
+    // has been referenced, clear the bit
+    if (refbits[frameNo].exchange(false)) {
+      continue;
+    }
+    if (evictable(frameNo)) {
+      frame = frameNo;
+      return true;
+    }
+  }
+  return false;
+}
+
+// -----------------------------------------------------------------------------
+// LRUKPolicy
+// -----------------------------------------------------------------------------
+
+LRUKPolicy::LRUKPolicy(std::uint32_t numBufs, int k)
+    : k(k),
+      now(0),
+      policyName("LRU-" + std::to_string(k)),
+      history(numBufs * k, 0),
+      resident(numBufs, false) {}
+
+LRUKPolicy::Rank LRUKPolicy::rankOf(FrameId frame) const {
+  return Rank(std::make_pair(history[frame * k + k - 1], history[frame * k]),
+              frame);
+}
+
+void LRUKPolicy::touch(FrameId frame) {
+  ranks.erase(rankOf(frame));
+  std::uint64_t* times = &history[frame * k];
+  for (int i = k - 1; i > 0; i--) {
+    times[i] = times[i - 1];
+  }
+  times[0] = ++now;
+  ranks.insert(rankOf(frame));
+}
+
+void LRUKPolicy::loaded(FrameId frame, const File* file, PageId pageNo) {
+  std::lock_guard<std::mutex> guard(latch);
+  if (resident[frame]) {
+    ranks.erase(rankOf(frame));
+  }
+  std::fill(history.begin() + frame * k, history.begin() + (frame + 1) * k, 0);
+  resident[frame] = true;
+  touch(frame);
+}
+
+void LRUKPolicy::accessed(FrameId frame) {
+  std::lock_guard<std::mutex> guard(latch);
+  if (resident[frame]) {
+    touch(frame);
+  }
+}
+
+void LRUKPolicy::removed(FrameId frame, bool evicted) {
+  std::lock_guard<std::mutex> guard(latch);
+  if (resident[frame]) {
+    ranks.erase(rankOf(frame));
+  }
+  resident[frame] = false;
+}
+
+bool LRUKPolicy::victim(FrameId& frame,
+                        const std::function<bool(FrameId)>& evictable) {
+  std::lock_guard<std::mutex> guard(latch);
+
+  // the best page is usually unpinned, so the walk mostly ends at once
+  for (std::set<Rank>::const_iterator it = ranks.begin(); it != ranks.end();
+       ++it) {
+    if (evictable(it->second)) {
+      frame = it->second;
+      return true;
+    }
+  }
+  return false;
+}
+
+// -----------------------------------------------------------------------------
+// TwoQPolicy
+// -----------------------------------------------------------------------------
+
+TwoQPolicy::TwoQPolicy(std::uint32_t numBufs)
+    : kin(std::max<std::size_t>(1, numBufs / 4)),
+      kout(std::max<std::size_t>(1, numBufs / 2)),
+      queues(numBufs, NONE),
+      positions(numBufs),
+      pages(numBufs) {}
+
+void TwoQPolicy::detach(FrameId frame) {
+  if (queues[frame] == A1IN) {
+    a1in.erase(positions[frame]);
+  } else if (queues[frame] == AM) {
+    am.erase(positions[frame]);
+  }
+  queues[frame] = NONE;
+}
+
+bool TwoQPolicy::oldestEvictable(
+    std::list<FrameId>& queue, FrameId& frame,
+    const std::function<bool(FrameId)>& evictable) {
+  for (std::list<FrameId>::reverse_iterator it = queue.rbegin();
+       it != queue.rend(); ++it) {
+    if (evictable(*it)) {
+      frame = *it;
+      return true;
+    }
+  }
+  return false;
+}
+
+void TwoQPolicy::loaded(FrameId frame, const File* file, PageId pageNo) {
+  std::lock_guard<std::mutex> guard(latch);
+  detach(frame);
+  pages[frame] = PageKey(file, pageNo);
+
+  // a page asked for again after leaving A1in is hot
+  std::map<PageKey, std::list<PageKey>::iterator>::iterator ghost =
+      a1outIndex.find(pages[frame]);
+  if (ghost != a1outIndex.end()) {
+    a1out.erase(ghost->second);
+    a1outIndex.erase(ghost);
+    am.push_front(frame);
+    queues[frame] = AM;
+    positions[frame] = am.begin();
+  } else {
+    a1in.push_front(frame);
+    queues[frame] = A1IN;
+    positions[frame] = a1in.begin();
+  }
+}
+
+void TwoQPolicy::accessed(FrameId frame) {
+  std::lock_guard<std::mutex> guard(latch);
+
+  // pages on A1in stay where they are, their first accesses are often
+  // correlated
+  if (queues[frame] == AM) {
+    am.splice(am.begin(), am, positions[frame]);
+  }
+}
+
+void TwoQPolicy::removed(FrameId frame, bool evicted) {
+  std::lock_guard<std::mutex> guard(latch);
+  if (evicted && queues[frame] == A1IN) {
+    a1out.push_front(pages[frame]);
+    a1outIndex[pages[frame]] = a1out.begin();
+    if (a1out.size() > kout) {
+      a1outIndex.erase(a1out.back());
+      a1out.pop_back();
+    }
+  }
+  detach(frame);
+}
+
+bool TwoQPolicy::victim(FrameId& frame,
+                        const std::function<bool(FrameId)>& evictable) {
+  std::lock_guard<std::mutex> guard(latch);
+  if (a1in.size() > kin) {
+    return oldestEvictable(a1in, frame, evictable) ||
+           oldestEvictable(am, frame, evictable);
+  }
+  return oldestEvictable(am, frame, evictable) ||
+         oldestEvictable(a1in, frame, evictable);
+}
+
+// -----------------------------------------------------------------------------
+// ARCPolicy
+// -----------------------------------------------------------------------------
+
+ARCPolicy::ARCPolicy(std::uint32_t numBufs)
+    : capacity(numBufs),
+      target(0),
+      queues(numBufs, NONE),
+      positions(numBufs),
+      pages(numBufs) {}
+
+void ARCPolicy::detach(FrameId frame) {
+  if (queues[frame] == T1) {
+    t1.erase(positions[frame]);
+  } else if (queues[frame] == T2) {
+    t2.erase(positions[frame]);
+  }
+  queues[frame] = NONE;
+}
+
+void ARCPolicy::dropGhost(Queue queue) {
+  std::list<PageKey>& ghosts = queue == B1 ? b1 : b2;
+  ghostIndex.erase(ghosts.back());
+  ghosts.pop_back();
+}
+
+void ARCPolicy::trimGhosts() {
+  while (t1.size() + b1.size() > capacity && !b1.empty()) {
+    dropGhost(B1);
+  }
+  while (t1.size() + t2.size() + b1.size() + b2.size() > 2 * capacity) {
+    if (!b2.empty()) {
+      dropGhost(B2);
+    } else if (!b1.empty()) {
+      dropGhost(B1);
+    } else {
+      break;
+    }
+  }
+}
+
+bool ARCPolicy::oldestEvictable(
+    std::list<FrameId>& queue, FrameId& frame,
+    const std::function<bool(FrameId)>& evictable) {
+  for (std::list<FrameId>::reverse_iterator it = queue.rbegin();
+       it != queue.rend(); ++it) {
+    if (evictable(*it)) {
+      frame = *it;
+      return true;
+    }
+  }
+  return false;
+}
+
+void ARCPolicy::loaded(FrameId frame, const File* file, PageId pageNo) {
+  std::lock_guard<std::mutex> guard(latch);
+  detach(frame);
+  pages[frame] = PageKey(file, pageNo);
+
+  std::map<PageKey, std::pair<Queue, std::list<PageKey>::iterator>>::iterator
+      ghost = ghostIndex.find(pages[frame]);
+  if (ghost == ghostIndex.end()) {
+    t1.push_front(frame);
+    queues[frame] = T1;
+    positions[frame] = t1.begin();
+  } else {
+    // a miss on a page evicted from T1 means T1 should have been larger, one
+    // on a page evicted from T2 that T2 should have been
+    if (ghost->second.first == B1) {
+      std::size_t delta = std::max<std::size_t>(1, b2.size() / b1.size());
+      target = std::min(capacity, target + delta);
+      b1.erase(ghost->second.second);
+    } else {
+      std::size_t delta = std::max<std::size_t>(1, b1.size() / b2.size());
+      target = target > delta ? target - delta : 0;
+      b2.erase(ghost->second.second);
+    }
+    ghostIndex.erase(ghost);
+    t2.push_front(frame);
+    queues[frame] = T2;
+    positions[frame] = t2.begin();
+  }
+  trimGhosts();
+}
+
+void ARCPolicy::accessed(FrameId frame) {
+  std::lock_guard<std::mutex> guard(latch);
+  if (queues[frame] == T1) {
+    t1.erase(positions[frame]);
+  } else if (queues[frame] == T2) {
+    t2.erase(positions[frame]);
+  } else {
+    return;
+  }
+  t2.push_front(frame);
+  queues[frame] = T2;
+  positions[frame] = t2.begin();
+}
+
+void ARCPolicy::removed(FrameId frame, bool evicted) {
+  std::lock_guard<std::mutex> guard(latch);
+  if (evicted && queues[frame] != NONE) {
+    Queue queue = queues[frame] == T1 ? B1 : B2;
+    std::list<PageKey>& ghosts = queue == B1 ? b1 : b2;
+    ghosts.push_front(pages[frame]);
+    ghostIndex[pages[frame]] = std::make_pair(queue, ghosts.begin());
+  }
+  detach(frame);
+  trimGhosts();
+}
+
+bool ARCPolicy::victim(FrameId& frame,
+                       const std::function<bool(FrameId)>& evictable) {
+  std::lock_guard<std::mutex> guard(latch);
+  if (!t1.empty() && (t1.size() > target || t2.empty())) {
+    return oldestEvictable(t1, frame, evictable) ||
+           oldestEvictable(t2, frame, evictable);
+  }
+  return oldestEvictable(t2, frame, evictable) ||
+         oldestEvictable(t1, frame, evictable);
+}
+
+// -----------------------------------------------------------------------------
+// ClockProPolicy
+// -----------------------------------------------------------------------------
+
+ClockProPolicy::ClockProPolicy(std::uint32_t numBufs)
+    : numBufs(numBufs),
+      entries(2 * numBufs),
+      handHot(-1),
+      handCold(-1),
+      handTest(-1),
+      numHot(0),
+      numCold(0),
+      numGhosts(0),
+      coldTarget(std::max<int>(1, numBufs / 4)) {
+  for (int i = 0; i < 2 * this->numBufs; i++) {
+    entries[i].onClock = false;
+  }
+  for (int i = 2 * this->numBufs - 1; i >= this->numBufs; i--) {
+    freeGhosts.push_back(i);
+  }
+}
+
+void ClockProPolicy::link(int i) {
+  Entry& entry = entries[i];
+  entry.onClock = true;
+  if (handHot == -1) {
+    entry.prev = entry.next = i;
+    handHot = handCold = handTest = i;
+    return;
+  }
+  entry.next = handHot;
+  entry.prev = entries[handHot].prev;
+  entries[entry.prev].next = i;
+  entries[handHot].prev = i;
+}
+
+void ClockProPolicy::unlink(int i) {
+  Entry& entry = entries[i];
+  entry.onClock = false;
+  if (entry.next == i) {
+    handHot = handCold = handTest = -1;
+    return;
+  }
+  entries[entry.prev].next = entry.next;
+  entries[entry.next].prev = entry.prev;
+  if (handHot == i) handHot = entry.next;
+  if (handCold == i) handCold = entry.next;
+  if (handTest == i) handTest = entry.next;
+}
+
+void ClockProPolicy::replace(int i, int j) {
+  Entry& entry = entries[i];
+  entry.onClock = false;
+  entries[j].onClock = true;
+  if (entry.next == i) {
+    entries[j].prev = entries[j].next = j;
+  } else {
+    entries[j].prev = entry.prev;
+    entries[j].next = entry.next;
+    entries[entry.prev].next = j;
+    entries[entry.next].prev = j;
+  }
+  if (handHot == i) handHot = j;
+  if (handCold == i) handCold = j;
+  if (handTest == i) handTest = j;
+}
+
+void ClockProPolicy::dropGhost(int i) {
+  ghostIndex.erase(entries[i].page);
+  unlink(i);
+  freeGhosts.push_back(i);
+  numGhosts--;
+}
+
+void ClockProPolicy::runHandHot() {
+  while (numHot > 0) {
+    // keep the test hand ahead of the hot hand
+    if (handHot == handTest) {
+      stepHandTest();
+    }
+    Entry& entry = entries[handHot];
+    handHot = entry.next;
+    if (entry.resident && entry.hot) {
+      if (entry.referenced) {
+        entry.referenced = false;
+      } else {
+        entry.hot = false;
+        numHot--;
+        numCold++;
+        return;
+      }
+    }
+  }
+}
+
+void ClockProPolicy::stepHandTest() {
+  int i = handTest;
+  if (entries[i].resident) {
+    handTest = entries[i].next;
+    return;
+  }
+
+  // the page was not asked for again in time, fewer cold pages would have done
+  dropGhost(i);
+  if (coldTarget > 1) {
+    coldTarget--;
+  }
+}
+
+void ClockProPolicy::runHandTest() {
+  int ghosts = numGhosts;
+  while (numGhosts == ghosts && ghosts > 0) {
+    stepHandTest();
+  }
+}
+
+void ClockProPolicy::loaded(FrameId frame, const File* file, PageId pageNo) {
+  std::lock_guard<std::mutex> guard(latch);
+  int i = frame;
+  Entry& entry = entries[i];
+  if (entry.onClock) {
+    entry.hot ? numHot-- : numCold--;
+    unlink(i);
+  }
+  entry.page = PageKey(file, pageNo);
+  entry.resident = true;
+  entry.referenced = false;
+
+  std::map<PageKey, int>::iterator ghost = ghostIndex.find(entry.page);
+  if (ghost == ghostIndex.end()) {
+    entry.hot = false;
+    numCold++;
+    link(i);
+    return;
+  }
+
+  // evicted while on test: it is hot, and more cold pages would have kept it
+  dropGhost(ghost->second);
+  if (coldTarget < std::max(1, numBufs - 1)) {
+    coldTarget++;
+  }
+  entry.hot = true;
+  numHot++;
+  link(i);
+  while (numHot > 0 && numHot > numBufs - coldTarget) {
+    runHandHot();
+  }
+}
+
+void ClockProPolicy::accessed(FrameId frame) {
+  std::lock_guard<std::mutex> guard(latch);
+  if (entries[frame].onClock) {
+    entries[frame].referenced = true;
+  }
+}
+
+void ClockProPolicy::removed(FrameId frame, bool evicted) {
+  std::lock_guard<std::mutex> guard(latch);
+  int i = frame;
+  Entry& entry = entries[i];
+  if (!entry.onClock) {
+    return;
+  }
+  entry.hot ? numHot-- : numCold--;
+  if (!evicted || entry.hot) {
+    unlink(i);
+    return;
+  }
+
+  // the number of an evicted cold page stays where the page was
+  if (numGhosts >= numBufs) {
+    runHandTest();
+  }
+  int j = freeGhosts.back();
+  freeGhosts.pop_back();
+  entries[j].page = entry.page;
+  entries[j].resident = false;
+  entries[j].hot = false;
+  entries[j].referenced = false;
+  replace(i, j);
+  ghostIndex[entries[j].page] = j;
+  numGhosts++;
+}
+
+bool ClockProPolicy::victim(FrameId& frame,
+                           const std::function<bool(FrameId)>& evictable) {
+  std::lock_guard<std::mutex> guard(latch);
+  int size = numHot + numCold + numGhosts;
+  for (int steps = 0; numHot + numCold > 0 && steps < 4 * size; steps++) {
+    // once a round of the clock found no cold page to evict, turn hot pages
+    // cold until one is
+    if (numCold == 0 || steps >= size) {
+      runHandHot();
+    }
+    int i = handCold;
+    Entry& entry = entries[i];
+    handCold = entry.next;
+    if (!entry.resident || entry.hot) {
+      continue;
+    }
+    if (entry.referenced) {
+      // referenced again while on test
+      entry.referenced = false;
+      entry.hot = true;
+      numCold--;
+      numHot++;
+      while (numHot > 0 && numHot > numBufs - coldTarget) {
+        runHandHot();
+      }
+      continue;
+    }
+    if (evictable(i)) {
+      frame = i;
+      return true;
+    }
+  }
+  return false;
+}
+
+}  // namespace badgerdb
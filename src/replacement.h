@@ -0,0 +1,509 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University
+ * of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "file.h"
+#include "types.h"
+
+namespace badgerdb {
+
+/**
+ * @brief Replacement policies a BufMgr can be constructed with.
+ */
+enum ReplacementPolicyType {
+  CLOCK_POLICY = 0,    /* One reference bit per frame, swept by a clock hand */
+  LRUK_POLICY = 1,     /* Evict the page whose K-th last access is oldest */
+  TWOQ_POLICY = 2,     /* Pages seen once wait in a FIFO before the LRU */
+  ARC_POLICY = 3,      /* Adaptive balance of recency and frequency */
+  CLOCKPRO_POLICY = 4  /* Clock over hot and cold pages with a test period */
+};
+
+/**
+ * @brief Chooses which page of the buffer pool to evict.
+ *
+ * The buffer manager tells the policy about every page placed in a frame,
+ * every later request for it and every page that leaves the pool, and asks
+ * it for a victim when it needs a frame and none is free. Frames without a
+ * page are handed out by the buffer manager itself before it asks.
+ *
+ * The buffer manager calls a policy from many threads at once, and never
+ * while holding the latch of a frame; policies synchronize themselves. The
+ * evictable callback passed to victim() takes the latch of the frame it is
+ * asked about, so a policy may call it under a latch of its own.
+ */
+class ReplacementPolicy {
+ public:
+  /**
+   * Returns a new policy of the given type for a pool of numBufs frames.
+   *
+   * @param type     Policy to create
+   * @param numBufs  Number of frames in the buffer pool
+   * @return  The policy, owned by the caller.
+   */
+  static ReplacementPolicy* create(ReplacementPolicyType type,
+                                   std::uint32_t numBufs);
+
+  virtual ~ReplacementPolicy() {}
+
+  /**
+   * Returns the name of the policy.
+   */
+  virtual const char* name() const = 0;
+
+  /**
+   * A page was read into or allocated in the frame.
+   *
+   * @param frame   Frame of the page
+   * @param file    File of the page
+   * @param pageNo  Page number in the file
+   */
+  virtual void loaded(FrameId frame, const File* file, PageId pageNo) = 0;
+
+  /**
+   * The page in the frame was asked for again while in the pool.
+   *
+   * @param frame   Frame of the page
+   */
+  virtual void accessed(FrameId frame) = 0;
+
+  /**
+   * The page in the frame left the pool.
+   *
+   * @param frame   Frame of the page
+   * @param evicted True if the page was evicted to make room, false if it
+   * was flushed or disposed of
+   */
+  virtual void removed(FrameId frame, bool evicted) = 0;
+
+  /**
+   * Chooses the frame whose page to evict. The page stays known to the policy
+   * until removed() is called for it, as the buffer manager may fail to evict
+   * it after all.
+   *
+   * @param frame     Receives the frame chosen
+   * @param evictable Returns true if the page in a frame can be evicted now
+   * @return  False if no page can be evicted.
+   */
+  virtual bool victim(FrameId& frame,
+                      const std::function<bool(FrameId)>& evictable) = 0;
+};
+
+/**
+ * @brief A page, as remembered by policies that keep track of pages no longer
+ * in the pool.
+ */
+typedef std::pair<const File*, PageId> PageKey;
+
+/**
+ * @brief The clock algorithm: a hand sweeps over the frames, clearing the
+ * reference bit of pages that have one and evicting the first page without.
+ * Takes no latch; threads sweeping at once each advance the hand for
+ * themselves.
+ */
+class ClockPolicy : public ReplacementPolicy {
+ private:
+  /**
+   * Number of frames in the buffer pool
+   */
+  std::uint32_t numBufs;
+
+  /**
+   * Current position of clockhand in our buffer pool
+   */
+  std::atomic<FrameId> clockHand;
+
+  /**
+   * Reference bit of each frame
+   */
+  std::unique_ptr<std::atomic<bool>[]> refbits;
+
+  /**
+   * Advance clock to next frame in the buffer pool. Threads advancing it at
+   * once each get a frame of their own.
+   *
+   * @return  The frame the clock hand has moved to.
+   */
+  FrameId advanceClock();
+
+ public:
+  explicit ClockPolicy(std::uint32_t numBufs);
+  const char* name() const { return "CLOCK"; }
+  void loaded(FrameId frame, const File* file, PageId pageNo);
+  void accessed(FrameId frame);
+  void removed(FrameId frame, bool evicted);
+  bool victim(FrameId& frame, const std::function<bool(FrameId)>& evictable);
+};
+
+/**
+ * @brief LRU-K: evicts the page whose K-th most recent access lies furthest
+ * back, pages accessed fewer than K times first and among those the least
+ * recently used. A page swept once by a scan therefore goes before any page
+ * asked for twice. Only the history of pages in the pool is kept.
+ */
+class LRUKPolicy : public ReplacementPolicy {
+ private:
+  /**
+   * Protects the members below
+   */
+  std::mutex latch;
+
+  /**
+   * Number of accesses remembered per page
+   */
+  int k;
+
+  /**
+   * Logical time, advanced on every access
+   */
+  std::uint64_t now;
+
+  /**
+   * Name of the policy, with k in it
+   */
+  std::string policyName;
+
+  /**
+   * Times of the last k accesses of the page in each frame, most recent
+   * first, zero where there are fewer
+   */
+  std::vector<std::uint64_t> history;
+
+  /**
+   * True for the frames holding a page
+   */
+  std::vector<bool> resident;
+
+  /**
+   * Order of eviction of a page: the time of its K-th last access, zero for
+   * pages accessed fewer than K times, then the time of its last access
+   */
+  typedef std::pair<std::pair<std::uint64_t, std::uint64_t>, FrameId> Rank;
+
+  /**
+   * Ranks of the frames holding a page, the first to evict first
+   */
+  std::set<Rank> ranks;
+
+  /**
+   * Returns the rank of the page in the frame.
+   */
+  Rank rankOf(FrameId frame) const;
+
+  /**
+   * Records an access to the page in the frame.
+   */
+  void touch(FrameId frame);
+
+ public:
+  LRUKPolicy(std::uint32_t numBufs, int k);
+  const char* name() const { return policyName.c_str(); }
+  void loaded(FrameId frame, const File* file, PageId pageNo);
+  void accessed(FrameId frame);
+  void removed(FrameId frame, bool evicted);
+  bool victim(FrameId& frame, const std::function<bool(FrameId)>& evictable);
+};
+
+/**
+ * @brief Full 2Q: pages enter a FIFO (A1in) and are evicted from it unless
+ * asked for again after leaving it, while their number is still remembered
+ * (A1out); only then do they join the LRU list (Am) of hot pages. A1in holds
+ * a quarter of the pool and A1out remembers half of it.
+ */
+class TwoQPolicy : public ReplacementPolicy {
+ private:
+  /**
+   * List a frame is on
+   */
+  enum Queue { NONE, A1IN, AM };
+
+  /**
+   * Protects the members below
+   */
+  std::mutex latch;
+
+  /**
+   * Target size of A1in
+   */
+  std::size_t kin;
+
+  /**
+   * Size of A1out
+   */
+  std::size_t kout;
+
+  /**
+   * FIFO of the frames of pages seen once, newest first
+   */
+  std::list<FrameId> a1in;
+
+  /**
+   * LRU list of the frames of hot pages, most recently used first
+   */
+  std::list<FrameId> am;
+
+  /**
+   * FIFO of pages evicted from A1in, newest first
+   */
+  std::list<PageKey> a1out;
+
+  /**
+   * Position in a1out of each page on it
+   */
+  std::map<PageKey, std::list<PageKey>::iterator> a1outIndex;
+
+  /**
+   * List each frame is on
+   */
+  std::vector<Queue> queues;
+
+  /**
+   * Position of each frame on its list
+   */
+  std::vector<std::list<FrameId>::iterator> positions;
+
+  /**
+   * Page in each frame
+   */
+  std::vector<PageKey> pages;
+
+  /**
+   * Takes the frame off its list.
+   */
+  void detach(FrameId frame);
+
+  /**
+   * Returns the oldest frame of the list that can be evicted.
+   */
+  bool oldestEvictable(std::list<FrameId>& queue, FrameId& frame,
+                       const std::function<bool(FrameId)>& evictable);
+
+ public:
+  explicit TwoQPolicy(std::uint32_t numBufs);
+  const char* name() const { return "2Q"; }
+  void loaded(FrameId frame, const File* file, PageId pageNo);
+  void accessed(FrameId frame);
+  void removed(FrameId frame, bool evicted);
+  bool victim(FrameId& frame, const std::function<bool(FrameId)>& evictable);
+};
+
+/**
+ * @brief Adaptive Replacement Cache: pages seen once (T1) and pages seen more
+ * than once (T2) are kept on two LRU lists, along with the numbers of as many
+ * pages recently evicted from each (B1 and B2). A miss on a page of B1 grows
+ * the target size of T1, one on a page of B2 shrinks it.
+ */
+class ARCPolicy : public ReplacementPolicy {
+ private:
+  /**
+   * List a frame or page is on
+   */
+  enum Queue { NONE, T1, T2, B1, B2 };
+
+  /**
+   * Protects the members below
+   */
+  std::mutex latch;
+
+  /**
+   * Number of frames in the buffer pool
+   */
+  std::size_t capacity;
+
+  /**
+   * Target size of T1
+   */
+  std::size_t target;
+
+  /**
+   * LRU lists of frames, most recently used first
+   */
+  std::list<FrameId> t1, t2;
+
+  /**
+   * LRU lists of evicted pages, most recently evicted first
+   */
+  std::list<PageKey> b1, b2;
+
+  /**
+   * List and position of each page on B1 or B2
+   */
+  std::map<PageKey, std::pair<Queue, std::list<PageKey>::iterator>>
+      ghostIndex;
+
+  /**
+   * List each frame is on
+   */
+  std::vector<Queue> queues;
+
+  /**
+   * Position of each frame on its list
+   */
+  std::vector<std::list<FrameId>::iterator> positions;
+
+  /**
+   * Page in each frame
+   */
+  std::vector<PageKey> pages;
+
+  /**
+   * Takes the frame off its list.
+   */
+  void detach(FrameId frame);
+
+  /**
+   * Forgets the least recently evicted page of B1 or B2.
+   */
+  void dropGhost(Queue queue);
+
+  /**
+   * Forgets evicted pages until T1 and B1 together hold at most one page per
+   * frame and all four lists at most two.
+   */
+  void trimGhosts();
+
+  /**
+   * Returns the least recently used frame of the list that can be evicted.
+   */
+  bool oldestEvictable(std::list<FrameId>& queue, FrameId& frame,
+                       const std::function<bool(FrameId)>& evictable);
+
+ public:
+  explicit ARCPolicy(std::uint32_t numBufs);
+  const char* name() const { return "ARC"; }
+  void loaded(FrameId frame, const File* file, PageId pageNo);
+  void accessed(FrameId frame);
+  void removed(FrameId frame, bool evicted);
+  bool victim(FrameId& frame, const std::function<bool(FrameId)>& evictable);
+};
+
+/**
+ * @brief CLOCK-Pro: pages in the pool are hot or cold. A cold page referenced
+ * again before the cold hand comes by turns hot, and so does an evicted cold
+ * page read in again while its number is still on the clock. Three hands go
+ * round: the cold hand evicts cold pages, the hot hand turns unreferenced hot
+ * pages cold and the test hand takes the numbers of evicted pages off the
+ * clock. The target number of cold pages adapts: it grows when an evicted
+ * page comes back in time and shrinks when the test hand forgets one.
+ */
+class ClockProPolicy : public ReplacementPolicy {
+ private:
+  /**
+   * @brief A page on the clock. The entry of the page in frame i is entry i;
+   * entries from numBufs on are pages no longer in the pool.
+   */
+  struct Entry {
+    PageKey page;
+    bool onClock;
+    bool resident;
+    bool hot;
+    bool referenced;
+    int prev;
+    int next;
+  };
+
+  /**
+   * Protects the members below
+   */
+  std::mutex latch;
+
+  /**
+   * Number of frames in the buffer pool
+   */
+  int numBufs;
+
+  /**
+   * Every entry, pages in the pool first
+   */
+  std::vector<Entry> entries;
+
+  /**
+   * Entries of evicted pages not in use
+   */
+  std::vector<int> freeGhosts;
+
+  /**
+   * Entry of each evicted page on the clock
+   */
+  std::map<PageKey, int> ghostIndex;
+
+  /**
+   * Positions of the hands, -1 while the clock is empty. New entries go right
+   * behind the hot hand, the last place each hand gets to.
+   */
+  int handHot, handCold, handTest;
+
+  /**
+   * Number of hot pages, of cold pages in the pool and of evicted pages on
+   * the clock
+   */
+  int numHot, numCold, numGhosts;
+
+  /**
+   * Target number of cold pages in the pool
+   */
+  int coldTarget;
+
+  /**
+   * Puts an entry on the clock, right behind the hot hand.
+   */
+  void link(int i);
+
+  /**
+   * Takes an entry off the clock, moving the hands on it forward.
+   */
+  void unlink(int i);
+
+  /**
+   * Puts entry j on the clock in the place of entry i.
+   */
+  void replace(int i, int j);
+
+  /**
+   * Takes an evicted page off the clock and frees its entry.
+   */
+  void dropGhost(int i);
+
+  /**
+   * Moves the hot hand until it has turned a hot page cold.
+   */
+  void runHandHot();
+
+  /**
+   * Moves the test hand one entry forward, taking the entry off the clock if
+   * it is an evicted page.
+   */
+  void stepHandTest();
+
+  /**
+   * Moves the test hand until it has taken an evicted page off the clock.
+   */
+  void runHandTest();
+
+ public:
+  explicit ClockProPolicy(std::uint32_t numBufs);
+  const char* name() const { return "CLOCK-Pro"; }
+  void loaded(FrameId frame, const File* file, PageId pageNo);
+  void accessed(FrameId frame);
+  void removed(FrameId frame, bool evicted);
+  bool victim(FrameId& frame, const std::function<bool(FrameId)>& evictable);
+};
+
+}  // namespace badgerdb